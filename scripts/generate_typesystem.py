@@ -95,9 +95,23 @@ public:
 # 2: type name
 FIELD = "  // {0}\n  {1} {2};\n"
 
+# C++ field initializations template, the features are resolved once per type
+# 0: field names
+# 1: number of fields
+# 2: field initializations
+FIELD_INITS =\
+r"""    static const char *const names[] = {{{0}}};
+    const uima::Feature *features = getFeatures(names, {1});
+{2}"""
+
+# C++ field name template
+# 0: field name
+FIELD_NAME = "\"{0}\""
+
 # C++ field initialization template
 # 0: field name
-FIELD_INIT = "    {0}.init(this, \"{0}\");\n"
+# 1: index of the field
+FIELD_INIT = "    {0}.init(this, features, {1}, \"{0}\");\n"
 
 # Special id initialization
 FIELD_ID_INITIALIZATION =\
@@ -617,10 +631,14 @@ class Type:
     fullname = TYPE_FULL_NAME.format(namespace, subNamespace, self.name)
     typeTrait = TYPE_TRAIT.format(namespace, self.name, definitionName)
     definition = TYPE_DEFINITION.format(definitionName, fullname)
-    for f in self.features:
-      (field , fieldInit) = f.format()
+    fieldNames = []
+    for i, f in enumerate(self.features):
+      (field , fieldInit) = f.format(i)
       fields += field
       fieldInits += fieldInit
+      fieldNames.append(FIELD_NAME.format(f.name))
+    if fieldNames:
+      fieldInits = FIELD_INITS.format(", ".join(fieldNames), len(fieldNames), fieldInits)
 
     content = CLASS.format(self.description, self.name, self.supertype, fields, fieldInits)
     return (content, typeTrait, definition)
@@ -692,9 +710,9 @@ class Feature:
   def __str__(self):
     return STR_FEATURE.format(self.name, self.description, self.rangetype, self.multipleReferencesAllowed, self.elementType)
 
-  def format(self):
+  def format(self, index):
     field = FIELD.format(self.description, self.cType, self.name)
-    fieldInit = FIELD_INIT.format(self.name)
+    fieldInit = FIELD_INIT.format(self.name, index)
     if self.name == "id":
       fieldInit += FIELD_ID_INITIALIZATION
 
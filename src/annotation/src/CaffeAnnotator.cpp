@@ -50,7 +50,7 @@ private:
   bool caffe_normalize;
 
   cv::Mat color;
-  pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud;
+  pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr cloud;
 public:
 
   CaffeAnnotator(): DrawingAnnotator(__func__)
@@ -120,7 +120,10 @@ public:
     outInfo("process start");
     rs::SceneCas cas(tcas);
 
-    cas.get(VIEW_CLOUD, *cloud);
+    if(cas.has(VIEW_CLOUD))
+    {
+      cloud = cas.getShared<pcl::PointCloud<pcl::PointXYZRGBA> >(VIEW_CLOUD);
+    }
     cas.get(VIEW_COLOR_IMAGE_HD, color);
 
     rs::Scene scene = cas.getScene();
@@ -63,7 +63,7 @@ private:
   };
 
   cv::Mat disp;
-  pcl::PointCloud<PointT>::Ptr dispCloud;
+  pcl::PointCloud<PointT>::ConstPtr dispCloud;
   double pointSize;
   std::vector<OrientedBoundingBox> orientedBoundingBoxes;
   tf::StampedTransform camToWorld, worldToCam;
@@ -107,14 +107,17 @@ public:
     MEASURE_TIME;
     outInfo("process begins");
 
-    pcl::PointCloud<PointT>::Ptr cloud_ptr(new pcl::PointCloud<PointT>());
-
     rs::SceneCas cas(tcas);
     rs::Scene scene = cas.getScene();
     std::vector<rs::Cluster> clusters;
     std::vector<rs::Plane> planes;
 
-    cas.get(VIEW_CLOUD, *cloud_ptr);
+    pcl::PointCloud<PointT>::ConstPtr cloud_ptr = cas.getShared<pcl::PointCloud<PointT> >(VIEW_CLOUD);
+    if(!cloud_ptr)
+    {
+      outError("No point cloud in CAS!");
+      return UIMA_ERR_NONE;
+    }
     dispCloud = cloud_ptr;
     cas.get(VIEW_COLOR_IMAGE_HD, disp);
 
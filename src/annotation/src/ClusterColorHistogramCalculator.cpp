@@ -65,7 +65,7 @@ private:
   std::vector<std::vector<int>> colorIds;
   std::vector<std::vector<float>> colorRatios;
 
-  cv::Mat color;
+  rs::ImageView color;
 
 public:
   ClusterColorHistogramCalculator() : DrawingAnnotator(__func__), minValueColor(60), minSaturationColor(60), maxValueBlack(60), minValueWhite(120), histogramCols(16), histogramRows(16), colorRange(256.0 / 6.0)
@@ -142,7 +142,7 @@ private:
     rs::Scene scene = cas.getScene();
     std::vector<rs::Cluster> clusters;
 
-    cas.get(VIEW_COLOR_IMAGE_HD, color);
+    cas.getImageView(VIEW_COLOR_IMAGE_HD, color);
     rs::Query qs = rs::create<rs::Query>(tcas);
     std::string jsonQuery;
     if(cas.getFS("QUERY", qs))
@@ -171,7 +171,7 @@ private:
 
       clusterRois[idx] = roi;
 
-      color(roi).copyTo(rgb, mask);
+      color.get()(roi).copyTo(rgb, mask);
 
       cv::Mat hsv, hist;
       cv::cvtColor(rgb, hsv, CV_BGR2HSV_FULL);
@@ -40,7 +40,7 @@ private:
   cv::Ptr<cv::DescriptorExtractor> extractor;
   std::vector<cv::KeyPoint> keypoints;
 
-  cv::Mat color;
+  rs::ImageView color;
 
 public:
   FeatureAnnotator() : DrawingAnnotator(__func__), detector(NULL), extractor(NULL)
@@ -284,7 +284,7 @@ private:
     outInfo("process begins");
     rs::SceneCas cas(tcas);
 
-    cas.get(VIEW_COLOR_IMAGE_HD, color);
+    cas.getImageView(VIEW_COLOR_IMAGE_HD, color);
 
     keypoints.clear();
     processClusters(tcas);
@@ -328,7 +328,7 @@ private:
       rs::conversion::from(image_rois.roi_hires(), roi);
       rs::conversion::from(image_rois.mask_hires(), objMask);
 
-      extract(color, roi, objMask, keypoints, descriptors);
+      extract(color.get(), roi, objMask, keypoints, descriptors);
       outDebug("features found: " << keypoints.size());
 
       if(keypoints.empty())
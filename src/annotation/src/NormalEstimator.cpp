@@ -37,8 +37,8 @@ using namespace uima;
 class NormalEstimator : public DrawingAnnotator
 {
 private:
-  pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud_ptr;
-  pcl::PointCloud<pcl::PointXYZRGBA>::Ptr thermal_cloud_ptr;
+  pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr cloud_ptr;
+  pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr thermal_cloud_ptr;
   pcl::PointCloud<pcl::Normal>::Ptr normals_ptr;
   pcl::PointCloud<pcl::Normal>::Ptr thermal_normals_ptr;
 
@@ -102,13 +102,15 @@ public:
 
     // create scene cas wrapper for cas and get kinect frame
     rs::SceneCas cas(tcas);
-    if(useThermal && cas.get(VIEW_THERMAL_CLOUD, *thermal_cloud_ptr))
+    if(useThermal && cas.has(VIEW_THERMAL_CLOUD))
     {
+      thermal_cloud_ptr = cas.getShared<pcl::PointCloud<pcl::PointXYZRGBA> >(VIEW_THERMAL_CLOUD);
       compute_normals_pcl(thermal_cloud_ptr, thermal_normals_ptr);
       cas.set(VIEW_THERMAL_NORMALS, *thermal_normals_ptr);
     }
-    if(useRGB && cas.get(VIEW_CLOUD, *cloud_ptr))
+    if(useRGB && cas.has(VIEW_CLOUD))
     {
+      cloud_ptr = cas.getShared<pcl::PointCloud<pcl::PointXYZRGBA> >(VIEW_CLOUD);
       outInfo("Cloud Size: "<<cloud_ptr->points.size());
       if(cloud_ptr->isOrganized())
       {
@@ -126,7 +128,7 @@ public:
     return UIMA_ERR_NONE;
   }
 
-  void compute_normals_pcl(pcl::PointCloud< pcl::PointXYZRGBA>::Ptr &cloud_ptr, pcl::PointCloud< pcl::Normal>::Ptr &normals_ptr)
+  void compute_normals_pcl(const pcl::PointCloud< pcl::PointXYZRGBA>::ConstPtr &cloud_ptr, pcl::PointCloud< pcl::Normal>::Ptr &normals_ptr)
   {
     pcl::IntegralImageNormalEstimation< pcl::PointXYZRGBA, pcl::Normal> ne;
     ne.setNormalEstimationMethod(ne.COVARIANCE_MATRIX);
@@ -136,7 +138,7 @@ public:
     ne.compute(*normals_ptr);
   }
 
-  void compute_normals_unOrganizedCloud(pcl::PointCloud< pcl::PointXYZRGBA>::Ptr &cloud_ptr, pcl::PointCloud< pcl::Normal>::Ptr &normals_ptr)
+  void compute_normals_unOrganizedCloud(const pcl::PointCloud< pcl::PointXYZRGBA>::ConstPtr &cloud_ptr, pcl::PointCloud< pcl::Normal>::Ptr &normals_ptr)
   {
     pcl::NormalEstimation<pcl::PointXYZRGBA, pcl::Normal> ne;
     ne.setInputCloud(cloud_ptr);
@@ -150,7 +152,7 @@ public:
   {
     const std::string cloudname = this->name + "_cloud";
     const std::string normalsname = this->name + "_normals";
-    pcl::PointCloud< pcl::PointXYZRGBA>::Ptr out_cloud_ptr;
+    pcl::PointCloud< pcl::PointXYZRGBA>::ConstPtr out_cloud_ptr;
     pcl::PointCloud< pcl::Normal>::Ptr out_normals_ptr;
 
     switch(pclDispMode)
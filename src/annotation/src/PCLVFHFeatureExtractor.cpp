@@ -77,10 +77,13 @@ public:
       outDebug("VIEWPOINT:" << roll << " " << pitch << " " << yaw << std::endl);
     }
 
-    pcl::PointCloud<PointT>::Ptr cloudPtr(new pcl::PointCloud<PointT>);
-    pcl::PointCloud<pcl::Normal>::Ptr normalsPtr(new pcl::PointCloud<pcl::Normal>);
-    cas.get(VIEW_CLOUD, *cloudPtr);
-    cas.get(VIEW_NORMALS, *normalsPtr);
+    pcl::PointCloud<PointT>::ConstPtr cloudPtr = cas.getShared<pcl::PointCloud<PointT> >(VIEW_CLOUD);
+    pcl::PointCloud<pcl::Normal>::ConstPtr normalsPtr = cas.getShared<pcl::PointCloud<pcl::Normal> >(VIEW_NORMALS);
+    if(!cloudPtr || !normalsPtr)
+    {
+      outError("No point cloud or normals in CAS!");
+      return UIMA_ERR_NONE;
+    }
 
     pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT> ());
     vfh.setSearchMethod(tree);
@@ -82,9 +82,6 @@ public:
     MEASURE_TIME;
     // declare variables for kinect data
     outInfo("process start");
-    pcl::PointCloud<PointT>::Ptr cloud_ptr(new pcl::PointCloud<PointT>);
-    pcl::PointCloud<pcl::Normal>::Ptr normal_ptr(new pcl::PointCloud<pcl::Normal>);
-
     dispCloudPtr_.reset(new pcl::PointCloud<PointT>);
 
     rs::SceneCas cas(tcas);
@@ -93,8 +90,13 @@ public:
     std::vector<rs::Plane> planes;
     std::vector<float> plane_model;
 
-    cas.get(VIEW_CLOUD, *cloud_ptr);
-    cas.get(VIEW_NORMALS, *normal_ptr);
+    pcl::PointCloud<PointT>::ConstPtr cloud_ptr = cas.getShared<pcl::PointCloud<PointT> >(VIEW_CLOUD);
+    pcl::PointCloud<pcl::Normal>::ConstPtr normal_ptr = cas.getShared<pcl::PointCloud<pcl::Normal> >(VIEW_NORMALS);
+    if(!cloud_ptr || !normal_ptr)
+    {
+      outError("No point cloud or normals in CAS!");
+      return UIMA_ERR_NONE;
+    }
 
     scene.identifiables.filter(clusters);
     scene.annotations.filter(planes);
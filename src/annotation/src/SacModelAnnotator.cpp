@@ -67,10 +67,13 @@ public:
     rs::SceneCas cas(tcas);
     rs::Scene scene = cas.getScene();
 
-    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud_ptr(new pcl::PointCloud<pcl::PointXYZRGBA>);
-    pcl::PointCloud<pcl::Normal>::Ptr normals_ptr(new pcl::PointCloud<pcl::Normal>);
-    cas.get(VIEW_CLOUD, *cloud_ptr);
-    cas.get(VIEW_NORMALS, *normals_ptr);
+    pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr cloud_ptr = cas.getShared<pcl::PointCloud<pcl::PointXYZRGBA> >(VIEW_CLOUD);
+    pcl::PointCloud<pcl::Normal>::ConstPtr normals_ptr = cas.getShared<pcl::PointCloud<pcl::Normal> >(VIEW_NORMALS);
+    if(!cloud_ptr || !normals_ptr)
+    {
+      outError("No point cloud or normals in CAS!");
+      return UIMA_ERR_NONE;
+    }
 
 
     std::vector<rs::Cluster> clusters;
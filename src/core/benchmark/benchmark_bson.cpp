@@ -0,0 +1,156 @@
+/**
+ * Copyright 2014 University of Bremen, Institute for Artificial Intelligence
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// STL
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// UIMA
+#include <uima/api.hpp>
+
+// OpenCV
+#include <opencv2/opencv.hpp>
+
+// RS
+#include <rs/scene_cas.h>
+#include <rs/conversion/bson.h>
+#include <rs/utils/output.h>
+
+/**
+ * Builds a scene like the ones stored by the storage writer: clusters with an image ROI including
+ * masks, a geometry, a size, a shape and a color annotation each.
+ */
+static rs::Scene createScene(uima::CAS &cas, const int clusters)
+{
+  rs::Scene scene = rs::create<rs::Scene>(cas);
+  scene.timestamp.set(1234567890);
+
+  for(int i = 0; i < clusters; ++i)
+  {
+    const cv::Rect rect(10 * i, 20, 64, 48);
+    rs::ImageROI roi = rs::create<rs::ImageROI>(cas);
+    roi.roi(rs::conversion::to(cas, cv::Rect(rect.x / 2, rect.y / 2, rect.width / 2, rect.height / 2)));
+    roi.roi_hires(rs::conversion::to(cas, rect));
+    roi.mask(rs::conversion::to(cas, cv::Mat(rect.height / 2, rect.width / 2, CV_8U, cv::Scalar(255))));
+    roi.mask_hires(rs::conversion::to(cas, cv::Mat(rect.height, rect.width, CV_8U, cv::Scalar(255))));
+
+    rs::BoundingBox3D box = rs::create<rs::BoundingBox3D>(cas);
+    box.volume(0.001f * i);
+    box.width(0.1f);
+    box.depth(0.1f);
+    box.height(0.1f * i);
+
+    rs::Geometry geometry = rs::create<rs::Geometry>(cas);
+    geometry.boundingBox(box);
+    geometry.size("medium");
+    geometry.distanceToPlane.set(0.01 * i);
+
+    rs::SemanticSize size = rs::create<rs::SemanticSize>(cas);
+    size.size.set("medium");
+    size.confidence.set(0.5f);
+
+    rs::Shape shape = rs::create<rs::Shape>(cas);
+    shape.shape.set("box");
+    shape.confidence.set(0.75f);
+
+    rs::SemanticColor color = rs::create<rs::SemanticColor>(cas);
+    color.color(std::vector<std::string> {"red", "white", "black"});
+    color.ratio(std::vector<float> {0.6f, 0.3f, 0.1f});
+
+    rs::Cluster cluster = rs::create<rs::Cluster>(cas);
+    cluster.rois(roi);
+    cluster.source.set("Benchmark");
+    cluster.annotations.append(geometry);
+    cluster.annotations.append(size);
+    cluster.annotations.append(shape);
+    cluster.annotations.append(color);
+    scene.identifiables.append(cluster);
+  }
+  return scene;
+}
+
+static double elapsed(const std::chrono::steady_clock::time_point &start)
+{
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Times rs::conversion::fromFeatureStructure and rs::conversion::toFeatureStructure on a scene with
+ * the given number of clusters, in a CAS created from the given type system descriptor. The first
+ * conversion in each direction also builds the plans of the types involved and is reported on its
+ * own. Usage: benchmark_bson [descriptor] [clusters] [iterations]
+ */
+int main(int argc, char **argv)
+{
+  const std::string file = argc > 1 ? argv[1] : TYPESYSTEM_XML_PATH "/all_types.xml";
+  const int clusters = argc > 2 ? std::max(1, atoi(argv[2])) : 20;
+  const int iterations = argc > 3 ? std::max(1, atoi(argv[3])) : 1000;
+
+  uima::ResourceManager::createInstance("benchmark_bson");
+  uima::ErrorInfo errorInfo;
+  uima::TypeSystem *typeSystem = uima::Framework::createTypeSystem(file.c_str(), errorInfo);
+  if(errorInfo.getErrorId() != UIMA_ERR_NONE)
+  {
+    outError("could not create the type system from " << file << ": " << errorInfo.asString());
+    return 1;
+  }
+  uima::CAS *cas = uima::Framework::createCAS(*typeSystem, errorInfo);
+  if(errorInfo.getErrorId() != UIMA_ERR_NONE)
+  {
+    outError("could not create a CAS: " << errorInfo.asString());
+    delete typeSystem;
+    return 1;
+  }
+
+  const rs::Scene scene = createScene(*cas, clusters);
+  const mongo::OID parent = mongo::OID::gen();
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  mongo::BSONObj object = rs::conversion::fromFeatureStructure(scene, parent);
+  const double firstFrom = elapsed(start);
+
+  start = std::chrono::steady_clock::now();
+  for(int i = 0; i < iterations; ++i)
+  {
+    object = rs::conversion::fromFeatureStructure(scene, parent);
+  }
+  const double from = elapsed(start) / iterations;
+
+  // every conversion creates new feature structures, the CAS is only reset after the run
+  start = std::chrono::steady_clock::now();
+  uima::FeatureStructure fs = rs::conversion::toFeatureStructure(*cas, object);
+  const double firstTo = elapsed(start);
+
+  start = std::chrono::steady_clock::now();
+  for(int i = 0; i < iterations; ++i)
+  {
+    fs = rs::conversion::toFeatureStructure(*cas, object);
+  }
+  const double to = elapsed(start) / iterations;
+
+  printf("scene with %d clusters, %d bytes of BSON\n", clusters, object.objsize());
+  printf("fromFeatureStructure first %10.1f us  average %10.1f us\n", firstFrom, from);
+  printf("toFeatureStructure   first %10.1f us  average %10.1f us\n", firstTo, to);
+
+  cas->reset();
+  delete cas;
+  delete typeSystem;
+  return 0;
+}
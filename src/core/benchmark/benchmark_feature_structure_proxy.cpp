@@ -0,0 +1,112 @@
+/**
+ * Copyright 2014 University of Bremen, Institute for Artificial Intelligence
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// STL
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+// UIMA
+#include <uima/api.hpp>
+
+// RS
+#include <rs/types/all_types.h>
+#include <rs/utils/output.h>
+
+// counter of one thread, padded so that no two counters share a cache line, however the vector is aligned
+struct Counter
+{
+  size_t valid;
+  char padding[128 - sizeof(size_t)];
+};
+
+/**
+ * Times the construction of proxies of type T wrapping an existing feature structure, in the given
+ * number of threads at once. Returns the average time per proxy in nanoseconds.
+ */
+template<typename T>
+static double benchmark(const uima::FeatureStructure &fs, const int iterations, const int threads)
+{
+  std::vector<std::thread> workers;
+  std::vector<Counter> valid(threads, Counter());
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for(int t = 0; t < threads; ++t)
+  {
+    workers.push_back(std::thread([&fs, &valid, iterations, t]()
+    {
+      for(int i = 0; i < iterations; ++i)
+      {
+        T proxy(fs);
+        valid[t].valid += proxy.type().isValid();
+      }
+    }));
+  }
+  for(int t = 0; t < threads; ++t)
+  {
+    workers[t].join();
+  }
+  const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  return ns / ((double)iterations * threads);
+}
+
+template<typename T>
+static void benchmark(uima::CAS &cas, const int iterations, const int threads)
+{
+  // the first proxy creates the feature structure and builds the feature table of its type
+  const T first = rs::create<T>(cas);
+  const uima::FeatureStructure fs = first;
+  printf("%-20s 1 thread %8.1f ns  %2d threads %8.1f ns\n", TypeTrait<T>::name(),
+         benchmark<T>(fs, iterations, 1), threads, benchmark<T>(fs, iterations, threads));
+}
+
+/**
+ * Times the construction of rs::FeatureStructureProxy subclasses on a CAS created from the given
+ * type system descriptor. Usage: benchmark_feature_structure_proxy [descriptor] [iterations]
+ */
+int main(int argc, char **argv)
+{
+  const std::string file = argc > 1 ? argv[1] : TYPESYSTEM_XML_PATH "/scene_types.xml";
+  const int iterations = argc > 2 ? std::max(1, atoi(argv[2])) : 100000;
+  const int threads = std::max(2, (int)std::thread::hardware_concurrency());
+
+  uima::ResourceManager::createInstance("benchmark_feature_structure_proxy");
+  uima::ErrorInfo errorInfo;
+  uima::TypeSystem *typeSystem = uima::Framework::createTypeSystem(file.c_str(), errorInfo);
+  if(errorInfo.getErrorId() != UIMA_ERR_NONE)
+  {
+    outError("could not create the type system from " << file << ": " << errorInfo.asString());
+    return 1;
+  }
+  uima::CAS *cas = uima::Framework::createCAS(*typeSystem, errorInfo);
+  if(errorInfo.getErrorId() != UIMA_ERR_NONE)
+  {
+    outError("could not create a CAS: " << errorInfo.asString());
+    delete typeSystem;
+    return 1;
+  }
+
+  benchmark<rs::Cluster>(*cas, iterations, threads);
+  benchmark<rs::ImageROI>(*cas, iterations, threads);
+  benchmark<rs::Rect>(*cas, iterations, threads);
+  benchmark<rs::Point3f>(*cas, iterations, threads);
+
+  delete cas;
+  delete typeSystem;
+  return 0;
+}
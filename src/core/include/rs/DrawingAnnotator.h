@@ -24,6 +24,8 @@
 #include <map>
 #include <string>
 #include <mutex>
+#include <atomic>
+#include <memory>
 
 #include <uima/api.hpp>
 
@@ -33,7 +35,18 @@
 #include <pcl/point_cloud.h>
 
 #include <rs/utils/output.h>
+#include <rs/utils/time.h>
 
+/**
+ * Base of annotators that can be displayed by the visualizer.
+ *
+ * While an annotator is displayed, process publishes a snapshot of its image and of its cloud at
+ * the end of every frame. The cloud is the one set by snapshotCloudWithLock, or the scene cloud if
+ * the annotator does not set one. The viewers render the latest snapshot without locking the
+ * annotator, so neither waits for the other. Images outdated by a mouse or key callback, and the
+ * cloud viewer of annotators without snapshotCloudWithLock, which may draw shapes in
+ * fillVisualizerWithLock, are drawn directly, if the annotator is not processing at that moment.
+ */
 class DrawingAnnotator : public uima::Annotator
 {
 public:
@@ -48,9 +61,30 @@ public:
   bool hasRun;
 
 private:
+  struct Snapshot
+  {
+    cv::Mat image;
+    pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr cloud;
+    double pointSize;
+    // the cloud was set by snapshotCloudWithLock, which replaces fillVisualizerWithLock
+    bool ownCloud;
+  };
+
   static std::map<std::string, DrawingAnnotator *> annotators;
+  static std::atomic<DrawingAnnotator *> displayed;
+  // only images are published, and only when requested
+  static std::atomic<bool> imageOnly;
 
   std::mutex drawLock;
+  rs::LatencyHistogram &latency;
+
+  // written by process, read by the viewers with atomic_load
+  std::shared_ptr<const Snapshot> snapshot;
+  std::atomic<bool> stale;
+  std::atomic<bool> requested;
+
+  void publishSnapshot(uima::CAS &tcas);
+  void drawSnapshotCloud(const Snapshot &current, pcl::visualization::PCLVisualizer &visualizer, const bool firstRun);
 
 public:
   DrawingAnnotator(const std::string &name);
@@ -59,6 +93,22 @@ public:
   static void getAnnotatorNames(std::vector<std::string> &names);
   static DrawingAnnotator *getAnnotator(const std::string &name);
 
+  /**
+   * Sets the annotator shown by the visualizer, the only one publishing snapshots. NULL if none.
+   * With onRequest, it only publishes its image, and only for frames after requestSnapshot.
+   */
+  static void setDisplayed(DrawingAnnotator *annotator, const bool onRequest = false);
+
+  /**
+   * Makes the next frame publish a snapshot if the annotator is displayed on request.
+   */
+  void requestSnapshot();
+
+  /**
+   * Marks the published snapshot as outdated, e.g. after a callback changed what is drawn.
+   */
+  void invalidateSnapshot();
+
   uima::TyErrorId process(uima::CAS &tcas, uima::ResultSpecification const &res_spec);
 
   void drawImage(cv::Mat &disp);
@@ -71,7 +121,20 @@ protected:
   virtual uima::TyErrorId processWithLock(uima::CAS &tcas, uima::ResultSpecification const &res_spec) = 0;
 
   virtual void drawImageWithLock(cv::Mat &disp);
+
+  /**
+   * Fills the cloud viewer while holding the lock of the annotator, called by the viewer if the annotator
+   * does not set a cloud in snapshotCloudWithLock and is not processing. Shows the scene cloud by default.
+   */
   virtual void fillVisualizerWithLock(pcl::visualization::PCLVisualizer &visualizer, const bool firstRun);
+
+  /**
+   * Sets the cloud shown by the cloud viewer, called at the end of process while the annotator is
+   * displayed. The cloud is shared with the viewer and must not be changed afterwards, so process
+   * should create a new cloud every frame instead of reusing one. If a cloud is set, the viewer shows
+   * it without locking and fillVisualizerWithLock is not called.
+   */
+  virtual void snapshotCloudWithLock(pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr &cloud, double &pointSize);
 };
 
 #endif //__DRAWING_ANNOTATOR_H__
@@ -16,6 +16,10 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+// STL
+#include <string>
+#include <vector>
+
 // UIMA
 #include <uima/api.hpp>
 
@@ -28,6 +32,15 @@ namespace conversion
 {
 
 mongo::BSONObj fromFeatureStructure(const uima::FeatureStructure &fs, const mongo::OID &parent);
+
+/**
+ * Same as fromFeatureStructure, but byte array features of fs with at least blobSize elements are
+ * not converted. They are returned as (feature name, array) pairs in blobs instead, so that the
+ * caller can store them separately. Only features of fs itself are checked, byte arrays of nested
+ * feature structures are always converted.
+ */
+mongo::BSONObj fromFeatureStructure(const uima::FeatureStructure &fs, const mongo::OID &parent, const size_t blobSize, std::vector<std::pair<std::string, uima::ByteArrayFS> > &blobs);
+
 uima::FeatureStructure toFeatureStructure(uima::CAS &cas, const mongo::BSONObj &object);
 
 }
@@ -0,0 +1,136 @@
+/**
+ * Copyright 2014 University of Bremen, Institute for Artificial Intelligence
+ * Author(s): Ferenc Balint-Benczedi <balintbe@cs.uni-bremen.de>
+ *         Thiemo Wiedemeyer <wiedemeyer@cs.uni-bremen.de>
+ *         Jan-Hendrik Worch <jworch@cs.uni-bremen.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __JSON_H__
+#define __JSON_H__
+
+// STL
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// UIMA
+#include <uima/api.hpp>
+
+namespace rs
+{
+namespace conversion
+{
+
+/**
+ * Writes feature structures as JSON directly from the CAS into a reusable buffer. Every object gets
+ * its type as "_type" and one field per feature. Arrays and lists are written as JSON arrays.
+ *
+ * Features can be filtered by name on all levels, either by denying some or by allowing only some.
+ * The filter is resolved once per type, filtered features are never read from the CAS.
+ */
+class JsonWriter
+{
+public:
+  enum Kind
+  {
+    KIND_OBJECT = 0,
+    KIND_BOOLEAN,
+    KIND_BYTE,
+    KIND_SHORT,
+    KIND_INT,
+    KIND_LONG,
+    KIND_FLOAT,
+    KIND_DOUBLE,
+    KIND_STRING,
+    KIND_BOOLEAN_ARRAY,
+    KIND_BYTE_ARRAY,
+    KIND_SHORT_ARRAY,
+    KIND_INT_ARRAY,
+    KIND_LONG_ARRAY,
+    KIND_FLOAT_ARRAY,
+    KIND_DOUBLE_ARRAY,
+    KIND_STRING_ARRAY,
+    KIND_FS_ARRAY,
+    KIND_INT_LIST,
+    KIND_FLOAT_LIST,
+    KIND_STRING_LIST,
+    KIND_FS_LIST
+  };
+
+private:
+  struct FeaturePlan
+  {
+    uima::Feature feature;
+    // quoted name followed by a colon
+    std::string key;
+    Kind kind;
+  };
+
+  struct TypePlan
+  {
+    std::string type;
+    Kind kind;
+    std::vector<FeaturePlan> features;
+  };
+
+  const uima::TypeSystem *typeSystem;
+  std::map<uima::Type, Kind> kinds;
+  std::map<uima::Type, TypePlan> plans;
+
+  std::set<std::string> fields;
+  bool allow;
+
+  const TypePlan &getPlan(const uima::Type &type);
+  Kind getKind(const uima::Type &type) const;
+  void initKinds(const uima::TypeSystem &ts);
+
+  void writeFeature(const uima::FeatureStructure &fs, const FeaturePlan &plan);
+  void writeArray(const uima::FeatureStructure &fs, const Kind kind);
+  void writeString(const uima::UnicodeStringRef &ref);
+  void writeString(const std::string &str);
+  void writeNumber(const double value, const int precision);
+  void writeNumber(const long long value);
+
+public:
+  // the JSON written so far, can also be appended to directly
+  std::string buffer;
+
+  JsonWriter();
+
+  /**
+   * Features with one of these names are not written.
+   */
+  void setDeniedFields(const std::vector<std::string> &names);
+
+  /**
+   * Only features with one of these names are written, also in nested objects.
+   */
+  void setAllowedFields(const std::vector<std::string> &names);
+
+  /**
+   * Empties the buffer, keeping its memory.
+   */
+  void clear();
+
+  /**
+   * Appends fs to the buffer. Invalid feature structures are written as null.
+   */
+  void write(const uima::FeatureStructure &fs);
+};
+
+}
+}
+
+#endif // __JSON_H__
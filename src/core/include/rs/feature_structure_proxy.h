@@ -31,10 +31,16 @@
 #ifndef FEATURE_STRUCTURE_PROXY_H_
 #define FEATURE_STRUCTURE_PROXY_H_
 
+#include <map>
+#include <mutex>
+#include <vector>
+#include <string>
+
 #include <uima/api.hpp>
 
 #include <rs/utils/accessor.h>
 #include <rs/utils/output.h>
+#include <rs/utils/write_gate.h>
 #include <rs/utils/array_accessor.h>
 
 // MONGO
@@ -91,9 +97,56 @@ uima::Type type(uima::CAS &cas)
 template<typename T>
 T create(uima::CAS &cas)
 {
+  WriteGate::enter();
   return T(cas.createFS(type<T>(cas)));
 }
 
+/**
+ * FeatureTable holds the resolved uima::Feature handles of a uima::Type, so that features can be
+ * accessed by name without going through uima::Type::getFeatureByBaseName. There is one table per
+ * type and type system, it is built on first use and kept for the lifetime of the process.
+ */
+class FeatureTable
+{
+private:
+  std::vector<std::pair<std::string, uima::Feature> > features_;
+
+  // features of lists of names, see get(names, count)
+  mutable std::mutex slotsLock_;
+  mutable std::map<const char *const *, std::vector<uima::Feature> > slots_;
+
+  FeatureTable(const uima::Type &type);
+
+public:
+  /**
+   * Gets the table for the given type. Returns NULL for invalid types. Only the first lookup of a type in
+   * each thread takes a lock.
+   */
+  static const FeatureTable *of(const uima::Type &type);
+
+  /**
+   * Gets the feature with the given base name, or an invalid feature if the type has no such feature.
+   */
+  uima::Feature get(const char *name) const;
+
+  /**
+   * Gets the features with the given base names, in the same order. They are only looked up on the first call
+   * for names, which is identified by its address and has to stay valid for the lifetime of the process, like
+   * the static name array of a generated proxy class.
+   */
+  const uima::Feature *get(const char *const *names, const size_t count) const;
+};
+
+/**
+ * Gets the feature with the given base name of the type of fs using the FeatureTable of the type.
+ */
+inline uima::Feature getFeature(const uima::FeatureStructure &fs, const char *name)
+{
+  const uima::Type &type = fs.getType();
+  const FeatureTable *table = FeatureTable::of(type);
+  return table ? table->get(name) : type.getFeatureByBaseName(name);
+}
+
 /**
  * FeatureStructureProxy provides a thin proxy for a uima::FeatureStructure to more easily
  * work with UIMA types and objects. There should be a subclass of FeatureStructureProxy for
@@ -114,10 +167,11 @@ class FeatureStructureProxy
 private:
   uima::Type type_;
   uima::FeatureStructure fs_;
+  const FeatureTable *features_;
 
 protected:
 
-  FeatureStructureProxy()
+  FeatureStructureProxy() : features_(NULL)
   {
 
   }
@@ -134,17 +188,28 @@ protected:
     return rs::type<T>(fs_.getCAS());
   }
 
+  /**
+   * Gets the features of the fields of a proxy class, see FeatureTable::get(names, count). Returns NULL for
+   * invalid types.
+   */
+  const uima::Feature *getFeatures(const char *const *names, const size_t count) const
+  {
+    return features_ ? features_->get(names, count) : NULL;
+  }
+
 public:
   FeatureStructureProxy(uima::FeatureStructure fs)
   {
     type_ = fs.getType();
     fs_ = fs;
+    features_ = FeatureTable::of(type_);
   }
 
   FeatureStructureProxy(const FeatureStructureProxy &other)
   {
     type_ = other.type_;
     fs_ = other.fs_;
+    features_ = other.features_;
   }
 
   uima::Type type() const
@@ -190,9 +255,22 @@ public:
   }
 
   void init(FeatureStructureProxy *parent, const char *name)
+  {
+    init(parent, parent->features_ ? parent->features_->get(name) : parent->type_.getFeatureByBaseName(name), name);
+  }
+
+  /**
+   * Initializes the entry with a feature already resolved by the proxy, see FeatureStructureProxy::getFeatures.
+   */
+  void init(FeatureStructureProxy *parent, const uima::Feature *features, const size_t slot, const char *name)
+  {
+    init(parent, features ? features[slot] : parent->type_.getFeatureByBaseName(name), name);
+  }
+
+  void init(FeatureStructureProxy *parent, const uima::Feature &feature, const char *name)
   {
     parent_ = parent;
-    feature_ = parent->type_.getFeatureByBaseName(name);
+    feature_ = feature;
     if(!feature_.isValid())
     {
       outError("Error: invalid feature when initializing! check your typesystem.xml file!" << std::endl
@@ -215,6 +293,7 @@ public:
 
   virtual void set(const T &value)
   {
+    WriteGate::enter();
     accessor::Accessor<T>::set(this->fs(), feature_, value);
   }
 
@@ -298,6 +377,7 @@ public:
 
   virtual void set(const T &value)
   {
+    WriteGate::enter();
     this->fs().setFSValue(this->feature_, (uima::FeatureStructure)value);
   }
 };
@@ -576,6 +656,48 @@ public:
   }
 };
 
+/**
+ * ListIndex groups the elements of a uima::ListFS by their type, so that lists do not have to be
+ * walked for every filter call. An index is identified by the first node of its list, it is built
+ * on first use and kept up to date by appending through ListFeatureStructureEntry. Lists changed
+ * by other means are detected as long as only new elements were appended to them; removing
+ * elements has to go through ListFeatureStructureEntry::remove.
+ */
+class ListIndex
+{
+public:
+  /**
+   * Appends value to the non-empty list starting at head in constant time. Returns false if the
+   * list is empty, in which case nothing was appended.
+   */
+  static bool append(uima::ListFS head, const uima::FeatureStructure &value);
+
+  /**
+   * Appends all elements of type (or of a subtype of type, if subtypes is set) to result, in list order.
+   */
+  static void filter(uima::ListFS head, const uima::Type &type, std::vector<uima::FeatureStructure> &result, const bool subtypes = false);
+
+  /**
+   * Gets the first element of type. Returns false if the list has no such element.
+   */
+  static bool getFirst(uima::ListFS head, const uima::Type &type, uima::FeatureStructure &result);
+
+  /**
+   * Drops the index of the list starting at head.
+   */
+  static void invalidate(uima::ListFS head);
+
+  /**
+   * Drops all indices.
+   */
+  static void clear();
+
+  /**
+   * Drops all indices of lists in cas. Has to be called before the CAS is reset.
+   */
+  static void clear(uima::CAS &cas);
+};
+
 /**
  * ListFeatureStructureEntry allows easy access to the value of a UIMA feature of a
  * list type. The list element type has to be a int, float, string or a subclass of
@@ -596,6 +718,28 @@ private:
   {
     this->fs().setFSValue(this->feature_, list);
   }
+
+  // only lists of feature structures are indexed
+  template<typename ListT, typename ElementT>
+  static bool _appendIndexed(const ListT &list, const ElementT &value)
+  {
+    return false;
+  }
+
+  static bool _appendIndexed(const uima::ListFS &list, const uima::FeatureStructure &value)
+  {
+    return ListIndex::append(list, value);
+  }
+
+  template<typename ListT>
+  static void _invalidateIndex(const ListT &list)
+  {
+  }
+
+  static void _invalidateIndex(const uima::ListFS &list)
+  {
+    ListIndex::invalidate(list);
+  }
 public:
   typedef ListFSIterator<T> iterator;
 
@@ -624,6 +768,7 @@ public:
 
   virtual void set(const std::vector<T> &value)
   {
+    WriteGate::enter();
     // create new empty list
     allocate();
 
@@ -655,12 +800,13 @@ public:
 
   void append(const T &value)
   {
+    WriteGate::enter();
     // workaround weird UIMA behavior :(
     if(empty())
     {
       _set(_get().addLast(accessor::convert<T, typename trait::ListElementType>(value)));
     }
-    else
+    else if(!_appendIndexed(_get(), accessor::convert<T, typename trait::ListElementType>(value)))
     {
       _get().addLast(accessor::convert<T, typename trait::ListElementType>(value));
     }
@@ -676,43 +822,47 @@ public:
 
   void prepend(const T &value)
   {
+    WriteGate::enter();
+    _invalidateIndex(_get());
     // workaround weird UIMA behavior :(
     _set(_get().addFirst(accessor::convert<T, typename trait::ListElementType>(value)));
   }
 
   void remove(const T &value)
   {
+    WriteGate::enter();
+    // elements could be removed from any list sharing the node, so all indices of the CAS are dropped
+    uima::ListFS list = _get();
+    if(list.isValid())
+    {
+      ListIndex::clear(list.getCAS());
+    }
     // TODO: check if this behaves as stupid as append(...)
     _get().removeElement(accessor::convert<T, typename trait::ListElementType>(value));
   }
 
+  /**
+   * Appends all elements of type TargetT to result. If subtypes is set, elements of subtypes of
+   * TargetT are included as well.
+   */
   template<typename TargetT>
-  bool filter(std::vector<TargetT> &result)
+  bool filter(std::vector<TargetT> &result, const bool subtypes = false)
   {
-    bool success = false;
-
-    if(!empty())
+    if(empty())
     {
-      typename trait::ListType listfs = _get();
-
-      uima::Type type = rs::type<TargetT>(this->fs().getCAS());
-
-      while(!listfs.isEmpty())
-      {
-        uima::FeatureStructure fs = listfs.getHead();
+      return false;
+    }
 
-        if(fs.getType() == type)
-        {
-          success = true;
-          TargetT elem(fs);
-          result.push_back(elem);
-        }
+    std::vector<uima::FeatureStructure> elements;
+    ListIndex::filter(_get(), rs::type<TargetT>(this->fs().getCAS()), elements, subtypes);
 
-        listfs = listfs.getTail();
-      }
+    result.reserve(result.size() + elements.size());
+    for(size_t i = 0; i < elements.size(); ++i)
+    {
+      result.push_back(TargetT(elements[i]));
     }
 
-    return success;
+    return !elements.empty();
   }
 
   /*
@@ -740,29 +890,21 @@ public:
 
     if(!empty())
     {
-      typename trait::ListType listfs = _get();
+      std::vector<uima::FeatureStructure> elements;
+      ListIndex::filter(_get(), rs::type<TargetT>(this->fs().getCAS()), elements);
 
-      uima::Type type = rs::type<TargetT>(this->fs().getCAS());
-
-      while(!listfs.isEmpty())
+      for(size_t i = 0; i < elements.size(); ++i)
       {
-        uima::FeatureStructure fs = listfs.getHead();
+        std::vector<AnnotT> clustannots;
+        TargetT cluster(elements[i]);
+        cluster.annotations.filter(clustannots);
 
-        if(fs.getType() == type)
+        if(clustannots.size() > 0)
         {
-          std::vector<AnnotT> clustannots;
-          TargetT cluster(fs);
-          cluster.annotations.filter(clustannots);
-
-          if(clustannots.size() > 0)
-          {
-            success = true;
-            result.push_back(cluster);
-            annots.push_back(clustannots);
-          }
+          success = true;
+          result.push_back(cluster);
+          annots.push_back(clustannots);
         }
-
-        listfs = listfs.getTail();
       }
     }
 
@@ -772,29 +914,18 @@ public:
   template<typename TargetT>
   bool getFirst(TargetT &result)
   {
-    bool success = false;
-
-    if(!empty())
+    if(empty())
     {
-      typename trait::ListType listfs = _get();
-
-      uima::Type type = rs::type<TargetT>(this->fs().getCAS());
-
-      while(!listfs.isEmpty())
-      {
-        uima::FeatureStructure fs = listfs.getHead();
-
-        if(fs.getType() == type)
-        {
-          success = true;
-          result = fs;
-          break;
-        }
-        listfs = listfs.getTail();
-      }
+      return false;
     }
 
-    return success;
+    uima::FeatureStructure fs;
+    if(!ListIndex::getFirst(_get(), rs::type<TargetT>(this->fs().getCAS()), fs))
+    {
+      return false;
+    }
+    result = fs;
+    return true;
   }
 
 };
@@ -20,6 +20,11 @@
 #define SCENE_CAS_H_
 
 #include <map>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+#include <typeindex>
 
 #include <uima/api.hpp>
 
@@ -33,6 +38,7 @@
 #include <opencv2/opencv.hpp>
 
 #include <boost/tuple/tuple.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <tf/tf.h>
 #include <tf/LinearMath/Transform.h>
@@ -46,10 +52,96 @@ namespace rs
 
 //typedef std::map<std::string, std::vector<rs::SemanticMapObject>> SemanticMap;
 
+/**
+ * Read-only handle of an image shared between all readers of a view, see SceneCas::getImageView.
+ * get() only hands out a const reference, so the image can be passed to OpenCV functions as input
+ * but not as output or to drawing functions. Use clone() to get a private, writable copy.
+ */
+class ImageView
+{
+private:
+  boost::shared_ptr<const cv::Mat> image;
+
+public:
+  ImageView() : image(new cv::Mat())
+  {
+  }
+
+  ImageView(const boost::shared_ptr<const cv::Mat> &image) : image(image)
+  {
+  }
+
+  const cv::Mat &get() const
+  {
+    return *image;
+  }
+
+  cv::Mat clone() const
+  {
+    return image->clone();
+  }
+
+  bool empty() const
+  {
+    return image->empty();
+  }
+};
+
 class SceneCas
 {
 private:
+  /**
+   * Objects materialized from the sofa data of one view. They stay valid as long as the view
+   * still holds the same feature structure they were converted from.
+   */
+  struct CachedView
+  {
+    uima::FeatureStructure fs;
+    std::map<std::type_index, boost::shared_ptr<const void> > objects;
+  };
+  typedef std::map<std::string, CachedView> ViewCache;
+
+  static std::mutex cacheLock;
+  static std::map<const uima::CAS *, ViewCache> caches;
+
+public:
+  /**
+   * Produces the sofa data of a view registered with setViewLoader.
+   */
+  typedef std::function<uima::FeatureStructure(uima::CAS &view)> ViewLoader;
+
+  /**
+   * How often a lazily loaded view was registered and how often it was actually read.
+   */
+  struct ViewStats
+  {
+    size_t registered;
+    size_t loaded;
+    double loadTime;
+
+    ViewStats() : registered(0), loaded(0), loadTime(0.0)
+    {
+    }
+  };
+
+private:
+  struct PendingView
+  {
+    ViewLoader loader;
+    bool loading;
+  };
+
+  static std::mutex loaderLock;
+  static std::condition_variable loaderDone;
+  static std::map<const uima::CAS *, std::map<std::string, PendingView> > loaders;
+  // number of entries in loaders, so that views can be read without taking loaderLock when nothing is pending
+  static std::atomic<size_t> pendingViews;
+  static std::map<std::string, ViewStats> viewStats;
+
   uima::CAS &cas;
+  const uima::CAS *cacheKey;
+
+  static const uima::CAS *getCacheKey(uima::CAS &cas);
 
 public:
   SceneCas(uima::CAS &cas);
@@ -85,9 +177,82 @@ public:
     set(name, input, std::is_base_of<rs::FeatureStructureProxy,T>());
   }
 
+  /**
+   * Returns a shared, read-only instance of the view converted to T. The view is converted only
+   * once per CAS, all later calls for the same view and type return the same object until the
+   * view is replaced by setFS or the CAS is reset. Returns an empty pointer if the view does not
+   * exist. The returned object must not be modified, use get() to obtain a private copy instead.
+   */
+  template <class T>
+  boost::shared_ptr<const T> getShared(const char *name)
+  {
+    uima::FeatureStructure fs;
+    if(!getFS(name, fs))
+    {
+      return boost::shared_ptr<const T>();
+    }
+
+    boost::shared_ptr<const void> cached = getCached(name, typeid(T), fs);
+    if(cached)
+    {
+      return boost::static_pointer_cast<const T>(cached);
+    }
+
+    boost::shared_ptr<T> object(new T());
+    rs::conversion::from(fs, *object);
+    setCached(name, typeid(T), fs, object);
+    return object;
+  }
+
+  /**
+   * Sets output to a read-only handle of the image stored in the view. The image is converted only
+   * once per CAS through getShared, so all readers of the same view share one copy of the data.
+   * output keeps a reference to that data, which stays valid even after the CAS is reset. Returns
+   * false and leaves output unchanged if the view does not exist.
+   */
+  bool getImageView(const char *name, ImageView &output)
+  {
+    boost::shared_ptr<const cv::Mat> image = getShared<cv::Mat>(name);
+    if(!image)
+    {
+      return false;
+    }
+    output = ImageView(image);
+    return true;
+  }
+
+  /**
+   * Drops all objects cached by getShared for the given CAS and all list indices. Has to be called
+   * before the CAS is reset or destroyed, otherwise feature structures of the next frame might be
+   * mistaken for the cached ones.
+   */
+  static void clearCache(uima::CAS &cas);
+
+  /**
+   * Registers a view whose sofa data is only loaded the first time it is accessed through getFS.
+   * The view is created empty, loader is called at most once and dropped on setFS or clearCache.
+   */
+  static void setViewLoader(uima::CAS &cas, const std::string &name, const ViewLoader &loader);
+
+  /**
+   * Loads all views still pending from setViewLoader. Needed before accessing sofa data directly,
+   * bypassing getFS.
+   */
+  static void loadPendingViews(uima::CAS &cas);
+
+  /**
+   * Returns the usage statistics of all views ever registered with setViewLoader.
+   */
+  static void getViewStats(std::map<std::string, ViewStats> &stats);
+
 private:
   bool getView(const char *name, uima::CAS *&view);
 
+  static void loadPendingView(const uima::CAS *key, uima::CAS *view, const std::string &name);
+
+  boost::shared_ptr<const void> getCached(const char *name, const std::type_index &type, const uima::FeatureStructure &fs);
+  void setCached(const char *name, const std::type_index &type, const uima::FeatureStructure &fs, const boost::shared_ptr<const void> &object);
+
   template <class T>
   bool get(const char *name, T &output, const std::true_type &)
   {
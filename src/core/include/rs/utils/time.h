@@ -23,6 +23,12 @@
 #include <cmath>
 #include <string>
 #include <chrono>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
 #include <rs/utils/output.h>
 
 namespace rs
@@ -64,25 +70,118 @@ public:
   }
 };
 
+/**
+ * Latency histogram that can be fed from several threads without locking. Latencies are counted
+ * in logarithmic buckets, each 5% wider than the previous one, from 1 us to about an hour.
+ * Percentiles are reported as the upper bound of their bucket, so they are at most 5% too high.
+ */
+class LatencyHistogram
+{
+public:
+  static const size_t BUCKETS = 440;
+
+  struct Snapshot
+  {
+    std::string name;
+    uint64_t count;
+    uint64_t dropped;
+    double mean;
+    double p50;
+    double p95;
+    double p99;
+    double max;
+  };
+
+private:
+  const std::string name;
+  std::atomic<uint64_t> buckets[BUCKETS];
+  std::atomic<uint64_t> dropped;
+  std::atomic<uint64_t> sumUs;
+  std::atomic<uint64_t> maxUs;
+
+  LatencyHistogram(const LatencyHistogram &other);
+  LatencyHistogram &operator=(const LatencyHistogram &other);
+
+public:
+  LatencyHistogram(const std::string &name);
+
+  /** \brief Adds a latency in milliseconds. */
+  void add(const double ms);
+
+  /** \brief Counts a frame dropped by an rs::FrameFilterException. */
+  inline void
+  addDropped()
+  {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void snapshot(Snapshot &snapshot) const;
+};
+
+/**
+ * Process wide registry of latency histograms. Histograms are created on first use and never
+ * removed, so the references returned by get() can be kept, only get() itself takes a lock.
+ * Annotators are registered as "annotator/<name>", analysis engines as "engine/<name>" and
+ * MEASURE_TIME scopes as "scope/<file>/<function>".
+ */
+class LatencyRegistry
+{
+private:
+  std::mutex lock;
+  std::map<std::string, std::unique_ptr<LatencyHistogram>> histograms;
+
+  LatencyRegistry();
+  LatencyRegistry(const LatencyRegistry &other);
+  LatencyRegistry &operator=(const LatencyRegistry &other);
+
+public:
+  static LatencyRegistry &instance();
+
+  LatencyHistogram &get(const std::string &name);
+
+  void snapshot(std::vector<LatencyHistogram::Snapshot> &snapshots);
+
+  static void writeCSV(std::ostream &os, const std::vector<LatencyHistogram::Snapshot> &snapshots);
+  static void writeJSON(std::ostream &os, const std::vector<LatencyHistogram::Snapshot> &snapshots);
+
+  /** \brief Writes a snapshot to file, as JSON if it ends with ".json", as CSV otherwise. */
+  bool dump(const std::string &file);
+};
+
 class ScopeTime : private StopWatch
 {
 private:
   const char *file, *function;
   const int line;
+  LatencyHistogram *histogram;
 public:
-  inline ScopeTime(const char *file, const char *function, const int line) :
-    StopWatch(), file(file), function(function), line(line)
+  inline ScopeTime(const char *file, const char *function, const int line, LatencyHistogram *histogram = NULL) :
+    StopWatch(), file(file), function(function), line(line), histogram(histogram)
   {
   }
 
   inline ~ScopeTime()
   {
-    OUT_AUX_INT(FG_GREEN, FG_BLUE, OUT_LEVEL_INFO, OUT_STD_STREAM, this->getTime() << " ms.", file, line, function);
+    const double time = this->getTime();
+    if(histogram)
+    {
+      histogram->add(time);
+    }
+    OUT_AUX_INT(FG_GREEN, FG_BLUE, OUT_LEVEL_DEBUG, OUT_STD_STREAM, time << " ms.", file, line, function);
   }
 };
 
+/**
+ * Times the enclosing scope. A single declaration, so that it can be used wherever a statement can. The
+ * histogram is looked up once per use of the macro, by the static in the lambda.
+ */
 #ifndef MEASURE_TIME
-#define MEASURE_TIME rs::ScopeTime scopeTime(OUT_FILENAME, __FUNCTION__, __LINE__)
+#define MEASURE_TIME \
+  rs::ScopeTime scopeTime(OUT_FILENAME, __FUNCTION__, __LINE__, &[](const char *function) -> rs::LatencyHistogram & \
+  { \
+    static rs::LatencyHistogram &histogram = rs::LatencyRegistry::instance().get(std::string("scope/") + OUT_FILENAME + "/" + function); \
+    return histogram; \
+  }(__FUNCTION__))
 #endif
 
 }  // end namespace
@@ -0,0 +1,61 @@
+/**
+ * Copyright 2014 University of Bremen, Institute for Artificial Intelligence
+ * Author(s): Ferenc Balint-Benczedi <balintbe@cs.uni-bremen.de>
+ *         Thiemo Wiedemeyer <wiedemeyer@cs.uni-bremen.de>
+ *         Jan-Hendrik Worch <jworch@cs.uni-bremen.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __WRITE_GATE_H__
+#define __WRITE_GATE_H__
+
+namespace rs
+{
+
+/**
+ * Orders CAS writes of annotators running in parallel. Functions creating or changing feature
+ * structures call WriteGate::enter(), which blocks until the annotator running in the calling
+ * thread is allowed to write. Threads without an installed gate are never blocked.
+ */
+class WriteGate
+{
+public:
+  virtual ~WriteGate()
+  {
+  }
+
+  /**
+   * Blocks until the owner of the gate may write to the CAS.
+   */
+  virtual void wait() = 0;
+
+  static WriteGate *&current()
+  {
+    static thread_local WriteGate *gate = nullptr;
+    return gate;
+  }
+
+  static void enter()
+  {
+    WriteGate *gate = current();
+    if(gate)
+    {
+      gate->wait();
+    }
+  }
+};
+
+} // namespace rs
+
+#endif // __WRITE_GATE_H__
@@ -18,11 +18,15 @@
  */
 
 #include <rs/DrawingAnnotator.h>
+#include <rs/scene_cas.h>
 #include <rs/utils/exception.h>
 
 std::map<std::string, DrawingAnnotator *> DrawingAnnotator::annotators;
+std::atomic<DrawingAnnotator *> DrawingAnnotator::displayed(NULL);
+std::atomic<bool> DrawingAnnotator::imageOnly(false);
 
-DrawingAnnotator::DrawingAnnotator(const std::string &name) : name(name), update(false), hasRun(false)
+DrawingAnnotator::DrawingAnnotator(const std::string &name) : name(name), update(false), hasRun(false),
+  latency(rs::LatencyRegistry::instance().get("annotator/" + name)), stale(true), requested(false)
 {
   outDebug("Added: " << name);
   annotators[name] = this;
@@ -30,6 +34,8 @@ DrawingAnnotator::DrawingAnnotator(const std::string &name) : name(name), update
 
 DrawingAnnotator::~DrawingAnnotator()
 {
+  DrawingAnnotator *self = this;
+  displayed.compare_exchange_strong(self, NULL);
   std::map<std::string, DrawingAnnotator *>::const_iterator it;
   for(it = annotators.begin(); it != annotators.end(); ++it)
   {
@@ -64,13 +70,74 @@ DrawingAnnotator *DrawingAnnotator::getAnnotator(const std::string &name)
   return NULL;
 }
 
+void DrawingAnnotator::setDisplayed(DrawingAnnotator *annotator, const bool onRequest)
+{
+  if(annotator)
+  {
+    // its snapshot is from the last time it was displayed, if any
+    annotator->invalidateSnapshot();
+  }
+  imageOnly = onRequest;
+  displayed = annotator;
+}
+
+void DrawingAnnotator::requestSnapshot()
+{
+  requested = true;
+}
+
+void DrawingAnnotator::invalidateSnapshot()
+{
+  stale = true;
+}
+
+void DrawingAnnotator::publishSnapshot(uima::CAS &tcas)
+{
+  if(displayed != this || (imageOnly && !requested.exchange(false)))
+  {
+    return;
+  }
+
+  std::shared_ptr<Snapshot> next = std::make_shared<Snapshot>();
+  next->pointSize = 1.0;
+  next->ownCloud = false;
+  try
+  {
+    drawImageWithLock(next->image);
+    if(!imageOnly)
+    {
+      snapshotCloudWithLock(next->cloud, next->pointSize);
+      next->ownCloud = (bool)next->cloud;
+      if(!next->cloud)
+      {
+        // the conversion creates a new cloud, so it can be shared with the viewer as it is
+        pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGBA>());
+        rs::SceneCas cas(tcas);
+        if(cas.get(VIEW_CLOUD, *cloud))
+        {
+          next->cloud = cloud;
+        }
+      }
+    }
+  }
+  catch(...)
+  {
+    outError("Exception in " << name << "!");
+  }
+  std::atomic_store(&snapshot, std::shared_ptr<const Snapshot>(next));
+  stale = false;
+}
+
 uima::TyErrorId DrawingAnnotator::process(uima::CAS &tcas, uima::ResultSpecification const &res_spec)
 {
   uima::TyErrorId ret = UIMA_ERR_UNKNOWN_TYPE;
   drawLock.lock();
+  rs::StopWatch clock;
   try
   {
     ret = processWithLock(tcas, res_spec);
+    latency.add(clock.getTime());
+    publishSnapshot(tcas);
     update = true;
     hasRun = true;
   }
@@ -82,6 +149,9 @@ uima::TyErrorId DrawingAnnotator::process(uima::CAS &tcas, uima::ResultSpecifica
   }
   catch(const rs::FrameFilterException &e)
   {
+    latency.add(clock.getTime());
+    latency.addDropped();
+    publishSnapshot(tcas);
     update = true;
     hasRun = true;
     drawLock.unlock();
@@ -108,7 +178,31 @@ void DrawingAnnotator::drawImage(cv::Mat &disp)
     disp = cv::Mat::zeros(480, 640, CV_8UC3);
     return;
   }
-  drawLock.lock();
+
+  const std::shared_ptr<const Snapshot> current = std::atomic_load(&snapshot);
+  const bool haveImage = current && !current->image.empty();
+  if(haveImage && !stale)
+  {
+    // the viewer draws on disp, the snapshot stays untouched
+    current->image.copyTo(disp);
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(drawLock, std::try_to_lock);
+  if(!lock.owns_lock())
+  {
+    // processing, show the last snapshot until the next one is published
+    if(haveImage)
+    {
+      current->image.copyTo(disp);
+    }
+    else if(disp.empty())
+    {
+      disp = cv::Mat::zeros(480, 640, CV_8UC3);
+    }
+    return;
+  }
+
   try
   {
     drawImageWithLock(disp);
@@ -121,7 +215,6 @@ void DrawingAnnotator::drawImage(cv::Mat &disp)
       disp = cv::Mat::zeros(480, 640, CV_8UC3);
     }
   }
-  drawLock.unlock();
 }
 
 bool DrawingAnnotator::fillVisualizer(pcl::visualization::PCLVisualizer &visualizer, const bool firstRun)
@@ -130,7 +223,23 @@ bool DrawingAnnotator::fillVisualizer(pcl::visualization::PCLVisualizer &visuali
   {
     return false;
   }
-  drawLock.lock();
+
+  // snapshot clouds are rendered without the draw lock, so process does not wait for the viewer
+  const std::shared_ptr<const Snapshot> current = std::atomic_load(&snapshot);
+  if(current && current->ownCloud)
+  {
+    drawSnapshotCloud(*current, visualizer, firstRun);
+    return true;
+  }
+
+  // annotators without a snapshot cloud may draw shapes as well, they are only drawn while not processing,
+  // otherwise the viewer tries again
+  std::unique_lock<std::mutex> lock(drawLock, std::try_to_lock);
+  if(!lock.owns_lock())
+  {
+    return false;
+  }
+
   try
   {
     fillVisualizerWithLock(visualizer, firstRun);
@@ -139,10 +248,25 @@ bool DrawingAnnotator::fillVisualizer(pcl::visualization::PCLVisualizer &visuali
   {
     outError("Exception in " << name << "!");
   }
-  drawLock.unlock();
   return true;
 }
 
+void DrawingAnnotator::drawSnapshotCloud(const Snapshot &current, pcl::visualization::PCLVisualizer &visualizer, const bool firstRun)
+{
+  if(!current.cloud)
+  {
+    return;
+  }
+
+  // same id as used by the annotators, so both ways of drawing can follow each other
+  const std::string &cloudname = this->name;
+  if(firstRun || !visualizer.updatePointCloud(current.cloud, cloudname))
+  {
+    visualizer.addPointCloud(current.cloud, cloudname);
+    visualizer.setPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE, current.pointSize, cloudname);
+  }
+}
+
 bool DrawingAnnotator::callbackMouse(const int event, const int x, const int y, const Source source)
 {
   return false;
@@ -155,10 +279,19 @@ bool DrawingAnnotator::callbackKey(const int key, const Source source)
 
 void DrawingAnnotator::fillVisualizerWithLock(pcl::visualization::PCLVisualizer &visualizer, const bool firstRun)
 {
-  //empty function declaration so C+ does not complain like the litle bitch it is
+  // the scene cloud of the last snapshot
+  const std::shared_ptr<const Snapshot> current = std::atomic_load(&snapshot);
+  if(current)
+  {
+    drawSnapshotCloud(*current, visualizer, firstRun);
+  }
 }
 
 void DrawingAnnotator::drawImageWithLock(cv::Mat &disp)
 {
   disp = cv::Mat::zeros(480, 640, CV_8UC3);
 }
+
+void DrawingAnnotator::snapshotCloudWithLock(pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr &cloud, double &pointSize)
+{
+}
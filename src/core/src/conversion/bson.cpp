@@ -19,6 +19,8 @@
 
 // STL
 #include <map>
+#include <mutex>
+#include <functional>
 
 // UNICODE STRING
 #include <unicode/unistr.h>
@@ -66,12 +68,63 @@ static ToArrayTypes toArrayTypes;
 
 void initMaps(const uima::CAS &cas);
 
+/******************************************************************************
+ * Conversion:: Serialization Plans
+ *****************************************************************************/
+
+enum FeatureKind
+{
+  FEATURE_BASIC = 0,
+  FEATURE_ARRAY,
+  FEATURE_FS
+};
+
+/**
+ * Everything needed to convert one feature, resolved once per type.
+ */
+struct FeaturePlan
+{
+  uima::Feature feature;
+  std::string name;
+  FeatureKind kind;
+  FromBasicTypeFunction fromBasic;
+  ToBasicTypeFunction toBasic;
+  FromArrayTypeFunction fromArray;
+  ToArrayTypeFunction toArray;
+};
+
+/**
+ * The serialization plan of a type. Array and list types are converted as a whole by fromArray and
+ * toArray, all other types feature by feature in the order of features.
+ */
+struct TypePlan
+{
+  uima::Type type;
+  std::string name;
+  FromArrayTypeFunction fromArray;
+  ToArrayTypeFunction toArray;
+  uima::Feature idFeature;
+  bool hasId;
+  std::vector<FeaturePlan> features;
+  std::map<std::string, size_t> featureIndex;
+};
+
+typedef std::map<std::pair<const uima::TypeSystem *, uima::Type>, const TypePlan *> TypePlans;
+typedef std::map<std::pair<const uima::TypeSystem *, std::string>, const TypePlan *> TypePlansByName;
+
+static std::mutex typePlansLock;
+static TypePlans typePlans;
+
+const TypePlan &getPlan(const uima::Type &type);
+const TypePlan *getPlan(const uima::TypeSystem &typeSys, const std::string &name);
+
 /******************************************************************************
  * Conversion:: Prototypes
  *****************************************************************************/
 
 mongo::BSONObj fromFeatureStructureAux(const uima::FeatureStructure &fs, const mongo::OID &parent);
 uima::FeatureStructure toFeatureStructureAux(uima::CAS &cas, const mongo::BSONObj &object);
+void fromArrayFSByte(const uima::FeatureStructure &fs, const std::string &fieldName, mongo::BSONObjBuilder &builder, const mongo::OID &parent);
 
 /******************************************************************************
  * Conversion:: Basic Feature
@@ -137,88 +190,64 @@ void toFeatureFeatureStructure(uima::CAS &cas, uima::FeatureStructure &fs, const
  * Conversion:: Feature Type selection
  *****************************************************************************/
 
-void fromFeature(const uima::FeatureStructure &fs, const uima::Feature &feature, mongo::BSONObjBuilder &builder)
+void fromFeature(const uima::FeatureStructure &fs, const FeaturePlan &plan, mongo::BSONObjBuilder &builder)
 {
-  uima::Type featureType;
-  feature.getRangeType(featureType);
-  const uima::UnicodeStringRef featureName = feature.getName();
-  const std::string &name = featureName.asUTF8();
-
-  FromBasicTypes::const_iterator itB = fromBasicTypes.find(featureType);
-  if(itB != fromBasicTypes.end())
+  switch(plan.kind)
   {
-    (*itB->second)(fs, feature, name, builder);
-    return;
-  }
-
-  FromArrayTypes::const_iterator itA = fromArrayTypes.find(featureType);
-  if(itA != fromArrayTypes.end())
+  case FEATURE_BASIC:
+    (*plan.fromBasic)(fs, plan.feature, plan.name, builder);
+    break;
+  case FEATURE_ARRAY:
   {
-    const uima::FeatureStructure &subFS = fs.getFSValue(feature);
+    const uima::FeatureStructure &subFS = fs.getFSValue(plan.feature);
     if(!subFS.isValid())
     {
-      builder.append(name, mongo::BSONObj());
+      builder.append(plan.name, mongo::BSONObj());
     }
     else
     {
       mongo::BSONElement oid;
       builder.asTempObj().getObjectID(oid);
-      (*itA->second)(subFS, name, builder, oid.OID());
+      (*plan.fromArray)(subFS, plan.name, builder, oid.OID());
     }
-    return;
+    break;
+  }
+  case FEATURE_FS:
+    fromFeatureFeatureStructure(fs, plan.feature, plan.name, builder);
+    break;
   }
-
-  fromFeatureFeatureStructure(fs, feature, name, builder);
 }
 
-void toFeature(uima::CAS &cas, uima::FeatureStructure fs, const uima::Type &fsType, const mongo::BSONElement &elem)
+void toFeature(uima::CAS &cas, uima::FeatureStructure fs, const FeaturePlan &plan, const mongo::BSONElement &elem)
 {
-  const UnicodeString name = UnicodeString::fromUTF8(elem.fieldName());
-  uima::Feature feature = fsType.getFeatureByBaseName(name);
-  uima::Type featureType;
-  feature.getRangeType(featureType);
-
-  ToBasicTypes::const_iterator itB = toBasicTypes.find(featureType);
-  if(itB != toBasicTypes.end())
-  {
-    (*itB->second)(cas, fs, feature, elem);
-    return;
-  }
-
-  ToArrayTypes::const_iterator itA = toArrayTypes.find(featureType);
-  if(itA != toArrayTypes.end())
+  switch(plan.kind)
   {
+  case FEATURE_BASIC:
+    (*plan.toBasic)(cas, fs, plan.feature, elem);
+    break;
+  case FEATURE_ARRAY:
     if(!elem.isABSONObj() || !elem.Obj().isEmpty())
     {
-      fs.setFSValue(feature, (*itA->second)(cas, elem));
+      fs.setFSValue(plan.feature, (*plan.toArray)(cas, elem));
     }
-    return;
+    break;
+  case FEATURE_FS:
+    toFeatureFeatureStructure(cas, fs, plan.feature, elem);
+    break;
   }
-
-  toFeatureFeatureStructure(cas, fs, feature, elem);
 }
 
 /******************************************************************************
  * Conversion:: Basic Feature Structure
  *****************************************************************************/
 
-void fromBasicFeatureStructure(const uima::FeatureStructure &fs, const uima::Type &fsType, const std::string &type, mongo::BSONObjBuilder &builder, const mongo::OID &parent)
+void fromBasicFeatureStructure(const uima::FeatureStructure &fs, const TypePlan &plan, mongo::BSONObjBuilder &builder, const mongo::OID &parent,
+                               const size_t blobSize = 0, std::vector<std::pair<std::string, uima::ByteArrayFS>> *blobs = NULL)
 {
-  std::vector<uima::Feature> features;
-  fsType.getAppropriateFeatures(features);
-
-  uima::Feature idFeature;
   std::string id;
-  try
-  {
-    idFeature = fsType.getFeatureByBaseName(FIELD_ID_CAS);
-    if(fsType.isAppropriateFeature(idFeature))
-    {
-      id = fs.getStringValue(idFeature).asUTF8();
-    }
-  }
-  catch(const uima::InvalidFSTypeObjectException)
+  if(plan.hasId)
   {
+    id = fs.getStringValue(plan.idFeature).asUTF8();
   }
 
   if(!id.empty())
@@ -230,48 +259,63 @@ void fromBasicFeatureStructure(const uima::FeatureStructure &fs, const uima::Typ
     builder.genOID();
   }
   builder.append(FIELD_PARENT, parent);
-  builder.append(FIELD_TYPE, type);
+  builder.append(FIELD_TYPE, plan.name);
 
-  for(size_t i = 0; i < features.size(); ++i)
+  for(size_t i = 0; i < plan.features.size(); ++i)
   {
-    const uima::Feature &feature = features[i];
-    if(feature != idFeature)
+    const FeaturePlan &featurePlan = plan.features[i];
+    if(blobs && featurePlan.fromArray == &fromArrayFSByte)
     {
-      fromFeature(fs, feature, builder);
+      uima::ByteArrayFS arrayFS(fs.getFSValue(featurePlan.feature));
+      if(arrayFS.isValid() && arrayFS.size() >= blobSize)
+      {
+        blobs->push_back(std::make_pair(featurePlan.name, arrayFS));
+        continue;
+      }
     }
+    fromFeature(fs, featurePlan, builder);
   }
 }
 
-uima::FeatureStructure toBasicFeatureStructure(uima::CAS &cas, const uima::Type &fsType, const mongo::BSONObj &object)
+uima::FeatureStructure toBasicFeatureStructure(uima::CAS &cas, const TypePlan &plan, const mongo::BSONObj &object)
 {
-  uima::FeatureStructure newFS = cas.createFS(fsType);
+  uima::FeatureStructure newFS = cas.createFS(plan.type);
 
-  try
+  if(plan.hasId)
   {
-    const uima::Feature &idFeature = fsType.getFeatureByBaseName(FIELD_ID_CAS);
-    if(fsType.isAppropriateFeature(idFeature))
+    mongo::BSONElement elem;
+    if(object.getObjectID(elem))
     {
-      mongo::BSONElement elem;
-      if(object.getObjectID(elem))
-      {
-        newFS.setStringValue(idFeature, UnicodeString::fromUTF8(elem.OID().toString()));
-      }
+      newFS.setStringValue(plan.idFeature, UnicodeString::fromUTF8(elem.OID().toString()));
     }
   }
-  catch(const uima::InvalidFSTypeObjectException)
-  {
-  }
-
-  std::vector<mongo::BSONElement> elems;
-  object.elems(elems);
 
-  for(size_t i = 0; i < elems.size(); ++i)
+  // fields are usually stored in the order of the plan, so the next feature is tried first
+  size_t next = 0;
+  mongo::BSONObjIterator it(object);
+  while(it.more())
   {
-    const mongo::BSONElement &elem = elems[i];
-    if(elem.fieldName()[0] != '_')
+    const mongo::BSONElement &elem = it.next();
+    const char *fieldName = elem.fieldName();
+    if(fieldName[0] == '_')
     {
-      toFeature(cas, newFS, fsType, elem);
+      continue;
     }
+
+    size_t index = next;
+    if(index >= plan.features.size() || plan.features[index].name != fieldName)
+    {
+      std::map<std::string, size_t>::const_iterator itI = plan.featureIndex.find(fieldName);
+      if(itI == plan.featureIndex.end())
+      {
+        outWarn("type '" << plan.name << "' has no feature '" << fieldName << "'!");
+        continue;
+      }
+      index = itI->second;
+    }
+
+    toFeature(cas, newFS, plan.features[index], elem);
+    next = index + 1;
   }
   return newFS;
 }
@@ -685,46 +729,44 @@ mongo::BSONObj fromFeatureStructureAux(const uima::FeatureStructure &fs, const m
   {
     return mongo::BSONObj();
   }
-  initMaps(fs.getCAS());
 
-  const uima::Type &fsType = fs.getType();
-  const std::string type = fsType.getName().asUTF8();
+  const TypePlan &plan = getPlan(fs.getType());
 
   mongo::BSONObjBuilder builder;
 
-  FromArrayTypes::const_iterator itA = fromArrayTypes.find(fsType);
-  if(itA != fromArrayTypes.end())
+  if(plan.fromArray)
   {
     builder.genOID();
-    builder.append(FIELD_TYPE, type);
+    builder.append(FIELD_TYPE, plan.name);
     builder.append(FIELD_PARENT, parent);
-    (*itA->second)(fs, FIELD_DATA, builder, parent);
+    (*plan.fromArray)(fs, FIELD_DATA, builder, parent);
   }
   else
   {
-    fromBasicFeatureStructure(fs, fsType, type, builder, parent);
+    fromBasicFeatureStructure(fs, plan, builder, parent);
   }
   return builder.obj();
 }
 
 uima::FeatureStructure toFeatureStructureAux(uima::CAS &cas, const mongo::BSONObj &object)
 {
-  initMaps(cas);
   if(object.isEmpty())
   {
     return uima::FeatureStructure();
   }
 
-  const UnicodeString type = UnicodeString::fromUTF8(object.getStringField(FIELD_TYPE));
-  const uima::TypeSystem &typeSys = cas.getTypeSystem();
-  const uima::Type &fsType = typeSys.getType(type);
+  const TypePlan *plan = getPlan(cas.getTypeSystem(), object.getStringField(FIELD_TYPE));
+  if(!plan)
+  {
+    outError("unknown type '" << object.getStringField(FIELD_TYPE) << "'!");
+    return uima::FeatureStructure();
+  }
 
-  ToArrayTypes::const_iterator itA = toArrayTypes.find(fsType);
-  if(itA != toArrayTypes.end())
+  if(plan->toArray)
   {
-    return (*itA->second)(cas, object.getField(FIELD_DATA));
+    return (*plan->toArray)(cas, object.getField(FIELD_DATA));
   }
-  return toBasicFeatureStructure(cas, fsType, object);
+  return toBasicFeatureStructure(cas, *plan, object);
 }
 
 /******************************************************************************
@@ -742,6 +784,25 @@ mongo::BSONObj fromFeatureStructure(const uima::FeatureStructure &fs, const mong
   return fromFeatureStructureAux(fs, parent);
 }
 
+mongo::BSONObj fromFeatureStructure(const uima::FeatureStructure &fs, const mongo::OID &parent, const size_t blobSize, std::vector<std::pair<std::string, uima::ByteArrayFS>> &blobs)
+{
+  if(!fs.isValid())
+  {
+    return mongo::BSONObj();
+  }
+  initMaps(fs.getCAS());
+
+  const TypePlan &plan = getPlan(fs.getType());
+  if(plan.fromArray)
+  {
+    return fromFeatureStructureAux(fs, parent);
+  }
+
+  mongo::BSONObjBuilder builder;
+  fromBasicFeatureStructure(fs, plan, builder, parent, blobSize, &blobs);
+  return builder.obj();
+}
+
 uima::FeatureStructure toFeatureStructure(uima::CAS &cas, const mongo::BSONObj &object)
 {
   initMaps(cas);
@@ -768,15 +829,8 @@ uima::FeatureStructure toFeatureStructure(uima::CAS &cas, const mongo::BSONObj &
   toArrayTypes[_TS_.getType(uima::CAS::TYPE_NAME_EMPTY_##_UPPER_##_LIST)] = &toListFS##_NAME_;\
   toArrayTypes[_TS_.getType(uima::CAS::TYPE_NAME_NON_EMPTY_##_UPPER_##_LIST)] = &toListFS##_NAME_;
 
-void initMaps(const uima::CAS &cas)
+void initMapsAux(const uima::CAS &cas)
 {
-  static bool isInitialized = false;
-
-  if(isInitialized)
-  {
-    return;
-  }
-
   const uima::TypeSystem &ts = cas.getTypeSystem();
 
   ADD_BASIC_TYPE(ts, Boolean, BOOLEAN);
@@ -802,8 +856,162 @@ void initMaps(const uima::CAS &cas)
   ADD_LIST_TYPE(ts, Float, FLOAT);
   ADD_LIST_TYPE(ts, String, STRING);
   ADD_LIST_TYPE(ts, FeatureStructure, FS);
+}
+
+void initMaps(const uima::CAS &cas)
+{
+  static std::once_flag isInitialized;
+  std::call_once(isInitialized, initMapsAux, std::cref(cas));
+}
+
+/******************************************************************************
+ * Conversion:: Compile Serialization Plans
+ *****************************************************************************/
+
+TypePlan *compilePlan(const uima::Type &type)
+{
+  TypePlan *plan = new TypePlan();
+  plan->type = type;
+  plan->name = type.getName().asUTF8();
+  plan->fromArray = NULL;
+  plan->toArray = NULL;
+  plan->hasId = false;
+
+  FromArrayTypes::const_iterator itFA = fromArrayTypes.find(type);
+  ToArrayTypes::const_iterator itTA = toArrayTypes.find(type);
+  if(itFA != fromArrayTypes.end() && itTA != toArrayTypes.end())
+  {
+    plan->fromArray = itFA->second;
+    plan->toArray = itTA->second;
+    return plan;
+  }
+
+  try
+  {
+    plan->idFeature = type.getFeatureByBaseName(FIELD_ID_CAS);
+    plan->hasId = type.isAppropriateFeature(plan->idFeature);
+  }
+  catch(const uima::InvalidFSTypeObjectException)
+  {
+  }
+
+  std::vector<uima::Feature> features;
+  type.getAppropriateFeatures(features);
+  plan->features.reserve(features.size());
+
+  for(size_t i = 0; i < features.size(); ++i)
+  {
+    const uima::Feature &feature = features[i];
+    if(plan->hasId && feature == plan->idFeature)
+    {
+      continue;
+    }
+
+    FeaturePlan featurePlan;
+    featurePlan.feature = feature;
+    featurePlan.name = feature.getName().asUTF8();
+    featurePlan.kind = FEATURE_FS;
+    featurePlan.fromBasic = NULL;
+    featurePlan.toBasic = NULL;
+    featurePlan.fromArray = NULL;
+    featurePlan.toArray = NULL;
+
+    uima::Type featureType;
+    feature.getRangeType(featureType);
+
+    FromBasicTypes::const_iterator itFB = fromBasicTypes.find(featureType);
+    ToBasicTypes::const_iterator itTB = toBasicTypes.find(featureType);
+    itFA = fromArrayTypes.find(featureType);
+    itTA = toArrayTypes.find(featureType);
+    if(itFB != fromBasicTypes.end() && itTB != toBasicTypes.end())
+    {
+      featurePlan.kind = FEATURE_BASIC;
+      featurePlan.fromBasic = itFB->second;
+      featurePlan.toBasic = itTB->second;
+    }
+    else if(itFA != fromArrayTypes.end() && itTA != toArrayTypes.end())
+    {
+      featurePlan.kind = FEATURE_ARRAY;
+      featurePlan.fromArray = itFA->second;
+      featurePlan.toArray = itTA->second;
+    }
+
+    plan->featureIndex[featurePlan.name] = plan->features.size();
+    plan->features.push_back(featurePlan);
+  }
+  return plan;
+}
+
+/**
+ * The plans a thread has used, so that only its first lookup of a type takes typePlansLock. Conversions
+ * mostly look up the same type many times in a row, e.g. for the elements of an array, which the last
+ * lookup answers without a search.
+ */
+struct LocalTypePlans
+{
+  TypePlans::key_type lastKey;
+  const TypePlan *last;
+  TypePlans plans;
+  TypePlansByName plansByName;
+
+  LocalTypePlans() : last(NULL)
+  {
+  }
+};
 
-  isInitialized = true;
+LocalTypePlans &getLocalPlans()
+{
+  static thread_local LocalTypePlans localPlans;
+  return localPlans;
+}
+
+const TypePlan &getPlan(const uima::Type &type)
+{
+  const uima::TypeSystem &typeSys = type.getTypeSystem();
+  const TypePlans::key_type key(&typeSys, type);
+
+  LocalTypePlans &local = getLocalPlans();
+  if(local.last && local.lastKey == key)
+  {
+    return *local.last;
+  }
+
+  TypePlans::const_iterator it = local.plans.find(key);
+  if(it == local.plans.end())
+  {
+    std::lock_guard<std::mutex> lock(typePlansLock);
+    TypePlans::const_iterator shared = typePlans.find(key);
+    if(shared == typePlans.end())
+    {
+      TypePlan *plan = compilePlan(type);
+      shared = typePlans.insert(std::make_pair(key, plan)).first;
+    }
+    it = local.plans.insert(*shared).first;
+  }
+  local.lastKey = key;
+  local.last = it->second;
+  return *local.last;
+}
+
+const TypePlan *getPlan(const uima::TypeSystem &typeSys, const std::string &name)
+{
+  const TypePlansByName::key_type key(&typeSys, name);
+
+  LocalTypePlans &local = getLocalPlans();
+  TypePlansByName::const_iterator it = local.plansByName.find(key);
+  if(it != local.plansByName.end())
+  {
+    return it->second;
+  }
+
+  const uima::Type &type = typeSys.getType(UnicodeString::fromUTF8(name));
+  if(!type.isValid())
+  {
+    return NULL;
+  }
+  const TypePlan *plan = &getPlan(type);
+  local.plansByName[key] = plan;
+  return plan;
 }
 
 } // namespace conversion
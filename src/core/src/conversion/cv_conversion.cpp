@@ -268,7 +268,7 @@ void from(const uima::FeatureStructure &fs, cv::Mat &output)
 
   if(output.rows != 0 && output.cols != 0)
   {
-    const uima::Feature &feature = fs.getType().getFeatureByBaseName("data");
+    const uima::Feature &feature = rs::getFeature(fs, "data");
     const uima::ByteArrayFS &arrayFS = fs.getByteArrayFSValue(feature);
     arrayFS.copyToArray(0, (char *)output.data, 0, arrayFS.size());
   }
@@ -283,7 +283,7 @@ uima::FeatureStructure to(uima::CAS &cas, const cv::Mat &input)
   if(!input.empty())
   {
     uima::FeatureStructure &fs = mat;
-    const uima::Feature &feature = fs.getType().getFeatureByBaseName("data");
+    const uima::Feature &feature = rs::getFeature(fs, "data");
     uima::ByteArrayFS arrayFS = cas.createByteArrayFS(size);
     if(input.isContinuous())
     {
@@ -0,0 +1,354 @@
+/**
+ * Copyright 2014 University of Bremen, Institute for Artificial Intelligence
+ * Author(s): Ferenc Balint-Benczedi <balintbe@cs.uni-bremen.de>
+ *         Thiemo Wiedemeyer <wiedemeyer@cs.uni-bremen.de>
+ *         Jan-Hendrik Worch <jworch@cs.uni-bremen.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// STL
+#include <cmath>
+#include <cstdio>
+
+// RS
+#include <rs/conversion/json.h>
+#include <rs/utils/output.h>
+
+namespace rs
+{
+namespace conversion
+{
+
+JsonWriter::JsonWriter() : typeSystem(NULL), allow(false)
+{
+}
+
+void JsonWriter::setDeniedFields(const std::vector<std::string> &names)
+{
+  fields = std::set<std::string>(names.begin(), names.end());
+  allow = false;
+  plans.clear();
+}
+
+void JsonWriter::setAllowedFields(const std::vector<std::string> &names)
+{
+  fields = std::set<std::string>(names.begin(), names.end());
+  allow = true;
+  plans.clear();
+}
+
+void JsonWriter::clear()
+{
+  buffer.clear();
+}
+
+/******************************************************************************
+ * JsonWriter:: Plans
+ *****************************************************************************/
+
+#define ADD_KIND(_TS_, _NAME_, _KIND_) kinds[_TS_.getType(uima::CAS::TYPE_NAME_##_NAME_)] = _KIND_;
+
+void JsonWriter::initKinds(const uima::TypeSystem &ts)
+{
+  typeSystem = &ts;
+  kinds.clear();
+  plans.clear();
+
+  ADD_KIND(ts, BOOLEAN, KIND_BOOLEAN);
+  ADD_KIND(ts, BYTE, KIND_BYTE);
+  ADD_KIND(ts, SHORT, KIND_SHORT);
+  ADD_KIND(ts, INTEGER, KIND_INT);
+  ADD_KIND(ts, LONG, KIND_LONG);
+  ADD_KIND(ts, FLOAT, KIND_FLOAT);
+  ADD_KIND(ts, DOUBLE, KIND_DOUBLE);
+  ADD_KIND(ts, STRING, KIND_STRING);
+
+  ADD_KIND(ts, BOOLEAN_ARRAY, KIND_BOOLEAN_ARRAY);
+  ADD_KIND(ts, BYTE_ARRAY, KIND_BYTE_ARRAY);
+  ADD_KIND(ts, SHORT_ARRAY, KIND_SHORT_ARRAY);
+  ADD_KIND(ts, INTEGER_ARRAY, KIND_INT_ARRAY);
+  ADD_KIND(ts, LONG_ARRAY, KIND_LONG_ARRAY);
+  ADD_KIND(ts, FLOAT_ARRAY, KIND_FLOAT_ARRAY);
+  ADD_KIND(ts, DOUBLE_ARRAY, KIND_DOUBLE_ARRAY);
+  ADD_KIND(ts, STRING_ARRAY, KIND_STRING_ARRAY);
+  ADD_KIND(ts, FS_ARRAY, KIND_FS_ARRAY);
+
+  ADD_KIND(ts, INTEGER_LIST, KIND_INT_LIST);
+  ADD_KIND(ts, EMPTY_INTEGER_LIST, KIND_INT_LIST);
+  ADD_KIND(ts, NON_EMPTY_INTEGER_LIST, KIND_INT_LIST);
+  ADD_KIND(ts, FLOAT_LIST, KIND_FLOAT_LIST);
+  ADD_KIND(ts, EMPTY_FLOAT_LIST, KIND_FLOAT_LIST);
+  ADD_KIND(ts, NON_EMPTY_FLOAT_LIST, KIND_FLOAT_LIST);
+  ADD_KIND(ts, STRING_LIST, KIND_STRING_LIST);
+  ADD_KIND(ts, EMPTY_STRING_LIST, KIND_STRING_LIST);
+  ADD_KIND(ts, NON_EMPTY_STRING_LIST, KIND_STRING_LIST);
+  ADD_KIND(ts, FS_LIST, KIND_FS_LIST);
+  ADD_KIND(ts, EMPTY_FS_LIST, KIND_FS_LIST);
+  ADD_KIND(ts, NON_EMPTY_FS_LIST, KIND_FS_LIST);
+}
+
+JsonWriter::Kind JsonWriter::getKind(const uima::Type &type) const
+{
+  std::map<uima::Type, Kind>::const_iterator it = kinds.find(type);
+  return it != kinds.end() ? it->second : KIND_OBJECT;
+}
+
+const JsonWriter::TypePlan &JsonWriter::getPlan(const uima::Type &type)
+{
+  if(&type.getTypeSystem() != typeSystem)
+  {
+    initKinds(type.getTypeSystem());
+  }
+
+  std::map<uima::Type, TypePlan>::const_iterator it = plans.find(type);
+  if(it != plans.end())
+  {
+    return it->second;
+  }
+
+  TypePlan &plan = plans[type];
+  plan.type = type.getName().asUTF8();
+  plan.kind = getKind(type);
+  if(plan.kind != KIND_OBJECT)
+  {
+    return plan;
+  }
+
+  std::vector<uima::Feature> features;
+  type.getAppropriateFeatures(features);
+  for(size_t i = 0; i < features.size(); ++i)
+  {
+    const std::string name = features[i].getName().asUTF8();
+    if((fields.find(name) != fields.end()) != allow)
+    {
+      continue;
+    }
+
+    uima::Type featureType;
+    features[i].getRangeType(featureType);
+
+    FeaturePlan featurePlan;
+    featurePlan.feature = features[i];
+    featurePlan.key = '"' + name + "\":";
+    featurePlan.kind = getKind(featureType);
+    plan.features.push_back(featurePlan);
+  }
+  return plan;
+}
+
+/******************************************************************************
+ * JsonWriter:: Values
+ *****************************************************************************/
+
+void JsonWriter::writeString(const std::string &str)
+{
+  buffer += '"';
+  for(size_t i = 0; i < str.size(); ++i)
+  {
+    const char c = str[i];
+    switch(c)
+    {
+    case '"':
+      buffer += "\\\"";
+      break;
+    case '\\':
+      buffer += "\\\\";
+      break;
+    case '\n':
+      buffer += "\\n";
+      break;
+    case '\r':
+      buffer += "\\r";
+      break;
+    case '\t':
+      buffer += "\\t";
+      break;
+    default:
+      if((unsigned char)c < 0x20)
+      {
+        char escaped[8];
+        snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned int)c);
+        buffer += escaped;
+      }
+      else
+      {
+        buffer += c;
+      }
+    }
+  }
+  buffer += '"';
+}
+
+void JsonWriter::writeString(const uima::UnicodeStringRef &ref)
+{
+  writeString(ref.asUTF8());
+}
+
+void JsonWriter::writeNumber(const double value, const int precision)
+{
+  // JSON has no representation for them
+  if(!std::isfinite(value))
+  {
+    buffer += "null";
+    return;
+  }
+  char number[32];
+  const int length = snprintf(number, sizeof(number), "%.*g", precision, value);
+  buffer.append(number, length);
+}
+
+void JsonWriter::writeNumber(const long long value)
+{
+  char number[24];
+  const int length = snprintf(number, sizeof(number), "%lld", value);
+  buffer.append(number, length);
+}
+
+#define WRITE_ARRAY(_NAME_, _WRITE_)\
+  {\
+    uima::_NAME_##ArrayFS array(fs);\
+    for(size_t i = 0; i < array.size(); ++i)\
+    {\
+      if(i)\
+      {\
+        buffer += ',';\
+      }\
+      _WRITE_(array.get(i));\
+    }\
+    break;\
+  }
+
+#define WRITE_LIST(_NAME_, _WRITE_)\
+  {\
+    uima::_NAME_##ListFS list(fs);\
+    const size_t size = list.getLength();\
+    for(size_t i = 0; i < size; ++i)\
+    {\
+      if(i)\
+      {\
+        buffer += ',';\
+      }\
+      _WRITE_(list.getHead());\
+      list.moveToNext();\
+    }\
+    break;\
+  }
+
+#define WRITE_BOOLEAN(_VALUE_) buffer += (_VALUE_) ? "true" : "false"
+#define WRITE_INTEGER(_VALUE_) writeNumber((long long)(_VALUE_))
+#define WRITE_FLOAT(_VALUE_) writeNumber((_VALUE_), 9)
+#define WRITE_DOUBLE(_VALUE_) writeNumber((_VALUE_), 17)
+#define WRITE_STRING(_VALUE_) writeString(_VALUE_)
+#define WRITE_FS(_VALUE_) write(_VALUE_)
+
+void JsonWriter::writeArray(const uima::FeatureStructure &fs, const Kind kind)
+{
+  buffer += '[';
+  switch(kind)
+  {
+  case KIND_BOOLEAN_ARRAY:
+    WRITE_ARRAY(Boolean, WRITE_BOOLEAN)
+  case KIND_BYTE_ARRAY:
+    WRITE_ARRAY(Byte, WRITE_INTEGER)
+  case KIND_SHORT_ARRAY:
+    WRITE_ARRAY(Short, WRITE_INTEGER)
+  case KIND_INT_ARRAY:
+    WRITE_ARRAY(Int, WRITE_INTEGER)
+  case KIND_LONG_ARRAY:
+    WRITE_ARRAY(Long, WRITE_INTEGER)
+  case KIND_FLOAT_ARRAY:
+    WRITE_ARRAY(Float, WRITE_FLOAT)
+  case KIND_DOUBLE_ARRAY:
+    WRITE_ARRAY(Double, WRITE_DOUBLE)
+  case KIND_STRING_ARRAY:
+    WRITE_ARRAY(String, WRITE_STRING)
+  case KIND_FS_ARRAY:
+    WRITE_ARRAY(, WRITE_FS)
+  case KIND_INT_LIST:
+    WRITE_LIST(Int, WRITE_INTEGER)
+  case KIND_FLOAT_LIST:
+    WRITE_LIST(Float, WRITE_FLOAT)
+  case KIND_STRING_LIST:
+    WRITE_LIST(String, WRITE_STRING)
+  case KIND_FS_LIST:
+    WRITE_LIST(, WRITE_FS)
+  default:
+    outError("unsupported array kind " << kind << "!");
+  }
+  buffer += ']';
+}
+
+void JsonWriter::writeFeature(const uima::FeatureStructure &fs, const FeaturePlan &plan)
+{
+  switch(plan.kind)
+  {
+  case KIND_BOOLEAN:
+    WRITE_BOOLEAN(fs.getBooleanValue(plan.feature));
+    break;
+  case KIND_BYTE:
+    WRITE_INTEGER(fs.getByteValue(plan.feature));
+    break;
+  case KIND_SHORT:
+    WRITE_INTEGER(fs.getShortValue(plan.feature));
+    break;
+  case KIND_INT:
+    WRITE_INTEGER(fs.getIntValue(plan.feature));
+    break;
+  case KIND_LONG:
+    WRITE_INTEGER(fs.getLongValue(plan.feature));
+    break;
+  case KIND_FLOAT:
+    WRITE_FLOAT(fs.getFloatValue(plan.feature));
+    break;
+  case KIND_DOUBLE:
+    WRITE_DOUBLE(fs.getDoubleValue(plan.feature));
+    break;
+  case KIND_STRING:
+    WRITE_STRING(fs.getStringValue(plan.feature));
+    break;
+  default:
+    // arrays, lists and objects are written according to the type of the value
+    write(fs.getFSValue(plan.feature));
+    break;
+  }
+}
+
+void JsonWriter::write(const uima::FeatureStructure &fs)
+{
+  if(!fs.isValid())
+  {
+    buffer += "null";
+    return;
+  }
+
+  const TypePlan &plan = getPlan(fs.getType());
+  if(plan.kind != KIND_OBJECT)
+  {
+    writeArray(fs, plan.kind);
+    return;
+  }
+
+  buffer += "{\"_type\":";
+  writeString(plan.type);
+  for(size_t i = 0; i < plan.features.size(); ++i)
+  {
+    buffer += ',';
+    buffer += plan.features[i].key;
+    writeFeature(fs, plan.features[i]);
+  }
+  buffer += '}';
+}
+
+}
+}
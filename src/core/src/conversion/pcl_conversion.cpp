@@ -45,7 +45,7 @@ void from_aux(const uima::FeatureStructure &fs, pcl::PointCloud<PointT> &output)
   output.resize(output.width * output.height);
   pcl_conversions::toPCL(header, output.header);
 
-  const uima::Feature &feature = fs.getType().getFeatureByBaseName("points");
+  const uima::Feature &feature = rs::getFeature(fs, "points");
   const uima::ByteArrayFS &arrayFS = fs.getByteArrayFSValue(feature);
   arrayFS.copyToArray(0, (char *)output.points.data(), 0, arrayFS.size());
   //memcpy(&output.points[0], &cloud.points()[0], cloud.points.size());
@@ -74,7 +74,7 @@ uima::FeatureStructure to_aux(uima::CAS &cas, const pcl::PointCloud<PointT> &inp
   //std::memcpy(&data[0], &input.points[0], size);
   //cloud.points(data);
   uima::FeatureStructure &fs = cloud;
-  const uima::Feature &feature = fs.getType().getFeatureByBaseName("points");
+  const uima::Feature &feature = rs::getFeature(fs, "points");
   uima::ByteArrayFS arrayFS = cas.createByteArrayFS(size);
   arrayFS.copyFromArray((char *)input.points.data(), 0, size, 0);
   fs.setFSValue(feature, arrayFS);
@@ -95,7 +95,7 @@ void from(const uima::FeatureStructure &fs, pcl::PointCloud<pcl::Normal> &output
   output.resize(output.width * output.height);
   pcl_conversions::toPCL(header, output.header);
 
-  const uima::Feature &feature = fs.getType().getFeatureByBaseName("points");
+  const uima::Feature &feature = rs::getFeature(fs, "points");
   const uima::ByteArrayFS &arrayFS = fs.getByteArrayFSValue(feature);
   arrayFS.copyToArray(0, (char *)output.points.data(), 0, arrayFS.size());
   //memcpy(&output.points[0], &cloud.points()[0], cloud.points.size());
@@ -121,7 +121,7 @@ uima::FeatureStructure to(uima::CAS &cas, const pcl::PointCloud<pcl::Normal> &in
   //std::memcpy(&data[0], &input.points[0], size);
   //cloud.points(data);
   uima::FeatureStructure &fs = cloud;
-  const uima::Feature &feature = fs.getType().getFeatureByBaseName("points");
+  const uima::Feature &feature = rs::getFeature(fs, "points");
   uima::ByteArrayFS arrayFS = cas.createByteArrayFS(size);
   arrayFS.copyFromArray((char *)input.points.data(), 0, size, 0);
   fs.setFSValue(feature, arrayFS);
@@ -208,7 +208,7 @@ void from(const uima::FeatureStructure &fs, pcl::PointIndices &output)
   from(pi.header(), header);
   pcl_conversions::toPCL(header, output.header);
 
-  const uima::Feature &feature = fs.getType().getFeatureByBaseName("indices");
+  const uima::Feature &feature = rs::getFeature(fs, "indices");
   const uima::IntArrayFS &arrayFS = fs.getIntArrayFSValue(feature);
   const size_t size = arrayFS.size();
   output.indices.resize(size);
@@ -226,7 +226,7 @@ uima::FeatureStructure to(uima::CAS &cas, const pcl::PointIndices &input)
   //pi.indices.set(input.indices);
 
   uima::FeatureStructure &fs = pi;
-  const uima::Feature &feature = fs.getType().getFeatureByBaseName("indices");
+  const uima::Feature &feature = rs::getFeature(fs, "indices");
   const size_t size = input.indices.size();
   uima::IntArrayFS arrayFS = cas.createIntArrayFS(size);
   arrayFS.copyFromArray(input.indices.data(), 0, size, 0);
@@ -0,0 +1,345 @@
+/**
+ * Copyright 2014 University of Bremen, Institute for Artificial Intelligence
+ * Author(s): Ferenc Balint-Benczedi <balintbe@cs.uni-bremen.de>
+ *         Thiemo Wiedemeyer <wiedemeyer@cs.uni-bremen.de>
+ *         Jan-Hendrik Worch <jworch@cs.uni-bremen.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <map>
+#include <mutex>
+#include <cstring>
+#include <algorithm>
+
+#include <rs/feature_structure_proxy.h>
+
+namespace rs
+{
+
+/******************************************************************************
+ * FeatureTable
+ *****************************************************************************/
+
+typedef std::map<std::pair<const uima::TypeSystem *, uima::Type>, FeatureTable *> FeatureTables;
+
+static std::mutex featureTablesLock;
+static FeatureTables featureTables;
+
+FeatureTable::FeatureTable(const uima::Type &type)
+{
+  std::vector<uima::Feature> features;
+  type.getAppropriateFeatures(features);
+
+  features_.reserve(features.size());
+  for(size_t i = 0; i < features.size(); ++i)
+  {
+    features_.push_back(std::make_pair(features[i].getName().asUTF8(), features[i]));
+  }
+}
+
+const FeatureTable *FeatureTable::of(const uima::Type &type)
+{
+  if(!type.isValid())
+  {
+    return NULL;
+  }
+
+  const FeatureTables::key_type key(&type.getTypeSystem(), type);
+
+  // proxies are mostly created for the same type many times in a row, so every thread remembers the table of its
+  // last lookup and the tables it has used before, only its first lookup of a type goes through the shared map
+  static thread_local FeatureTables::key_type lastKey;
+  static thread_local const FeatureTable *lastTable = NULL;
+  static thread_local FeatureTables cache;
+  if(lastTable && lastKey == key)
+  {
+    return lastTable;
+  }
+
+  FeatureTables::iterator it = cache.find(key);
+  if(it == cache.end())
+  {
+    std::lock_guard<std::mutex> lock(featureTablesLock);
+    FeatureTables::iterator shared = featureTables.find(key);
+    if(shared == featureTables.end())
+    {
+      shared = featureTables.insert(std::make_pair(key, new FeatureTable(type))).first;
+    }
+    it = cache.insert(*shared).first;
+  }
+  lastKey = key;
+  lastTable = it->second;
+  return lastTable;
+}
+
+uima::Feature FeatureTable::get(const char *name) const
+{
+  for(size_t i = 0; i < features_.size(); ++i)
+  {
+    if(!std::strcmp(features_[i].first.c_str(), name))
+    {
+      return features_[i].second;
+    }
+  }
+  return uima::Feature();
+}
+
+const uima::Feature *FeatureTable::get(const char *const *names, const size_t count) const
+{
+  // a proxy resolves the fields of every class in its hierarchy, so every thread remembers the features of all
+  // tables and name lists it has used, only the first lookup takes the lock of the table
+  typedef std::map<std::pair<const FeatureTable *, const char *const *>, const uima::Feature *> Slots;
+  static thread_local Slots cache;
+  const Slots::key_type key(this, names);
+  Slots::iterator it = cache.find(key);
+  if(it != cache.end())
+  {
+    return it->second;
+  }
+
+  std::lock_guard<std::mutex> lock(slotsLock_);
+  std::vector<uima::Feature> &features = slots_[names];
+  if(features.empty())
+  {
+    features.reserve(count);
+    for(size_t i = 0; i < count; ++i)
+    {
+      features.push_back(get(names[i]));
+    }
+  }
+  return cache.insert(std::make_pair(key, features.data())).first->second;
+}
+
+/******************************************************************************
+ * ListIndex
+ *****************************************************************************/
+
+struct ListIndexEntry
+{
+  // the list type, the first element and the last node with its element, to tell whether the entry still matches
+  // the list starting at its head
+  uima::Type type;
+  uima::FeatureStructure first;
+  uima::ListFS last;
+  uima::FeatureStructure lastElement;
+  size_t size;
+  // elements with their position in the list
+  std::map<uima::Type, std::vector<std::pair<size_t, uima::FeatureStructure> > > elements;
+};
+
+/**
+ * Indices of the lists of one CAS, keyed by their first node. They are only emptied and never destroyed, so
+ * threads can keep using them without going through the shared map.
+ */
+struct CasListIndices
+{
+  std::mutex lock;
+  std::map<uima::FeatureStructure, ListIndexEntry> lists;
+};
+
+typedef std::map<const uima::CAS *, CasListIndices *> ListIndices;
+
+// only guards the map of CASes, the indices of a CAS are guarded by its own lock
+static std::mutex listIndicesLock;
+static ListIndices listIndices;
+
+static CasListIndices &getCasListIndices(const uima::CAS *base)
+{
+  // every thread mostly works on the same CAS, so it remembers the indices of its last lookup
+  static thread_local const uima::CAS *lastCas = NULL;
+  static thread_local CasListIndices *lastIndices = NULL;
+  if(lastIndices && lastCas == base)
+  {
+    return *lastIndices;
+  }
+
+  std::lock_guard<std::mutex> lock(listIndicesLock);
+  ListIndices::iterator it = listIndices.find(base);
+  if(it == listIndices.end())
+  {
+    it = listIndices.insert(std::make_pair(base, new CasListIndices())).first;
+  }
+  lastCas = base;
+  lastIndices = it->second;
+  return *lastIndices;
+}
+
+static CasListIndices &getCasListIndices(uima::ListFS &head)
+{
+  // keyed by the base CAS, so that all indices of a CAS can be dropped regardless of the view
+  return getCasListIndices(head.getCAS().getBaseCas());
+}
+
+static void addElement(ListIndexEntry &entry, const uima::FeatureStructure &fs)
+{
+  if(fs.isValid())
+  {
+    entry.elements[fs.getType()].push_back(std::make_pair(entry.size, fs));
+  }
+  entry.lastElement = fs;
+  ++entry.size;
+}
+
+/**
+ * The entry is outdated if elements were appended without going through ListIndex::append. The other checks
+ * catch most entries left over from before a CAS reset that skipped ListIndex::clear, whose nodes now belong to
+ * other feature structures. That is not guaranteed though, so the CAS still has to be cleared before a reset.
+ */
+static bool isCurrent(uima::ListFS &head, const ListIndexEntry &entry)
+{
+  return head.getType() == entry.type && entry.last.getType() == entry.type && entry.last.getTail().isEmpty() &&
+         head.getHead() == entry.first && entry.last.getHead() == entry.lastElement;
+}
+
+// the entry stays valid as long as lock is held
+static ListIndexEntry *getListIndex(uima::ListFS &head, std::unique_lock<std::mutex> &lock)
+{
+  if(!head.isValid() || head.isEmpty())
+  {
+    return NULL;
+  }
+
+  CasListIndices &indices = getCasListIndices(head);
+  lock = std::unique_lock<std::mutex>(indices.lock);
+
+  std::map<uima::FeatureStructure, ListIndexEntry>::iterator it = indices.lists.find(head);
+  if(it != indices.lists.end() && isCurrent(head, it->second))
+  {
+    return &it->second;
+  }
+
+  ListIndexEntry &entry = indices.lists[head];
+  entry.type = head.getType();
+  entry.first = head.getHead();
+  entry.size = 0;
+  entry.elements.clear();
+
+  for(uima::ListFS node = head; !node.isEmpty(); node = node.getTail())
+  {
+    addElement(entry, node.getHead());
+    entry.last = node;
+  }
+  return &entry;
+}
+
+bool ListIndex::append(uima::ListFS head, const uima::FeatureStructure &value)
+{
+  std::unique_lock<std::mutex> lock;
+  ListIndexEntry *entry = getListIndex(head, lock);
+  if(!entry)
+  {
+    return false;
+  }
+
+  // last is the last node, so addLast does not have to walk the list
+  entry->last.addLast(value);
+  entry->last = entry->last.getTail();
+  addElement(*entry, value);
+  return true;
+}
+
+void ListIndex::filter(uima::ListFS head, const uima::Type &type, std::vector<uima::FeatureStructure> &result, const bool subtypes)
+{
+  std::unique_lock<std::mutex> lock;
+  ListIndexEntry *entry = getListIndex(head, lock);
+  if(!entry)
+  {
+    return;
+  }
+
+  if(!subtypes)
+  {
+    std::map<uima::Type, std::vector<std::pair<size_t, uima::FeatureStructure> > >::const_iterator it = entry->elements.find(type);
+    if(it != entry->elements.end())
+    {
+      result.reserve(result.size() + it->second.size());
+      for(size_t i = 0; i < it->second.size(); ++i)
+      {
+        result.push_back(it->second[i].second);
+      }
+    }
+    return;
+  }
+
+  std::vector<std::pair<size_t, uima::FeatureStructure> > matches;
+  std::map<uima::Type, std::vector<std::pair<size_t, uima::FeatureStructure> > >::const_iterator it;
+  for(it = entry->elements.begin(); it != entry->elements.end(); ++it)
+  {
+    if(type.subsumes(it->first))
+    {
+      matches.insert(matches.end(), it->second.begin(), it->second.end());
+    }
+  }
+
+  // restore list order
+  std::sort(matches.begin(), matches.end(), [](const std::pair<size_t, uima::FeatureStructure> &a, const std::pair<size_t, uima::FeatureStructure> &b)
+  {
+    return a.first < b.first;
+  });
+
+  result.reserve(result.size() + matches.size());
+  for(size_t i = 0; i < matches.size(); ++i)
+  {
+    result.push_back(matches[i].second);
+  }
+}
+
+bool ListIndex::getFirst(uima::ListFS head, const uima::Type &type, uima::FeatureStructure &result)
+{
+  std::unique_lock<std::mutex> lock;
+  ListIndexEntry *entry = getListIndex(head, lock);
+  if(!entry)
+  {
+    return false;
+  }
+
+  std::map<uima::Type, std::vector<std::pair<size_t, uima::FeatureStructure> > >::const_iterator it = entry->elements.find(type);
+  if(it == entry->elements.end() || it->second.empty())
+  {
+    return false;
+  }
+  result = it->second.front().second;
+  return true;
+}
+
+void ListIndex::invalidate(uima::ListFS head)
+{
+  if(!head.isValid() || head.isEmpty())
+  {
+    return;
+  }
+
+  CasListIndices &indices = getCasListIndices(head);
+  std::lock_guard<std::mutex> lock(indices.lock);
+  indices.lists.erase(head);
+}
+
+void ListIndex::clear()
+{
+  std::lock_guard<std::mutex> lock(listIndicesLock);
+  for(ListIndices::iterator it = listIndices.begin(); it != listIndices.end(); ++it)
+  {
+    std::lock_guard<std::mutex> lockIndices(it->second->lock);
+    it->second->lists.clear();
+  }
+}
+
+void ListIndex::clear(uima::CAS &cas)
+{
+  CasListIndices &indices = getCasListIndices(cas.getBaseCas());
+  std::lock_guard<std::mutex> lock(indices.lock);
+  indices.lists.clear();
+}
+
+}
@@ -26,6 +26,7 @@
 
 #include <rs/scene_cas.h>
 #include <rs/utils/output.h>
+#include <rs/utils/time.h>
 
 // Force disable debug output
 #undef OUT_LEVEL
@@ -34,8 +35,16 @@
 namespace rs
 {
 
+std::mutex SceneCas::cacheLock;
+std::map<const uima::CAS *, SceneCas::ViewCache> SceneCas::caches;
+std::mutex SceneCas::loaderLock;
+std::condition_variable SceneCas::loaderDone;
+std::map<const uima::CAS *, std::map<std::string, SceneCas::PendingView> > SceneCas::loaders;
+std::atomic<size_t> SceneCas::pendingViews(0);
+std::map<std::string, SceneCas::ViewStats> SceneCas::viewStats;
+
 SceneCas::SceneCas(uima::CAS &cas) :
-  cas(cas)
+  cas(cas), cacheKey(getCacheKey(cas))
 {
 }
 
@@ -84,12 +93,18 @@ bool SceneCas::getFS(const char *name, uima::FeatureStructure &fs)
     outDebug("View '" << name << "' does not exist!");
     return false;
   }
+  // loaded views are removed from the pending ones while holding loaderLock after their data was set
+  if(pendingViews.load(std::memory_order_acquire))
+  {
+    loadPendingView(cacheKey, view, name);
+  }
   fs = view->getSofaDataArray();
   return true;
 }
 
 void SceneCas::setFS(const char *name, const uima::FeatureStructure &fs)
 {
+  WriteGate::enter();
   uima::CAS *view;
   if(!getView(name, view))
   {
@@ -98,6 +113,182 @@ void SceneCas::setFS(const char *name, const uima::FeatureStructure &fs)
   const std::string mime = std::string("application/x-") + name;
 
   view->setSofaDataArray(fs, UnicodeString::fromUTF8(mime));
+
+  {
+    std::lock_guard<std::mutex> lock(loaderLock);
+    std::map<const uima::CAS *, std::map<std::string, PendingView> >::iterator it = loaders.find(cacheKey);
+    if(it != loaders.end() && it->second.erase(name))
+    {
+      --pendingViews;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(cacheLock);
+  std::map<const uima::CAS *, ViewCache>::iterator it = caches.find(cacheKey);
+  if(it != caches.end())
+  {
+    it->second.erase(name);
+  }
+}
+
+const uima::CAS *SceneCas::getCacheKey(uima::CAS &cas)
+{
+  // annotators might get a different view than the engine, but the initial view is shared by all of them
+  return cas.getView(uima::CAS::NAME_DEFAULT_SOFA);
+}
+
+void SceneCas::clearCache(uima::CAS &cas)
+{
+  const uima::CAS *key = getCacheKey(cas);
+  ListIndex::clear(cas);
+
+  {
+    std::lock_guard<std::mutex> lock(loaderLock);
+    std::map<const uima::CAS *, std::map<std::string, PendingView> >::iterator it = loaders.find(key);
+    if(it != loaders.end())
+    {
+      pendingViews -= it->second.size();
+      loaders.erase(it);
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(cacheLock);
+  caches.erase(key);
+}
+
+void SceneCas::setViewLoader(uima::CAS &cas, const std::string &name, const ViewLoader &loader)
+{
+  const UnicodeString viewName = UnicodeString::fromUTF8(name);
+  try
+  {
+    cas.getView(viewName);
+  }
+  catch(const uima::CASException &e)
+  {
+    cas.createView(viewName);
+  }
+
+  std::lock_guard<std::mutex> lock(loaderLock);
+  std::map<std::string, PendingView> &pendingOfCas = loaders[getCacheKey(cas)];
+  if(!pendingOfCas.count(name))
+  {
+    ++pendingViews;
+  }
+  PendingView &pending = pendingOfCas[name];
+  pending.loader = loader;
+  pending.loading = false;
+  ++viewStats[name].registered;
+}
+
+void SceneCas::loadPendingViews(uima::CAS &cas)
+{
+  const uima::CAS *key = getCacheKey(cas);
+  std::vector<std::string> names;
+  {
+    std::lock_guard<std::mutex> lock(loaderLock);
+    std::map<const uima::CAS *, std::map<std::string, PendingView> >::const_iterator it = loaders.find(key);
+    if(it == loaders.end())
+    {
+      return;
+    }
+    for(std::map<std::string, PendingView>::const_iterator itL = it->second.begin(); itL != it->second.end(); ++itL)
+    {
+      names.push_back(itL->first);
+    }
+  }
+
+  for(size_t i = 0; i < names.size(); ++i)
+  {
+    loadPendingView(key, cas.getView(UnicodeString::fromUTF8(names[i])), names[i]);
+  }
+}
+
+void SceneCas::getViewStats(std::map<std::string, ViewStats> &stats)
+{
+  std::lock_guard<std::mutex> lock(loaderLock);
+  stats = viewStats;
+}
+
+void SceneCas::loadPendingView(const uima::CAS *key, uima::CAS *view, const std::string &name)
+{
+  std::unique_lock<std::mutex> lock(loaderLock);
+  PendingView *pending = NULL;
+  for(;;)
+  {
+    std::map<const uima::CAS *, std::map<std::string, PendingView> >::iterator it = loaders.find(key);
+    if(it == loaders.end())
+    {
+      return;
+    }
+    std::map<std::string, PendingView>::iterator itL = it->second.find(name);
+    if(itL == it->second.end())
+    {
+      return;
+    }
+    pending = &itL->second;
+    if(!pending->loading)
+    {
+      break;
+    }
+    // another thread is loading the view, wait until its data is set
+    loaderDone.wait(lock);
+  }
+  pending->loading = true;
+  const ViewLoader loader = pending->loader;
+
+  // loaders may take other locks (e.g. the database connection), so do not hold loaderLock while loading
+  lock.unlock();
+  outDebug("loading view '" << name << "' on first access.");
+  rs::StopWatch clock;
+  const uima::FeatureStructure fs = loader(*view);
+  const std::string mime = "application/x-" + name;
+  view->setSofaDataArray(fs, UnicodeString::fromUTF8(mime));
+  const double time = clock.getTime();
+  lock.lock();
+
+  std::map<const uima::CAS *, std::map<std::string, PendingView> >::iterator it = loaders.find(key);
+  if(it != loaders.end() && it->second.erase(name))
+  {
+    --pendingViews;
+  }
+  ViewStats &stats = viewStats[name];
+  ++stats.loaded;
+  stats.loadTime += time;
+  loaderDone.notify_all();
+}
+
+boost::shared_ptr<const void> SceneCas::getCached(const char *name, const std::type_index &type, const uima::FeatureStructure &fs)
+{
+  std::lock_guard<std::mutex> lock(cacheLock);
+  CachedView &entry = caches[cacheKey][name];
+
+  if(!(entry.fs == fs))
+  {
+    outDebug("View '" << name << "' changed, dropping cached objects.");
+    entry.objects.clear();
+    entry.fs = fs;
+    return boost::shared_ptr<const void>();
+  }
+
+  std::map<std::type_index, boost::shared_ptr<const void> >::const_iterator it = entry.objects.find(type);
+  if(it == entry.objects.end())
+  {
+    return boost::shared_ptr<const void>();
+  }
+  return it->second;
+}
+
+void SceneCas::setCached(const char *name, const std::type_index &type, const uima::FeatureStructure &fs, const boost::shared_ptr<const void> &object)
+{
+  std::lock_guard<std::mutex> lock(cacheLock);
+  CachedView &entry = caches[cacheKey][name];
+
+  // view was replaced while converting, the object is outdated
+  if(!(entry.fs == fs))
+  {
+    return;
+  }
+  entry.objects[type] = object;
 }
 
 }
@@ -0,0 +1,179 @@
+/**
+ * Copyright 2014 University of Bremen, Institute for Artificial Intelligence
+ * Author(s): Ferenc Balint-Benczedi <balintbe@cs.uni-bremen.de>
+ *         Thiemo Wiedemeyer <wiedemeyer@cs.uni-bremen.de>
+ *         Jan-Hendrik Worch <jworch@cs.uni-bremen.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+
+#include <rs/utils/time.h>
+
+namespace rs
+{
+
+static const double BUCKET_FACTOR = 1.05;
+static const double INV_LOG_BUCKET_FACTOR = 1.0 / std::log(BUCKET_FACTOR);
+
+LatencyHistogram::LatencyHistogram(const std::string &name) : name(name), dropped(0), sumUs(0), maxUs(0)
+{
+  for(size_t i = 0; i < BUCKETS; ++i)
+  {
+    buckets[i] = 0;
+  }
+}
+
+void LatencyHistogram::add(const double ms)
+{
+  const double us = std::max(ms * 1000.0, 1.0);
+  const size_t index = std::min((size_t)(std::log(us) * INV_LOG_BUCKET_FACTOR), BUCKETS - 1);
+  const uint64_t value = (uint64_t)us;
+
+  buckets[index].fetch_add(1, std::memory_order_relaxed);
+  sumUs.fetch_add(value, std::memory_order_relaxed);
+
+  uint64_t max = maxUs.load(std::memory_order_relaxed);
+  while(max < value && !maxUs.compare_exchange_weak(max, value, std::memory_order_relaxed))
+  {
+  }
+}
+
+void LatencyHistogram::snapshot(Snapshot &snapshot) const
+{
+  uint64_t counts[BUCKETS];
+  uint64_t total = 0;
+  for(size_t i = 0; i < BUCKETS; ++i)
+  {
+    counts[i] = buckets[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+
+  snapshot.name = name;
+  snapshot.count = total;
+  snapshot.dropped = dropped.load(std::memory_order_relaxed);
+  snapshot.max = maxUs.load(std::memory_order_relaxed) / 1000.0;
+  snapshot.mean = total ? sumUs.load(std::memory_order_relaxed) / 1000.0 / total : 0.0;
+
+  // buckets are read one by one while others keep adding, the percentiles refer to the total read here
+  const double percentiles[] = {0.5, 0.95, 0.99};
+  double *results[] = {&snapshot.p50, &snapshot.p95, &snapshot.p99};
+  for(size_t p = 0; p < 3; ++p)
+  {
+    *results[p] = 0.0;
+    if(!total)
+    {
+      continue;
+    }
+    const uint64_t rank = std::max((uint64_t)std::ceil(percentiles[p] * total), (uint64_t)1);
+    uint64_t seen = 0;
+    for(size_t i = 0; i < BUCKETS; ++i)
+    {
+      seen += counts[i];
+      if(seen >= rank)
+      {
+        *results[p] = std::min(std::pow(BUCKET_FACTOR, (double)(i + 1)) / 1000.0, snapshot.max);
+        break;
+      }
+    }
+  }
+}
+
+LatencyRegistry::LatencyRegistry()
+{
+}
+
+LatencyRegistry &LatencyRegistry::instance()
+{
+  static LatencyRegistry registry;
+  return registry;
+}
+
+LatencyHistogram &LatencyRegistry::get(const std::string &name)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  std::unique_ptr<LatencyHistogram> &histogram = histograms[name];
+  if(!histogram)
+  {
+    histogram.reset(new LatencyHistogram(name));
+  }
+  return *histogram;
+}
+
+void LatencyRegistry::snapshot(std::vector<LatencyHistogram::Snapshot> &snapshots)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  snapshots.resize(histograms.size());
+  std::map<std::string, std::unique_ptr<LatencyHistogram>>::const_iterator it = histograms.begin();
+  for(size_t i = 0; it != histograms.end(); ++it, ++i)
+  {
+    it->second->snapshot(snapshots[i]);
+  }
+}
+
+void LatencyRegistry::writeCSV(std::ostream &os, const std::vector<LatencyHistogram::Snapshot> &snapshots)
+{
+  os << "name,count,dropped,mean_ms,p50_ms,p95_ms,p99_ms,max_ms" << std::endl;
+  os << std::fixed << std::setprecision(3);
+  for(size_t i = 0; i < snapshots.size(); ++i)
+  {
+    const LatencyHistogram::Snapshot &s = snapshots[i];
+    os << s.name << ',' << s.count << ',' << s.dropped << ',' << s.mean << ','
+       << s.p50 << ',' << s.p95 << ',' << s.p99 << ',' << s.max << std::endl;
+  }
+}
+
+void LatencyRegistry::writeJSON(std::ostream &os, const std::vector<LatencyHistogram::Snapshot> &snapshots)
+{
+  // names are annotator, engine and function names, they need no escaping
+  os << std::fixed << std::setprecision(3) << '[';
+  for(size_t i = 0; i < snapshots.size(); ++i)
+  {
+    const LatencyHistogram::Snapshot &s = snapshots[i];
+    os << (i ? "," : "") << "{\"name\":\"" << s.name << "\",\"count\":" << s.count << ",\"dropped\":" << s.dropped
+       << ",\"mean\":" << s.mean << ",\"p50\":" << s.p50 << ",\"p95\":" << s.p95 << ",\"p99\":" << s.p99 << ",\"max\":" << s.max << '}';
+  }
+  os << ']';
+}
+
+bool LatencyRegistry::dump(const std::string &file)
+{
+  std::vector<LatencyHistogram::Snapshot> snapshots;
+  snapshot(snapshots);
+
+  // write to a temporary file first, so that readers never see a partial dump
+  const std::string tmpFile = file + ".tmp";
+  std::ofstream os(tmpFile.c_str());
+  if(!os.is_open())
+  {
+    outError("could not open latency dump file \"" << tmpFile << "\".");
+    return false;
+  }
+  if(file.size() > 5 && file.compare(file.size() - 5, 5, ".json") == 0)
+  {
+    writeJSON(os, snapshots);
+    os << std::endl;
+  }
+  else
+  {
+    writeCSV(os, snapshots);
+  }
+  os.close();
+  return std::rename(tmpFile.c_str(), file.c_str()) == 0;
+}
+
+}  // end namespace
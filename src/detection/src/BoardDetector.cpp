@@ -44,7 +44,7 @@ private:
   float boardDistY;
   cv::Size boardSize;
   bool foundBoard;
-  cv::Mat image;
+  rs::ImageView image;
 
 public:
   BoardDetector() : DrawingAnnotator(__func__), boardType(CIRCLE), boardRows(7), boardCols(7), boardDistX(0.02), boardDistY(0.02), foundBoard(false)
@@ -115,20 +115,20 @@ private:
     rs::SceneCas cas(tcas);
     rs::Scene scene = cas.getScene();
 
-    cas.get(VIEW_COLOR_IMAGE_HD, image);
+    cas.getImageView(VIEW_COLOR_IMAGE_HD, image);
 
     foundBoard = false;
     switch(boardType)
     {
     case CIRCLE:
-      foundBoard = cv::findCirclesGrid(image, boardSize, pointsImage);
+      foundBoard = cv::findCirclesGrid(image.get(), boardSize, pointsImage);
       break;
     case CHESS:
-      foundBoard = cv::findChessboardCorners(image, boardSize, pointsImage, cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_NORMALIZE_IMAGE | cv::CALIB_CB_FAST_CHECK);
+      foundBoard = cv::findChessboardCorners(image.get(), boardSize, pointsImage, cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_NORMALIZE_IMAGE | cv::CALIB_CB_FAST_CHECK);
 
       if(foundBoard)
       {
-        cv::cornerSubPix(image, pointsImage, cv::Size(5, 5), cv::Size(-1, -1), cv::TermCriteria(CV_TERMCRIT_EPS | CV_TERMCRIT_ITER, 30, 0.1));
+        cv::cornerSubPix(image.get(), pointsImage, cv::Size(5, 5), cv::Size(-1, -1), cv::TermCriteria(CV_TERMCRIT_EPS | CV_TERMCRIT_ITER, 30, 0.1));
       }
       break;
     }
@@ -68,7 +68,7 @@ private:
 
   // PCL
   pcl::PointIndices::Ptr plane_inliers;
-  pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud;
+  pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr cloud;
   pcl::PointCloud<pcl::PointXYZRGBA>::Ptr display;
   std::vector<int> mapping_indices;
 
@@ -281,10 +281,8 @@ private:
     outInfo("estimating plane form Point Cloud data");
     rs::SceneCas cas(tcas);
 
-    cloud = pcl::PointCloud<pcl::PointXYZRGBA>::Ptr(new pcl::PointCloud<pcl::PointXYZRGBA>);
     plane_inliers = pcl::PointIndices::Ptr(new pcl::PointIndices);
 
-    pcl::PointCloud<pcl::Normal>::Ptr normals(new pcl::PointCloud<pcl::Normal>);
     pcl::OrganizedMultiPlaneSegmentation<pcl::PointXYZRGBA, pcl::Normal, pcl::Label> mps;
     pcl::PointCloud<pcl::Label>::Ptr labels(new pcl::PointCloud<pcl::Label>());
     std::vector<pcl::PointIndices> labelIndices;
@@ -294,8 +292,18 @@ private:
     modelCoefficients.clear();
     inlierIndices.clear();
 
-    cas.get(VIEW_CLOUD, *cloud);
-    cas.get(VIEW_NORMALS, *normals);
+    cloud = cas.getShared<pcl::PointCloud<pcl::PointXYZRGBA> >(VIEW_CLOUD);
+    if(!cloud)
+    {
+      outError("No cloud in CAS!");
+      return;
+    }
+    pcl::PointCloud<pcl::Normal>::ConstPtr normals = cas.getShared<pcl::PointCloud<pcl::Normal> >(VIEW_NORMALS);
+    if(!normals)
+    {
+      outError("No normals in CAS!");
+      return;
+    }
 
     mps.setMinInliers(min_plane_inliers);
     mps.setMaximumCurvature(max_curvature);
@@ -367,10 +375,14 @@ private:
     outInfo("Estimating plane form Point Cloud data");
     rs::SceneCas cas(tcas);
 
-    cloud = pcl::PointCloud<pcl::PointXYZRGBA>::Ptr(new pcl::PointCloud<pcl::PointXYZRGBA>());
     pcl::ModelCoefficients::Ptr plane_coefficients(new pcl::ModelCoefficients);
 
-    cas.get(VIEW_CLOUD, *cloud);
+    cloud = cas.getShared<pcl::PointCloud<pcl::PointXYZRGBA> >(VIEW_CLOUD);
+    if(!cloud)
+    {
+      outError("No cloud in CAS!");
+      return;
+    }
 
     std::vector<float> planeModel(4);
     if(process_cloud(plane_coefficients))
@@ -437,9 +449,13 @@ private:
     outInfo("loading plane from model file");
     rs::SceneCas cas(tcas);
     plane_inliers = pcl::PointIndices::Ptr(new pcl::PointIndices);
-    cloud = pcl::PointCloud<pcl::PointXYZRGBA>::Ptr(new pcl::PointCloud<pcl::PointXYZRGBA>());
     pcl::PointCloud <pcl::PointXYZRGBA>::Ptr cloudFiltered(new pcl::PointCloud<pcl::PointXYZRGBA>());
-    cas.get(VIEW_CLOUD,*cloud);
+    cloud = cas.getShared<pcl::PointCloud<pcl::PointXYZRGBA> >(VIEW_CLOUD);
+    if(!cloud)
+    {
+      outError("No cloud in CAS!");
+      return;
+    }
 
     cv::Mat planeCoeffs;
     cv::FileStorage fs;
@@ -502,7 +518,7 @@ private:
   bool process_cloud(pcl::ModelCoefficients::Ptr &plane_coefficients)
   {
     plane_inliers = pcl::PointIndices::Ptr(new pcl::PointIndices);
-    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud_filtered(cloud);
+    pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr cloud_filtered(cloud);
     pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud_filtered_no_nan(new pcl::PointCloud<pcl::PointXYZRGBA>);
 
     mapping_indices.clear();
@@ -624,7 +640,8 @@ private:
     //    uint32_t colors[6] = {0xFFFF0000, 0xFF00FF00, 0xFF0000FF, 0xFFFFFF00, 0xFFFF00FF, 0xFF00FFFF};
     const pcl::PointCloud<pcl::PointXYZRGBA>::VectorType &origPoints = this->cloud->points;
 
-    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr output;
+    pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr output;
+    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr filtered;
     switch(mode)
     {
     case BOARD:
@@ -632,32 +649,34 @@ private:
       break;
     case FILE:
     case PCL:
-      output.reset(new pcl::PointCloud<pcl::PointXYZRGBA>);
+      filtered.reset(new pcl::PointCloud<pcl::PointXYZRGBA>);
       ei.setInputCloud(cloud);
       ei.setIndices(plane_inliers);
       //      ei.setKeepOrganized(true);
-      ei.filter(*output);
+      ei.filter(*filtered);
+      output = filtered;
       break;
     case MPS:
-      output.reset(new pcl::PointCloud<pcl::PointXYZRGBA>);
+      filtered.reset(new pcl::PointCloud<pcl::PointXYZRGBA>);
       for(size_t i = 0; i < inlierIndices.size(); ++i)
       {
         const pcl::PointIndices &indices = this->inlierIndices[i];
-        const size_t outIndex = output->points.size();
-        output->points.resize(outIndex + indices.indices.size());
+        const size_t outIndex = filtered->points.size();
+        filtered->points.resize(outIndex + indices.indices.size());
         uint32_t rgba = rs::common::colors[i % rs::common::numberOfColors];
 
         #pragma omp parallel for
         for(size_t j = 0; j < indices.indices.size(); ++j)
         {
           const size_t index = indices.indices[j];
-          output->points[outIndex + j] = origPoints[index];
-          output->points[outIndex + j].rgba = rgba;
+          filtered->points[outIndex + j] = origPoints[index];
+          filtered->points[outIndex + j].rgba = rgba;
         }
       }
-      output->width = output->points.size();
-      output->height = 1;
-      output->is_dense = 1;
+      filtered->width = filtered->points.size();
+      filtered->height = 1;
+      filtered->is_dense = 1;
+      output = filtered;
       break;    
     }
 
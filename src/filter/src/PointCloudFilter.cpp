@@ -79,16 +79,20 @@ public:
     MEASURE_TIME;
     outInfo("process start");
     rs::SceneCas cas(tcas);
-    pcl::PointCloud<PointT>::Ptr cloud_ptr(new pcl::PointCloud<PointT>);
-    (new pcl::PointCloud<PointT>);
-
-    cas.get(VIEW_CLOUD, *cloud_ptr);
+    pcl::PointCloud<PointT>::ConstPtr cloud_ptr = cas.getShared<pcl::PointCloud<PointT> >(VIEW_CLOUD);
+    if(!cloud_ptr)
+    {
+      outError("No point cloud in CAS!");
+      return UIMA_ERR_NONE;
+    }
 
     pcl::PassThrough<PointT> pass;
     pass.setInputCloud(cloud_ptr);
     pass.setKeepOrganized(true);
     pass.setFilterLimits(minX, maxX);
     pass.setFilterFieldName("x");
+    // a new cloud every frame, the previous one might still be shown by the visualizer
+    cloud_filtered.reset(new pcl::PointCloud<PointT>);
     pass.filter(*cloud_filtered);
 
     pass.setFilterLimits(minY, maxY);
@@ -127,6 +131,12 @@ public:
     }
   }
 
+  void snapshotCloudWithLock(pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr &cloud, double &pointSize)
+  {
+    cloud = cloud_filtered;
+    pointSize = this->pointSize;
+  }
+
 };
 
 // This macro exports an entry point that is used to create the annotator.
@@ -20,6 +20,13 @@
 #ifndef __CAM_INTERFACE_H__
 #define __CAM_INTERFACE_H__
 
+// STL
+#include <mutex>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <condition_variable>
+
 // UIMA
 #include <uima/api.hpp>
 
@@ -28,19 +35,99 @@
 
 class CamInterface
 {
-protected:
+private:
+  mutable std::mutex dataLock;
+  std::condition_variable dataCV;
   bool _newData;
+  uint64_t dataTimestamp;
+
+protected:
+  CamInterface(const boost::property_tree::ptree &pt) : _newData(false), dataTimestamp(0) {}
 
-  CamInterface(const boost::property_tree::ptree &pt) : _newData(false) {}
+  /**
+   * Sets whether new data is available and wakes up threads waiting for it. Bridges call this from
+   * their callbacks, timestamp is the acquisition time of the data in nanoseconds, 0 if unknown.
+   */
+  void setNewData(const bool newData, const uint64_t timestamp = 0)
+  {
+    std::lock_guard<std::mutex> guard(dataLock);
+    _newData = newData;
+    if(newData)
+    {
+      dataTimestamp = timestamp;
+      dataCV.notify_all();
+    }
+  }
 
 public:
   virtual ~CamInterface() {}
 
   bool newData() const
   {
+    std::lock_guard<std::mutex> guard(dataLock);
     return _newData;
   }
 
+  /**
+   * Gets the acquisition time in nanoseconds of the available data, 0 if unknown.
+   */
+  uint64_t getDataTimestamp() const
+  {
+    std::lock_guard<std::mutex> guard(dataLock);
+    return dataTimestamp;
+  }
+
+  /**
+   * Blocks until new data is available or timeout has passed. Returns whether new data is available.
+   */
+  bool waitForData(const std::chrono::milliseconds &timeout)
+  {
+    std::unique_lock<std::mutex> guard(dataLock);
+    return dataCV.wait_for(guard, timeout, [this]() { return _newData; });
+  }
+
+  /**
+   * Blocks until all cameras have new data whose timestamps are at most syncTolerance nanoseconds
+   * apart, or timeout has passed. Data with unknown timestamps is always in sync. Returns whether
+   * synchronized data is available. While out of sync, the newer data is kept and the cameras lagging
+   * behind are waited for.
+   */
+  static bool waitForData(const std::vector<CamInterface *> &cameras, const std::chrono::milliseconds &timeout, const uint64_t syncTolerance)
+  {
+    const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + timeout;
+    for(;;)
+    {
+      uint64_t oldest = 0, newest = 0;
+      CamInterface *lagging = NULL;
+      for(size_t i = 0; i < cameras.size(); ++i)
+      {
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if(!cameras[i]->waitForData(std::chrono::duration_cast<std::chrono::milliseconds>(end > now ? end - now : std::chrono::steady_clock::duration::zero())))
+        {
+          return false;
+        }
+        const uint64_t timestamp = cameras[i]->getDataTimestamp();
+        if(timestamp && (!lagging || timestamp < oldest))
+        {
+          oldest = timestamp;
+          lagging = cameras[i];
+        }
+        newest = std::max(newest, timestamp);
+      }
+      if(!lagging || newest - oldest <= syncTolerance)
+      {
+        return true;
+      }
+
+      // wait for the lagging camera to get newer data
+      std::unique_lock<std::mutex> guard(lagging->dataLock);
+      if(!lagging->dataCV.wait_until(guard, end, [lagging, oldest]() { return lagging->dataTimestamp != oldest; }))
+      {
+        return false;
+      }
+    }
+  }
+
   virtual bool setData(uima::CAS &tcas, uint64_t ts = 0) = 0;
 };
 
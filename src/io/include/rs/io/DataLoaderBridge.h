@@ -20,8 +20,10 @@
 #ifndef __DATA_LOADER_BRIDGE_H__
 #define __DATA_LOADER_BRIDGE_H__
 
+#include <map>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 
 //RS
 #include <rs/scene_cas.h>
@@ -30,12 +32,23 @@
 #include <rs/io/CamInterface.h>
 #include <sensor_msgs/CameraInfo.h>
 
+//PCL
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
 //OpenCV
 #include <opencv2/opencv.hpp>
 
 class DataLoaderBridge : public CamInterface
 {
 private:
+  struct Frame
+  {
+    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud;
+    cv::Mat color;
+    cv::Mat depth;
+  };
+
   std::string path_to_cloud;
   std::string path_to_rgb;
   std::string path_to_depth;
@@ -60,7 +73,6 @@ private:
 
   double depth_scaling_factor;
 
-  int index_; // aka frameID, indexing for file list
   int data_size;
 
   double frameRate;
@@ -70,11 +82,28 @@ private:
   std::thread updateTimerThread;
   std::mutex updateLock;
 
+  // decoder threads reading the next frames ahead of the pipeline
+  int decoderThreads;
+  size_t prefetch;
+  std::vector<std::thread> decoders;
+  std::mutex frameLock;
+  std::condition_variable frameCV;
+  std::map<uint64_t, Frame> frames; // decoded frames by sequence number
+  uint64_t nextDecode;
+  uint64_t nextFrame;
+  bool decoding;
+  Frame current;
+
   bool readConfig(const boost::property_tree::ptree &pt);
   bool getListFile(std::string &path, std::vector<std::string> &filenames, std::string &pattern, bool &isFile);
   bool checkConsistency();
   void updateTimerWorker(const std::chrono::milliseconds period);
 
+  size_t frameCount() const;
+  bool isFinished(const uint64_t sequence) const;
+  void decodeFrame(const size_t index, Frame &frame) const;
+  void decodeWorker();
+
 public:
   DataLoaderBridge(const boost::property_tree::ptree &pt);
   ~DataLoaderBridge();
@@ -0,0 +1,98 @@
+/**
+ * Copyright 2014 University of Bremen, Institute for Artificial Intelligence
+ * Author(s): Ferenc Balint-Benczedi <balintbe@cs.uni-bremen.de>
+ *         Thiemo Wiedemeyer <wiedemeyer@cs.uni-bremen.de>
+ *         Jan-Hendrik Worch <jworch@cs.uni-bremen.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __FILE_STORAGE_H__
+#define __FILE_STORAGE_H__
+
+// STL
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// UIMA
+#include <uima/api.hpp>
+
+namespace rs
+{
+
+/******************************************************************************
+ * FileStorage
+ *****************************************************************************/
+
+/**
+ * File based alternative to rs::Storage, that does not need a running mongod.
+ *
+ * Every scene is appended as one record to the segment file "<file>.seg". A record contains the
+ * stored views as BSON documents, except for large byte arrays (point clouds, images), which are
+ * written as raw page aligned blobs behind them. The index file "<file>.idx" maps timestamps to
+ * records. Loading maps the record into memory and copies the blobs directly into ByteArrayFS.
+ */
+class FileStorage
+{
+private:
+  struct Record
+  {
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  std::string segmentFile;
+  std::string indexFile;
+  int segmentFD;
+  int indexFD;
+  uint64_t segmentSize;
+  size_t indexSize;
+
+  std::map<uint64_t, Record> records;
+
+  std::unordered_map<std::string, bool> storeViews;
+  std::unordered_map<std::string, bool> loadViews;
+
+  void readIndex();
+  bool appendIndex(const uint64_t timestamp, const Record &record);
+
+  FileStorage(const FileStorage &other);
+  FileStorage &operator=(const FileStorage &other);
+
+public:
+  FileStorage();
+  FileStorage(const std::string &file, const bool clear = false);
+  virtual ~FileStorage();
+
+  bool open(const std::string &file, const bool clear = false);
+  void close();
+  bool isOpen() const;
+
+  void enableViewStoring(const std::string &viewName, const bool enable);
+  void enableViewLoading(const std::string &viewName, const bool enable);
+
+  void getScenes(std::vector<uint64_t> &timestamps);
+  void getScenes(std::vector<uint64_t> &timestamps, const uint64_t begin, const uint64_t end);
+  void getNewScenes(std::vector<uint64_t> &timestamps);
+
+  bool storeScene(uima::CAS &cas, const uint64_t &timestamp);
+  bool removeScene(const uint64_t &timestamp);
+  bool updateScene(uima::CAS &cas, const uint64_t &timestamp);
+  bool loadScene(uima::CAS &cas, const uint64_t &timestamp);
+};
+
+} // namespace rs
+
+#endif //__FILE_STORAGE_H__
@@ -20,26 +20,61 @@
 #ifndef __MONGODB_BRIDGE_H__
 #define __MONGODB_BRIDGE_H__
 
+// STL
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
 // RS
 #include <rs/io/CamInterface.h>
 #include <rs/io/Storage.h>
+#include <rs/io/FileStorage.h>
 
 class MongoDBBridge : public CamInterface
 {
 private:
+  struct PrefetchedScene
+  {
+    size_t index;
+    bool found;
+    rs::Storage::SceneData data;
+  };
+
   std::string host;
   std::string db;
+  std::string file;
   rs::Storage storage;
+  rs::FileStorage fileStorage;
 
   std::vector<uint64_t> frames;
   size_t actualFrame;
   bool continual;
   bool loop;
+  bool lazyLoading;
   double playbackSpeed;
   uint64_t lastTimestamp, lastRun, simTimeLast;
 
+  // scenes fetched ahead of time by a second connection, see prefetchWorker
+  size_t prefetch;
+  rs::Storage prefetchStorage;
+  std::thread prefetchThread;
+  std::mutex prefetchLock;
+  std::condition_variable prefetchCV;
+  std::deque<PrefetchedScene> prefetched;
+  bool prefetchRunning;
+  bool prefetchFinished;
+
   void readConfig(const boost::property_tree::ptree &pt);
 
+  void getScenes(std::vector<uint64_t> &timestamps);
+  void getNewScenes(std::vector<uint64_t> &timestamps);
+  bool loadScene(uima::CAS &cas, const uint64_t timestamp);
+
+  void prefetchWorker(size_t index, std::vector<uint64_t> timestamps);
+  bool setPrefetchedData(uima::CAS &tcas);
+  void waitForPlayback(const uint64_t timestamp);
+
 public:
   MongoDBBridge(const boost::property_tree::ptree &pt);
   ~MongoDBBridge();
@@ -57,6 +57,7 @@ protected:
 
   bool lookupTransform(const ros::Time &timestamp);
   void setTransformAndTime(uima::CAS &tcas);
+  void setTransformAndTime(uima::CAS &tcas, const tf::StampedTransform &transform, const ros::Time &timestamp);
 };
 
 #endif // __ROS_CAM_INTERFACE2_H__
@@ -31,6 +31,10 @@
 
 //OpenCV
 #include <opencv2/opencv.hpp>
+#include <cv_bridge/cv_bridge.h>
+
+// STL
+#include <deque>
 
 // RS
 #include <rs/io/ROSCamInterface.h>
@@ -41,6 +45,21 @@ typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::Image, sens
 class ROSKinectBridge : public ROSCamInterface
 {
 private:
+  /**
+   * A received RGB-D frame. The images share their data with the received messages where possible,
+   * the messages are kept alive by the cv_bridge images.
+   */
+  struct Frame
+  {
+    cv_bridge::CvImageConstPtr colorMsg;
+    cv_bridge::CvImageConstPtr depthMsg;
+    cv::Mat color;
+    cv::Mat depth;
+    sensor_msgs::CameraInfo cameraInfo;
+    sensor_msgs::CameraInfo cameraInfoHD;
+    tf::StampedTransform transform;
+  };
+
   bool filterBlurredImages;
   bool scale;
   BlurDetector detector;
@@ -59,27 +78,31 @@ private:
            const sensor_msgs::Image::ConstPtr depth_img_msg,
            const sensor_msgs::CameraInfo::ConstPtr camera_info_msg);
 
-  cv::Mat color;
-  cv::Mat depth;
-
-  sensor_msgs::CameraInfo cameraInfo;
-  sensor_msgs::CameraInfo cameraInfoHD;
+  std::deque<Frame> frames;
+  size_t bufferSize;
 
   int depthOffset;
 
+  const Frame &findFrame(const uint64_t ts) const;
+
 public:
   ROSKinectBridge(const boost::property_tree::ptree &pt);
   ~ROSKinectBridge();
 
+  /**
+   * Sets the buffered frame closest to ts, the latest one if ts is 0 or the maximum value.
+   */
   bool setData(uima::CAS &tcas, u_int64_t = std::numeric_limits<uint64_t>::max());
   inline void getColorImage(cv::Mat& c)
   {
-    c = this->color.clone();
+    std::lock_guard<std::mutex> guard(lock);
+    c = frames.empty() ? cv::Mat() : frames.back().color.clone();
   }
 
   inline void getDepthImage(cv::Mat& d)
   {
-    d = this->depth.clone();
+    std::lock_guard<std::mutex> guard(lock);
+    d = frames.empty() ? cv::Mat() : frames.back().depth.clone();
   }
 };
 
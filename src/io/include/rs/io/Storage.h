@@ -21,7 +21,15 @@
 #define __STORAGE_H__
 
 // STL
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 // MONGO
@@ -51,29 +59,147 @@ namespace rs
 
 class Storage
 {
+public:
+  /**
+   * Documents of a stored scene, fetched from the database but not yet converted to feature
+   * structures. Can be fetched on another thread than the one loading it into a CAS.
+   */
+  struct SceneData
+  {
+    // byte array stored in chunks outside of the document of its feature structure
+    struct Blob
+    {
+      size_t object;
+      std::string feature;
+      // sized from the stored total size, the chunks are copied in as they arrive
+      std::vector<char> bytes;
+    };
+
+    struct View
+    {
+      std::string name;
+      bool isArray;
+      std::vector< ::mongo::BSONObj> objects;
+      std::vector<Blob> blobs;
+    };
+
+    uint64_t timestamp;
+    std::vector<View> views;
+  };
+
+  /**
+   * Documents of a scene or collection converted from a CAS, ready to be written by another thread
+   * than the one owning the CAS.
+   */
+  struct WriteBatch
+  {
+    /**
+     * Document of a deduplicated view, identified by the hash of its content. The content is only
+     * sent if the document is not known to be stored already.
+     */
+    struct SharedDocument
+    {
+      ::mongo::OID id;
+      ::mongo::BSONObj content;
+      int references;
+    };
+
+    uint64_t timestamp;
+    // remove the stored scene with the same timestamp first
+    bool update;
+    // collections to be emptied before inserting
+    std::vector<std::string> clear;
+    // view documents per collection
+    std::map<std::string, std::vector< ::mongo::BSONObj> > documents;
+    // deduplicated view documents per collection
+    std::map<std::string, std::vector<SharedDocument> > shared;
+    // the scene document, empty for collections
+    ::mongo::BSONObj scene;
+
+    // byte array of a view document, split into chunks only while being inserted
+    struct Blob
+    {
+      ::mongo::OID parent;
+      ::mongo::OID id;
+      std::vector<char> bytes;
+    };
+    std::vector<Blob> blobs;
+
+    WriteBatch() : timestamp(0), update(false)
+    {
+    }
+
+    /**
+     * Takes over the content of shared documents from a batch that could not be written. Later
+     * batches might only reference them, since they were expected to be stored by it.
+     */
+    void keepSharedContent(const WriteBatch &dropped);
+
+    /**
+     * Whether the batch is the first to store the content of a shared document, like the camera
+     * info, which later batches only reference. Such a batch must not be dropped.
+     */
+    bool hasSharedContent() const;
+  };
+
 private:
   ::mongo::DBClientConnection db;
+  // the connection is shared by the camera bridge and lazily loaded views of CASes in flight
+  std::recursive_mutex dbLock;
+
+  // additional connections for fetching the views of a scene in parallel, idle ones and how many are open
+  std::vector<std::unique_ptr< ::mongo::DBClientConnection> > fetchConnections;
+  size_t openFetchConnections;
+  std::mutex fetchLock;
+  std::condition_variable fetchReleased;
+
+  // workers fetching the views of all scenes, started on first use and stopped by the destructor
+  std::vector<std::thread> fetchWorkers;
+  std::deque<std::function<void()> > fetchTasks;
+  std::condition_variable fetchQueued;
+  bool fetchStopping;
+
+  class FetchConnection;
 
   std::string dbHost;
   std::string dbName;
   std::string dbBase;
   std::string dbCAS;
   std::string dbScripts;
+  std::string dbBlobs;
 
   std::unordered_map<std::string, bool> storeViews;
   std::unordered_map<std::string, bool> loadViews;
 
-  std::unordered_map<std::string,mongo::OID> camInfoOIDs;
-  bool first;
+  std::unordered_map<std::string, bool> dedupViews;
+  // shared documents known to be stored, as collection and id
+  std::unordered_set<std::string> sharedDocuments;
+  std::mutex sharedLock;
+
+  bool lazyLoading;
+  size_t blobThreshold;
 
   void setupDBScripts();
 
-  bool readArrayFS(uima::FeatureStructure fs, ::mongo::BSONObjBuilder &builderCAS, const ::mongo::OID &casOID, const std::string &sofaId, const std::string &dbCollection);
-  bool readFS(uima::FeatureStructure fs, ::mongo::BSONObjBuilder &builderCAS, const ::mongo::OID &casOID, const std::string &sofaId, const std::string &dbCollection);
+  bool readArrayFS(uima::FeatureStructure fs, ::mongo::BSONObjBuilder &builderCAS, const ::mongo::OID &casOID, const std::string &sofaId, const std::string &dbCollection, WriteBatch &batch);
+  bool readFS(uima::FeatureStructure fs, ::mongo::BSONObjBuilder &builderCAS, const ::mongo::OID &casOID, const std::string &sofaId, const std::string &dbCollection, WriteBatch &batch);
+  ::mongo::OID convertDocument(const uima::FeatureStructure &fs, const ::mongo::OID &casOID, const std::string &sofaId, const std::string &dbCollection, WriteBatch &batch);
+  ::mongo::OID addDocument(const ::mongo::BSONObj &object, const std::string &sofaId, const std::string &dbCollection, WriteBatch &batch);
 
   void loadView(uima::CAS &cas, const ::mongo::BSONElement &elem);
+  uima::FeatureStructure loadViewData(uima::CAS *view, const ::mongo::BSONElement &elem);
   uima::FeatureStructure loadArrayFS(uima::CAS *view, const std::string &viewName, const std::vector< ::mongo::OID> &ids);
-  uima::FeatureStructure loadFS(uima::CAS *view, const std::string &viewName, const ::mongo::OID &id);
+
+  std::unique_ptr< ::mongo::DBClientConnection> acquireConnection();
+  void releaseConnection(std::unique_ptr< ::mongo::DBClientConnection> &connection);
+  void fetchWorker();
+  void fetchViews(const std::vector< ::mongo::BSONElement> &elems, std::vector<SceneData::View> &views,
+                  const std::function<void(const SceneData::View &)> &fetched = std::function<void(const SceneData::View &)>());
+  void fetchViewData(::mongo::DBClientConnection &connection, const ::mongo::BSONElement &elem, SceneData::View &data);
+  void fetchBlobs(::mongo::DBClientConnection &connection, SceneData::View &data);
+  uima::FeatureStructure convertViewData(uima::CAS *view, const SceneData::View &data);
+  void insertView(uima::CAS &cas, const SceneData::View &data);
+  uima::CAS *getView(uima::CAS &cas, const std::string &viewName);
 
   void removeView(const ::mongo::BSONElement &elem);
 
@@ -88,13 +214,76 @@ public:
   void enableViewStoring(const std::string &viewName, const bool enable);
   void enableViewLoading(const std::string &viewName, const bool enable);
 
+  /**
+   * Stores the documents of a view only once per content. Scenes reference them by a hash of their
+   * content and removeScene only removes them once no scene references them anymore. Meant for
+   * views that rarely change, like camera infos or the semantic map.
+   */
+  void enableViewDeduplication(const std::string &viewName, const bool enable);
+
+  /**
+   * If enabled, loadScene only registers the views and fetches their data from the database the
+   * first time an annotator reads them through rs::SceneCas.
+   */
+  void enableLazyLoading(const bool enable);
+
+  /**
+   * Byte arrays (point clouds, images) of at least bytes size are stored in chunks in a separate
+   * collection instead of inside the document of their feature structure. This keeps documents
+   * below the size limit of MongoDB. 0 disables it. Only byte array features of the view's feature
+   * structures themselves are stored this way, arrays of nested feature structures stay inline.
+   * Deduplicated views and collections always keep their arrays inline.
+   */
+  void setBlobThreshold(const size_t bytes);
+
+  /**
+   * Gets the timestamps of all stored scenes in ascending order.
+   */
   void getScenes(std::vector<uint64_t> &timestamps);
 
+  /**
+   * Gets the timestamps of the stored scenes in [begin, end] in ascending order. Only the indexed
+   * timestamps are read, so this is cheap even for large databases.
+   */
+  void getScenes(std::vector<uint64_t> &timestamps, const uint64_t begin, const uint64_t end);
+
+  /**
+   * Appends the timestamps of the scenes newer than the last one in timestamps, for polling.
+   */
+  void getNewScenes(std::vector<uint64_t> &timestamps);
+
   bool storeScene(uima::CAS &cas, const uint64_t &timestamp);
   bool removeScene(const uint64_t &timestamp);
   bool updateScene(uima::CAS &cas, const uint64_t &timestamp);
   bool loadScene(uima::CAS &cas, const uint64_t &timestamp);
 
+  /**
+   * Fetches the documents of the views loadScene would load, without touching a CAS. Returns false if
+   * the scene does not exist or one of its views could not be read, e.g. because of an incomplete blob.
+   */
+  bool fetchScene(const uint64_t &timestamp, SceneData &scene);
+
+  /**
+   * Loads a scene fetched by fetchScene into cas. Does not access the database.
+   */
+  void loadScene(uima::CAS &cas, const SceneData &scene);
+
+  /**
+   * Converts the views of cas to documents, the first part of storeScene and updateScene.
+   */
+  void serializeScene(uima::CAS &cas, const uint64_t &timestamp, WriteBatch &batch, const bool update = false);
+
+  /**
+   * Converts view of cas to documents replacing collection, the first part of storeCollection.
+   */
+  void serializeCollection(uima::CAS &cas, const std::string &view, const std::string &collection, WriteBatch &batch);
+
+  /**
+   * Writes a batch with one bulk insert per collection. The scene document is inserted last, so
+   * that a scene is only found once all its views are stored.
+   */
+  bool writeBatch(const WriteBatch &batch);
+
   void removeCollection(const std::string &collection);
   void storeCollection(uima::CAS &cas, const std::string &view, const std::string &collection);
   void loadCollection(uima::CAS &cas, const std::string &view, const std::string &collection);
@@ -20,6 +20,8 @@
 #include <vector>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
 
 // OpenCV
 #include <opencv2/opencv.hpp>
@@ -30,7 +32,9 @@
 
 // ROS
 #include <ros/node_handle.h>
+#include <ros/callback_queue.h>
 #include <std_msgs/Header.h>
+#include <std_msgs/String.h>
 #include <sensor_msgs/image_encodings.h>
 
 // RS
@@ -53,7 +57,7 @@ private:
   std::thread cloudViewerThread;
   std::mutex lock;
 
-  bool running;
+  std::atomic<bool> running;
   bool updateImage;
   bool updateCloud;
   bool changedAnnotator;
@@ -68,12 +72,36 @@ private:
   ros::NodeHandle nh;
   ros::Publisher pub;
 
+  bool headless;
+  double headlessRate;
+  std::string headlessFormat;
+  std::string headlessFile;
+  std::thread headlessThread;
+  std::thread encoderThread;
+  std::mutex encoderLock;
+  std::condition_variable encoderCV;
+  cv::Mat encoderImage;
+  bool encoderPending;
+  ros::NodeHandle headlessNh;
+  ros::CallbackQueue headlessQueue;
+  ros::Publisher pubCompressed;
+  ros::Subscriber subAnnotator;
+
 public:
   static bool *trigger;
 
   Visualizer(const std::string &savePath);
   ~Visualizer();
 
+  /**
+   * Runs without any windows. Only the selected annotator is rendered, at most rate times per
+   * second and only while someone is subscribed to "~output_image/compressed" or file is set.
+   * The images are encoded as format ("jpeg" or "png") in a background thread and published,
+   * and written to file, which is replaced with every frame. Annotators are selected by name on
+   * "~select_annotator". Has to be called before start.
+   */
+  void setHeadless(const double rate, const std::string &format, const std::string &file);
+
   bool start();
   void stop();
 
@@ -84,17 +112,21 @@ private:
 
   void nextAnnotator();
   void prevAnnotator();
+  void selectAnnotator(const std_msgs::String::ConstPtr &msg);
   void checkAnnotator();
   void shutdown();
 
   void imageViewer();
   void cloudViewer();
+  void headlessViewer();
+  void encoder();
 
   void keyboardEventImageViewer(const cv::Mat &disp);
   void keyboardEventCloudViewer(const pcl::visualization::KeyboardEvent &event, void *);
 
   void saveImage(const cv::Mat &disp);
   void saveCloud(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud, pcl::visualization::PCLVisualizer::Ptr &visualizer);
+  void writeFile(const std::vector<uchar> &data);
 };
 
 }
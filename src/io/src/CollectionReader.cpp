@@ -60,6 +60,8 @@ private:
   std::vector<SemanticMapItem> semanticMapItems;
 
   std::vector<CamInterface *> cameras;
+  uint64_t syncTolerance;
+  std::chrono::milliseconds syncTimeout;
 
   uint64_t convertToInt(const std::string &s) const
   {
@@ -225,6 +227,20 @@ public:
         readConfig(*configs[i]);
       }
     }
+
+    float tolerance = -1.0f;
+    if(ctx.isParameterDefined("sync_tolerance"))
+    {
+      ctx.extractValue("sync_tolerance", tolerance);
+    }
+    syncTolerance = tolerance < 0.0f ? std::numeric_limits<uint64_t>::max() : (uint64_t)(tolerance * 1000000.0);
+
+    int timeout = 500;
+    if(ctx.isParameterDefined("sync_timeout"))
+    {
+      ctx.extractValue("sync_timeout", timeout);
+    }
+    syncTimeout = std::chrono::milliseconds(std::max(timeout, 0));
     return UIMA_ERR_NONE;
   }
 
@@ -272,12 +288,16 @@ public:
 
     outInfo("waiting for all cameras to have new data...");
     double t1 = clock.getTime();
-    for(size_t i = 0; i < cameras.size(); ++i)
+    // cameras with a constant clock offset never get in sync, after syncTimeout the latest data is used
+    const std::chrono::steady_clock::time_point syncEnd = std::chrono::steady_clock::now() + syncTimeout;
+    bool sync = true;
+    while(!CamInterface::waitForData(cameras, std::chrono::milliseconds(100), sync ? syncTolerance : std::numeric_limits<uint64_t>::max()))
     {
-      while(!cameras[i]->newData())
+      check_ros();
+      if(sync && syncTolerance != std::numeric_limits<uint64_t>::max() && std::chrono::steady_clock::now() >= syncEnd)
       {
-        usleep(100);
-        check_ros();
+        outWarn("cameras not in sync after " << syncTimeout.count() << " ms, using their latest data.");
+        sync = false;
       }
     }
     outInfo("Cameras got new data after waiting " << clock.getTime() - t1 << " ms. Receiving...");
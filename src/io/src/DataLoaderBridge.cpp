@@ -22,8 +22,6 @@
 #include <ros/package.h>
 
 //PCL includes
-#include <pcl/point_cloud.h>
-#include <pcl/point_types.h>
 #include <pcl/io/pcd_io.h>
 #include <pcl/io/ply_io.h>
 
@@ -54,23 +52,39 @@ DataLoaderBridge::DataLoaderBridge(const boost::property_tree::ptree &pt) : CamI
   haveRGB = false;
   haveDepth = false;
 
-  index_ = 0;
+  data_size = 0;
+  done = false;
+  decoderThreads = 0;
+  prefetch = 1;
+  nextDecode = 0;
+  nextFrame = 0;
+  decoding = false;
 
   if (this->readConfig(pt))
   {
-    this->_newData = true;
+    setNewData(true);
   }
   else
   {
-    this->_newData = false;
+    setNewData(false);
   }
 
-  if (this->frameRate > 0 && this->_newData)
+  if (this->frameRate > 0 && newData())
   {
     auto worker = std::bind(&DataLoaderBridge::updateTimerWorker, this,
       std::chrono::milliseconds(std::lround(1000 / this->frameRate)));
     this->updateTimerThread = std::thread(worker);
   }
+
+  if(newData() && decoderThreads > 0)
+  {
+    outInfo("decoding with " << decoderThreads << " threads, " << prefetch << " frames ahead.");
+    decoding = true;
+    for(int i = 0; i < decoderThreads; ++i)
+    {
+      decoders.push_back(std::thread(&DataLoaderBridge::decodeWorker, this));
+    }
+  }
 }
 
 DataLoaderBridge::~DataLoaderBridge()
@@ -80,6 +94,16 @@ DataLoaderBridge::~DataLoaderBridge()
   {
     this->updateTimerThread.join();
   }
+
+  {
+    std::lock_guard<std::mutex> lock(frameLock);
+    decoding = false;
+    frameCV.notify_all();
+  }
+  for(size_t i = 0; i < decoders.size(); ++i)
+  {
+    decoders[i].join();
+  }
 }
 
 //NOTE: check if all are files or all size of data are equal
@@ -155,7 +179,7 @@ void DataLoaderBridge::updateTimerWorker(const std::chrono::milliseconds period)
     std::this_thread::sleep_for(period);
     {
       std::lock_guard<std::mutex> lock(this->updateLock);
-      this->_newData = true;
+      setNewData(true);
       //outInfo("newData");
     }
   }
@@ -256,6 +280,8 @@ bool DataLoaderBridge::readConfig(const boost::property_tree::ptree &pt)
   }
 
   this->isLoop = pt.get<bool>("option.isLoop", true);
+  this->decoderThreads = pt.get<int>("option.decoderThreads", 1);
+  this->prefetch = std::max(pt.get<int>("option.prefetch", 4), 1);
 
   if(!checkConsistency())
   {
@@ -292,105 +318,149 @@ bool DataLoaderBridge::readConfig(const boost::property_tree::ptree &pt)
   return success;
 }
 
-bool DataLoaderBridge::setData(uima::CAS &tcas, uint64_t ts)
+size_t DataLoaderBridge::frameCount() const
 {
-  if(!newData())
-  {
-    return false;
-  }
-
-  outInfo("setData");
+  // single files are posted as one frame
+  return data_size > 0 ? data_size : 1;
+}
 
-  rs::SceneCas cas(tcas);
+bool DataLoaderBridge::isFinished(const uint64_t sequence) const
+{
+  return !isLoop && sequence >= frameCount();
+}
 
+void DataLoaderBridge::decodeFrame(const size_t index, Frame &frame) const
+{
   if(haveCloud)
   {
-    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud_ptr (new pcl::PointCloud<pcl::PointXYZRGBA>);
-
-    std::string path;
-    if(!isCloudFile)
-    {
-      path = clouds[index_];
-    }
-    else
-    {
-      path = path_to_cloud;
-    }
-
-    if(pcl::io::loadPCDFile (path, *cloud_ptr) == -1)
+    const std::string &path = isCloudFile ? path_to_cloud : clouds[index];
+    frame.cloud.reset(new pcl::PointCloud<pcl::PointXYZRGBA>);
+    if(pcl::io::loadPCDFile (path, *frame.cloud) == -1)
     {
       outError("Could not load point cloud file as PCD type. Check path again!");
     }
-
-    cas.set(VIEW_CLOUD, *cloud_ptr);
   }
 
   auto imageSize = cv::Size(this->cameraInfo.width, this->cameraInfo.height);
 
   if(haveRGB)
   {
-    std::string path;
-    if(!isRGBFile)
+    const std::string &path = isRGBFile ? path_to_rgb : images[index];
+    frame.color = cv::imread(path);
+    if(frame.color.empty())
     {
-      path = images[index_];
+      outError("Could not load color image " << path << ".");
     }
     else
     {
-      path = path_to_rgb;
+      cv::resize(frame.color, frame.color, imageSize, 0, 0, cv::INTER_NEAREST);
     }
-
-    this->color = cv::imread(path);
-    cv::resize(color, color, imageSize, 0, 0, cv::INTER_NEAREST);
-    cas.set(VIEW_COLOR_IMAGE, color);
   }
 
   if(haveDepth)
   {
-    std::string path;
-    if(!isDepthFile)
+    const std::string &path = isDepthFile ? path_to_depth : depths[index];
+    frame.depth = cv::imread(path,  CV_LOAD_IMAGE_ANYDEPTH);
+    if(frame.depth.empty())
     {
-      path = depths[index_];
+      outError("Could not load depth image " << path << ".");
+      return;
     }
-    else
-    {
-      path = path_to_depth;
-    }
-
-    this->depth = cv::imread(path,  CV_LOAD_IMAGE_ANYDEPTH);
-    cv::resize(depth, depth, imageSize, 0, 0, cv::INTER_NEAREST);
+    cv::resize(frame.depth, frame.depth, imageSize, 0, 0, cv::INTER_NEAREST);
 
-    if (depth.type() == CV_8UC1)
+    if (frame.depth.type() == CV_8UC1)
     {
-      depth.convertTo(depth, CV_16UC1, this->depth_scaling_factor, 0);
+      frame.depth.convertTo(frame.depth, CV_16UC1, this->depth_scaling_factor, 0);
     }
     else
     {
-      depth.convertTo(depth, -1, this->depth_scaling_factor, 0);
+      frame.depth.convertTo(frame.depth, -1, this->depth_scaling_factor, 0);
     }
-
-    cas.set(VIEW_DEPTH_IMAGE, depth);
   }
+}
 
-  cas.set(VIEW_CAMERA_INFO, cameraInfo);
-
-  index_++;
-  if(index_ > data_size - 1)
+void DataLoaderBridge::decodeWorker()
+{
+  std::unique_lock<std::mutex> lock(frameLock);
+  while(decoding)
   {
-    if(isLoop)
+    // at most prefetch frames are decoded or waiting for the pipeline
+    if(nextDecode - nextFrame >= prefetch || isFinished(nextDecode))
     {
-      index_ = 0;
+      frameCV.wait(lock);
+      continue;
     }
-    else
+
+    const uint64_t sequence = nextDecode++;
+    lock.unlock();
+    Frame frame;
+    decodeFrame(sequence % frameCount(), frame);
+    lock.lock();
+
+    frames[sequence] = frame;
+    frameCV.notify_all();
+  }
+}
+
+bool DataLoaderBridge::setData(uima::CAS &tcas, uint64_t ts)
+{
+  if(!newData())
+  {
+    return false;
+  }
+
+  outInfo("setData");
+
+  // if not looping, the last frame is posted again after all files were read
+  if(!isFinished(nextFrame) && decoders.empty())
+  {
+    decodeFrame(nextFrame % frameCount(), current);
+    ++nextFrame;
+  }
+  else if(!isFinished(nextFrame))
+  {
+    std::unique_lock<std::mutex> lock(frameLock);
+    std::map<uint64_t, Frame>::iterator it;
+    while((it = frames.find(nextFrame)) == frames.end())
     {
-      this->done = true;
-      index_ = data_size - 1;
+      frameCV.wait(lock);
     }
+    current = it->second;
+    frames.erase(it);
+    ++nextFrame;
+    frameCV.notify_all();
+  }
+
+  if(isFinished(nextFrame))
+  {
+    this->done = true;
+  }
+
+  rs::SceneCas cas(tcas);
+
+  if(haveCloud)
+  {
+    cas.set(VIEW_CLOUD, *current.cloud);
+  }
+
+  if(haveRGB)
+  {
+    this->color = current.color;
+    cas.set(VIEW_COLOR_IMAGE, color);
+  }
+
+  if(haveDepth)
+  {
+    this->depth = current.depth;
+    cas.set(VIEW_DEPTH_IMAGE, depth);
   }
 
+  cas.set(VIEW_CAMERA_INFO, cameraInfo);
+
   if (this->frameRate > 0)
   {
     std::lock_guard<std::mutex> lock(this->updateLock);
-    _newData = false;
+    setNewData(false);
   }
 
   return true;
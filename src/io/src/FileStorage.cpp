@@ -0,0 +1,706 @@
+/**
+ * Copyright 2014 University of Bremen, Institute for Artificial Intelligence
+ * Author(s): Ferenc Balint-Benczedi <balintbe@cs.uni-bremen.de>
+ *         Thiemo Wiedemeyer <wiedemeyer@cs.uni-bremen.de>
+ *         Jan-Hendrik Worch <jworch@cs.uni-bremen.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// SYSTEM
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// STL
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+
+// UNICODE STRING
+#include <unicode/unistr.h>
+
+// MONGO
+#include <mongo/bson/bson.h>
+
+// RS
+#include <rs/scene_cas.h>
+#include <rs/utils/output.h>
+#include <rs/io/FileStorage.h>
+#include <rs/conversion/bson.h>
+
+//#undef OUT_LEVEL
+//#define OUT_LEVEL OUT_LEVEL_DEBUG
+
+using namespace rs;
+
+/******************************************************************************
+ * Defines
+ *****************************************************************************/
+
+#define FILE_SEGMENT_EXT   ".seg"
+#define FILE_INDEX_EXT     ".idx"
+#define FILE_MAGIC         "RSCS"
+#define FILE_VERSION       1
+#define FILE_ALIGNMENT     4096
+#define FILE_BLOB_MIN_SIZE 4096
+#define FILE_CHUNK_SIZE    (1 << 20)
+
+/******************************************************************************
+ * File layout
+ *****************************************************************************/
+
+/*
+ * Record: RecordHeader, then for every view a ViewHeader, the view name, the BSON document of each
+ * element and a BlobHeader plus feature name for each extracted byte array. All of these are padded
+ * to 8 bytes. The blobs follow at FILE_ALIGNMENT aligned offsets relative to the record start,
+ * which itself is FILE_ALIGNMENT aligned inside the segment file.
+ */
+
+struct RecordHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint64_t timestamp;
+  uint32_t views;
+  uint32_t reserved;
+  uint64_t size;
+};
+
+struct ViewHeader
+{
+  uint32_t nameSize;
+  uint32_t isArray;
+  uint32_t elements;
+  uint32_t blobs;
+};
+
+struct BlobHeader
+{
+  uint32_t element;
+  uint32_t nameSize;
+  uint64_t size;
+  uint64_t offset;
+};
+
+/*
+ * Index: list of IndexEntry, size 0 marks a removed scene.
+ */
+struct IndexEntry
+{
+  uint64_t timestamp;
+  uint64_t offset;
+  uint64_t size;
+};
+
+static inline uint64_t align(const uint64_t value, const uint64_t alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+static inline void appendPadded(std::string &buffer, const void *data, const size_t size)
+{
+  buffer.append((const char *)data, size);
+  buffer.resize(align(buffer.size(), 8), '\0');
+}
+
+/*
+ * Reads the padded parts of a mapped record without ever leaving it.
+ */
+class RecordReader
+{
+private:
+  const char *pos;
+  const char *end;
+
+public:
+  RecordReader(const char *begin, const char *end) : pos(begin), end(end)
+  {
+  }
+
+  uint64_t remaining() const
+  {
+    return end - pos;
+  }
+
+  /*
+   * Returns the next size bytes and skips their padding, or NULL if they are not inside the record.
+   */
+  const char *take(const uint64_t size)
+  {
+    if(size > remaining())
+    {
+      return NULL;
+    }
+    const char *data = pos;
+    pos += std::min(align(size, 8), remaining());
+    return data;
+  }
+};
+
+/*
+ * A view of a mapped record, checked against the bounds of the record.
+ */
+struct RecordView
+{
+  std::string name;
+  bool isArray;
+  std::vector<mongo::BSONObj> objects;
+  std::vector<const BlobHeader *> blobHeaders;
+  std::vector<std::string> blobNames;
+};
+
+static bool readView(RecordReader &reader, const uint64_t recordSize, RecordView &view)
+{
+  const ViewHeader *header = (const ViewHeader *)reader.take(sizeof(ViewHeader));
+  const char *name = header ? reader.take(header->nameSize) : NULL;
+  // every element and blob takes at least its size or header, checked before allocating for them
+  if(!name || header->elements > reader.remaining() / sizeof(uint64_t) || header->blobs > reader.remaining() / sizeof(BlobHeader))
+  {
+    return false;
+  }
+  view.name.assign(name, header->nameSize);
+  view.isArray = header->isArray != 0;
+
+  view.objects.resize(header->elements);
+  for(uint32_t i = 0; i < header->elements; ++i)
+  {
+    const uint64_t *size = (const uint64_t *)reader.take(sizeof(uint64_t));
+    const char *object = size ? reader.take(*size) : NULL;
+    // the BSON document has to fill exactly the stored size and be valid inside it
+    if(!object || *size < 5 || *size > (uint64_t)std::numeric_limits<int32_t>::max() || *(const int32_t *)object != (int32_t)*size)
+    {
+      return false;
+    }
+    view.objects[i] = mongo::BSONObj(object);
+    if(!view.objects[i].valid())
+    {
+      return false;
+    }
+  }
+
+  view.blobHeaders.resize(header->blobs);
+  view.blobNames.resize(header->blobs);
+  for(uint32_t i = 0; i < header->blobs; ++i)
+  {
+    const BlobHeader *blobHeader = (const BlobHeader *)reader.take(sizeof(BlobHeader));
+    const char *blobName = blobHeader ? reader.take(blobHeader->nameSize) : NULL;
+    if(!blobName || blobHeader->element >= header->elements
+       || blobHeader->size > recordSize || blobHeader->offset > recordSize - blobHeader->size)
+    {
+      return false;
+    }
+    view.blobHeaders[i] = blobHeader;
+    view.blobNames[i].assign(blobName, blobHeader->nameSize);
+  }
+  return true;
+}
+
+static bool writeAll(const int fd, const char *data, size_t size, uint64_t offset)
+{
+  while(size > 0)
+  {
+    const ssize_t written = pwrite(fd, data, size, offset);
+    if(written < 0)
+    {
+      if(errno == EINTR)
+      {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    size -= written;
+    offset += written;
+  }
+  return true;
+}
+
+/******************************************************************************
+ * FileStorage
+ *****************************************************************************/
+
+FileStorage::FileStorage() : segmentFD(-1), indexFD(-1), segmentSize(0), indexSize(0)
+{
+}
+
+FileStorage::FileStorage(const std::string &file, const bool clear) : segmentFD(-1), indexFD(-1), segmentSize(0), indexSize(0)
+{
+  open(file, clear);
+}
+
+FileStorage::~FileStorage()
+{
+  close();
+}
+
+bool FileStorage::open(const std::string &file, const bool clear)
+{
+  close();
+
+  segmentFile = file + FILE_SEGMENT_EXT;
+  indexFile = file + FILE_INDEX_EXT;
+
+  const int flags = O_RDWR | O_CREAT | (clear ? O_TRUNC : 0);
+  segmentFD = ::open(segmentFile.c_str(), flags, 0644);
+  indexFD = ::open(indexFile.c_str(), flags, 0644);
+  if(segmentFD < 0 || indexFD < 0)
+  {
+    outError("could not open scene file '" << file << "': " << strerror(errno));
+    close();
+    return false;
+  }
+
+  struct stat info;
+  fstat(segmentFD, &info);
+  segmentSize = info.st_size;
+
+  readIndex();
+  outInfo("opened scene file '" << file << "' with " << records.size() << " scenes.");
+  return true;
+}
+
+void FileStorage::close()
+{
+  if(segmentFD >= 0)
+  {
+    ::close(segmentFD);
+  }
+  if(indexFD >= 0)
+  {
+    ::close(indexFD);
+  }
+  segmentFD = -1;
+  indexFD = -1;
+  segmentSize = 0;
+  indexSize = 0;
+  records.clear();
+}
+
+bool FileStorage::isOpen() const
+{
+  return segmentFD >= 0 && indexFD >= 0;
+}
+
+void FileStorage::readIndex()
+{
+  struct stat info;
+  if(fstat(indexFD, &info) < 0)
+  {
+    return;
+  }
+
+  // only read entries appended since the last call, the file may be written by another process
+  const size_t count = info.st_size / sizeof(IndexEntry) - indexSize;
+  if(count == 0)
+  {
+    return;
+  }
+
+  // entries pointing outside the segment file, e.g. of a truncated file, are dropped
+  if(fstat(segmentFD, &info) < 0)
+  {
+    return;
+  }
+  const uint64_t fileSize = info.st_size;
+
+  std::vector<IndexEntry> entries(count);
+  if(pread(indexFD, entries.data(), count * sizeof(IndexEntry), indexSize * sizeof(IndexEntry)) != (ssize_t)(count * sizeof(IndexEntry)))
+  {
+    outError("could not read index file '" << indexFile << "'.");
+    return;
+  }
+  indexSize += count;
+
+  for(size_t i = 0; i < entries.size(); ++i)
+  {
+    const IndexEntry &entry = entries[i];
+    if(entry.size == 0)
+    {
+      records.erase(entry.timestamp);
+    }
+    else if(entry.size < sizeof(RecordHeader) || entry.size > fileSize || entry.offset > fileSize - entry.size)
+    {
+      outError("invalid index entry for timestamp " << entry.timestamp << " in '" << indexFile << "'.");
+      records.erase(entry.timestamp);
+    }
+    else
+    {
+      Record &record = records[entry.timestamp];
+      record.offset = entry.offset;
+      record.size = entry.size;
+    }
+  }
+}
+
+bool FileStorage::appendIndex(const uint64_t timestamp, const Record &record)
+{
+  IndexEntry entry;
+  entry.timestamp = timestamp;
+  entry.offset = record.offset;
+  entry.size = record.size;
+
+  if(!writeAll(indexFD, (const char *)&entry, sizeof(IndexEntry), indexSize * sizeof(IndexEntry)))
+  {
+    outError("could not write index file '" << indexFile << "'.");
+    return false;
+  }
+  ++indexSize;
+  return true;
+}
+
+void FileStorage::enableViewStoring(const std::string &viewName, const bool enable)
+{
+  storeViews[viewName] = enable;
+}
+
+void FileStorage::enableViewLoading(const std::string &viewName, const bool enable)
+{
+  loadViews[viewName] = enable;
+}
+
+void FileStorage::getScenes(std::vector<uint64_t> &timestamps)
+{
+  getScenes(timestamps, 0, std::numeric_limits<uint64_t>::max());
+}
+
+void FileStorage::getScenes(std::vector<uint64_t> &timestamps, const uint64_t begin, const uint64_t end)
+{
+  timestamps.clear();
+  if(!isOpen())
+  {
+    return;
+  }
+
+  readIndex();
+  std::map<uint64_t, Record>::const_iterator it = records.lower_bound(begin);
+  const std::map<uint64_t, Record>::const_iterator itEnd = records.upper_bound(end);
+  for(; it != itEnd; ++it)
+  {
+    timestamps.push_back(it->first);
+  }
+}
+
+void FileStorage::getNewScenes(std::vector<uint64_t> &timestamps)
+{
+  if(timestamps.empty())
+  {
+    getScenes(timestamps);
+    return;
+  }
+
+  std::vector<uint64_t> newScenes;
+  getScenes(newScenes, timestamps.back() + 1, std::numeric_limits<uint64_t>::max());
+  timestamps.insert(timestamps.end(), newScenes.begin(), newScenes.end());
+}
+
+bool FileStorage::storeScene(uima::CAS &cas, const uint64_t &timestamp)
+{
+  if(!isOpen())
+  {
+    outError("scene file is not open.");
+    return false;
+  }
+
+  struct Blob
+  {
+    uima::ByteArrayFS array;
+    size_t headerPos;
+    uint64_t offset;
+  };
+
+  std::string meta;
+  std::vector<Blob> blobs;
+  uint32_t views = 0;
+
+  outDebug("converting CAS Views to BSON and writing to " << segmentFile << "...");
+  rs::SceneCas::loadPendingViews(cas);
+  uima::FSIterator it = cas.getSofaIterator();
+  for(; it.isValid(); it.moveToNext())
+  {
+    uima::SofaFS sofa(it.get());
+    const std::string sofaId = sofa.getSofaID().asUTF8();
+
+    if(!storeViews[sofaId])
+    {
+      outInfo("skipping sofa \"" << sofaId << "\".");
+      continue;
+    }
+    outDebug("converting sofa \"" << sofaId << "\".");
+
+    uima::FeatureStructure fs = sofa.getLocalFSData();
+    std::vector<uima::FeatureStructure> elements;
+    ViewHeader header;
+    header.isArray = 1;
+    try
+    {
+      uima::ArrayFS array(fs);
+      elements.resize(array.size());
+      for(size_t i = 0; i < array.size(); ++i)
+      {
+        elements[i] = array.get(i);
+      }
+    }
+    catch(...)
+    {
+      header.isArray = 0;
+      elements.push_back(fs);
+    }
+
+    std::vector<mongo::BSONObj> objects(elements.size());
+    std::vector<std::pair<uint32_t, std::pair<std::string, uima::ByteArrayFS> > > viewBlobs;
+    for(size_t i = 0; i < elements.size(); ++i)
+    {
+      std::vector<std::pair<std::string, uima::ByteArrayFS> > elementBlobs;
+      objects[i] = rs::conversion::fromFeatureStructure(elements[i], mongo::OID(), FILE_BLOB_MIN_SIZE, elementBlobs);
+      for(size_t j = 0; j < elementBlobs.size(); ++j)
+      {
+        viewBlobs.push_back(std::make_pair((uint32_t)i, elementBlobs[j]));
+      }
+    }
+
+    header.nameSize = sofaId.size();
+    header.elements = elements.size();
+    header.blobs = viewBlobs.size();
+    appendPadded(meta, &header, sizeof(ViewHeader));
+    appendPadded(meta, sofaId.data(), sofaId.size());
+
+    for(size_t i = 0; i < objects.size(); ++i)
+    {
+      const uint64_t size = objects[i].objsize();
+      appendPadded(meta, &size, sizeof(uint64_t));
+      appendPadded(meta, objects[i].objdata(), size);
+    }
+
+    for(size_t i = 0; i < viewBlobs.size(); ++i)
+    {
+      const std::string &name = viewBlobs[i].second.first;
+      Blob blob;
+      blob.array = viewBlobs[i].second.second;
+      blob.headerPos = meta.size();
+
+      BlobHeader blobHeader;
+      blobHeader.element = viewBlobs[i].first;
+      blobHeader.nameSize = name.size();
+      blobHeader.size = blob.array.size();
+      blobHeader.offset = 0;
+      appendPadded(meta, &blobHeader, sizeof(BlobHeader));
+      appendPadded(meta, name.data(), name.size());
+      blobs.push_back(blob);
+    }
+    ++views;
+  }
+
+  // place the blobs behind the meta data and patch their offsets into the blob headers
+  uint64_t size = sizeof(RecordHeader) + meta.size();
+  for(size_t i = 0; i < blobs.size(); ++i)
+  {
+    Blob &blob = blobs[i];
+    blob.offset = align(size, FILE_ALIGNMENT);
+    size = blob.offset + blob.array.size();
+    memcpy(&meta[blob.headerPos + offsetof(BlobHeader, offset)], &blob.offset, sizeof(uint64_t));
+  }
+
+  RecordHeader header;
+  memcpy(header.magic, FILE_MAGIC, sizeof(header.magic));
+  header.version = FILE_VERSION;
+  header.timestamp = timestamp;
+  header.views = views;
+  header.reserved = 0;
+  header.size = size;
+
+  Record record;
+  record.offset = align(segmentSize, FILE_ALIGNMENT);
+  record.size = size;
+
+  if(!writeAll(segmentFD, (const char *)&header, sizeof(RecordHeader), record.offset)
+     || !writeAll(segmentFD, meta.data(), meta.size(), record.offset + sizeof(RecordHeader)))
+  {
+    outError("could not write scene file '" << segmentFile << "': " << strerror(errno));
+    return false;
+  }
+
+  std::vector<char> chunk;
+  for(size_t i = 0; i < blobs.size(); ++i)
+  {
+    const Blob &blob = blobs[i];
+    const size_t blobSize = blob.array.size();
+    chunk.resize(std::min<size_t>(blobSize, FILE_CHUNK_SIZE));
+    for(size_t pos = 0; pos < blobSize; pos += chunk.size())
+    {
+      const size_t count = std::min(chunk.size(), blobSize - pos);
+      blob.array.copyToArray(pos, chunk.data(), 0, count);
+      if(!writeAll(segmentFD, chunk.data(), count, record.offset + blob.offset + pos))
+      {
+        outError("could not write scene file '" << segmentFile << "': " << strerror(errno));
+        return false;
+      }
+    }
+  }
+
+  segmentSize = record.offset + record.size;
+  if(!appendIndex(timestamp, record))
+  {
+    return false;
+  }
+  records[timestamp] = record;
+  return true;
+}
+
+bool FileStorage::removeScene(const uint64_t &timestamp)
+{
+  std::map<uint64_t, Record>::iterator it = records.find(timestamp);
+  if(it == records.end())
+  {
+    return false;
+  }
+
+  // the record stays in the append-only segment, only the index forgets about it
+  Record removed;
+  removed.offset = it->second.offset;
+  removed.size = 0;
+  if(!appendIndex(timestamp, removed))
+  {
+    return false;
+  }
+  records.erase(it);
+  return true;
+}
+
+bool FileStorage::updateScene(uima::CAS &cas, const uint64_t &timestamp)
+{
+  removeScene(timestamp);
+  return storeScene(cas, timestamp);
+}
+
+bool FileStorage::loadScene(uima::CAS &cas, const uint64_t &timestamp)
+{
+  if(!isOpen())
+  {
+    outError("scene file is not open.");
+    return false;
+  }
+
+  std::map<uint64_t, Record>::const_iterator itR = records.find(timestamp);
+  if(itR == records.end())
+  {
+    readIndex();
+    itR = records.find(timestamp);
+    if(itR == records.end())
+    {
+      return false;
+    }
+  }
+  const Record &record = itR->second;
+
+  // mapping a record that the file no longer covers would fault on access
+  struct stat info;
+  if(fstat(segmentFD, &info) < 0 || record.offset + record.size > (uint64_t)info.st_size)
+  {
+    outError("scene record for timestamp " << timestamp << " lies outside of '" << segmentFile << "'.");
+    return false;
+  }
+
+  const uint64_t pageSize = sysconf(_SC_PAGESIZE);
+  const uint64_t mapOffset = record.offset / pageSize * pageSize;
+  const size_t mapSize = record.offset - mapOffset + record.size;
+  void *mapping = mmap(NULL, mapSize, PROT_READ, MAP_PRIVATE, segmentFD, mapOffset);
+  if(mapping == MAP_FAILED)
+  {
+    outError("could not map scene file '" << segmentFile << "': " << strerror(errno));
+    return false;
+  }
+  const char *data = (const char *)mapping + (record.offset - mapOffset);
+
+  // the whole record is checked before any of it goes into the CAS
+  const RecordHeader &header = *(const RecordHeader *)data;
+  RecordReader reader(data + sizeof(RecordHeader), data + record.size);
+  std::vector<RecordView> views;
+  bool valid = memcmp(header.magic, FILE_MAGIC, sizeof(header.magic)) == 0 && header.version == FILE_VERSION
+               && header.timestamp == timestamp && header.size == record.size && header.views <= reader.remaining() / sizeof(ViewHeader);
+  if(valid)
+  {
+    views.resize(header.views);
+    for(uint32_t v = 0; v < header.views && valid; ++v)
+    {
+      valid = readView(reader, record.size, views[v]);
+    }
+  }
+  if(!valid)
+  {
+    outError("invalid scene record for timestamp " << timestamp << " in '" << segmentFile << "'.");
+    munmap(mapping, mapSize);
+    return false;
+  }
+
+  const bool loadAll = loadViews.empty();
+  for(size_t v = 0; v < views.size(); ++v)
+  {
+    const RecordView &recordView = views[v];
+    const std::string &viewName = recordView.name;
+    if(!loadAll && !loadViews[viewName])
+    {
+      continue;
+    }
+    outDebug("loading view: " << viewName);
+
+    uima::CAS *view = nullptr;
+    try
+    {
+      view = cas.getView(UnicodeString::fromUTF8(viewName));
+    }
+    catch(...)
+    {
+      view = cas.createView(UnicodeString::fromUTF8(viewName));
+    }
+
+    std::vector<uima::FeatureStructure> elements(recordView.objects.size());
+    for(size_t i = 0; i < recordView.objects.size(); ++i)
+    {
+      elements[i] = rs::conversion::toFeatureStructure(*view, recordView.objects[i]);
+    }
+
+    for(size_t i = 0; i < recordView.blobHeaders.size(); ++i)
+    {
+      const BlobHeader &blobHeader = *recordView.blobHeaders[i];
+      uima::FeatureStructure &fs = elements[blobHeader.element];
+      uima::ByteArrayFS arrayFS = view->createByteArrayFS(blobHeader.size);
+      arrayFS.copyFromArray(data + blobHeader.offset, 0, blobHeader.size, 0);
+      fs.setFSValue(rs::getFeature(fs, recordView.blobNames[i].c_str()), arrayFS);
+    }
+
+    uima::FeatureStructure fs;
+    if(recordView.isArray)
+    {
+      uima::ArrayFS array = view->createArrayFS(elements.size());
+      for(size_t i = 0; i < elements.size(); ++i)
+      {
+        array.set(i, elements[i]);
+      }
+      fs = array;
+    }
+    else if(!elements.empty())
+    {
+      fs = elements[0];
+    }
+
+    const std::string mime = "application/x-" + viewName;
+    view->setSofaDataArray(fs, UnicodeString::fromUTF8(mime));
+  }
+
+  munmap(mapping, mapSize);
+  return true;
+}
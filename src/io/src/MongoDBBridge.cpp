@@ -26,17 +26,25 @@
 #include <sys/stat.h>
 #include <thread>
 
-MongoDBBridge::MongoDBBridge(const boost::property_tree::ptree &pt) : CamInterface(pt)
+MongoDBBridge::MongoDBBridge(const boost::property_tree::ptree &pt) : CamInterface(pt), prefetch(0), prefetchRunning(false), prefetchFinished(false)
 {
   readConfig(pt);
 
   outInfo("initialize");
 
-  storage = rs::Storage(host, db);
+  if(file.empty())
+  {
+    storage = rs::Storage(host, db);
+    storage.enableLazyLoading(lazyLoading);
+  }
+  else if(!fileStorage.open(file))
+  {
+    throw_exception_message("could not open scene file " + file);
+  }
 
   actualFrame = 0;
 
-  storage.getScenes(frames);
+  getScenes(frames);
 
   if(continual)
   {
@@ -52,11 +60,47 @@ MongoDBBridge::MongoDBBridge(const boost::property_tree::ptree &pt) : CamInterfa
     outInfo("found " << frames.size() << " frames in database.");
     lastTimestamp = 0x7FFFFFFFFFFFFFFF;
   }
-  _newData = true;
+
+  if(prefetch > 0 && !file.empty())
+  {
+    outWarn("prefetching is only supported for MongoDB, scene files are mapped directly.");
+    prefetch = 0;
+  }
+  if(prefetch > 0)
+  {
+    prefetchStorage = rs::Storage(host, db, false, false);
+    prefetchRunning = true;
+    prefetchThread = std::thread(&MongoDBBridge::prefetchWorker, this, actualFrame, frames);
+  }
+  setNewData(true);
 }
 
 MongoDBBridge::~MongoDBBridge()
 {
+  if(prefetchThread.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> guard(prefetchLock);
+      prefetchRunning = false;
+      prefetchCV.notify_all();
+    }
+    prefetchThread.join();
+  }
+
+  if(!lazyLoading || !file.empty())
+  {
+    return;
+  }
+
+  std::map<std::string, rs::SceneCas::ViewStats> stats;
+  rs::SceneCas::getViewStats(stats);
+  outInfo("view usage during playback:");
+  for(std::map<std::string, rs::SceneCas::ViewStats>::const_iterator it = stats.begin(); it != stats.end(); ++it)
+  {
+    const rs::SceneCas::ViewStats &s = it->second;
+    outInfo("  " << it->first << ": read in " << s.loaded << " of " << s.registered << " frames, "
+            << (s.loaded ? s.loadTime / s.loaded : 0.0) << " ms per load");
+  }
 }
 
 void MongoDBBridge::readConfig(const boost::property_tree::ptree &pt)
@@ -67,9 +111,21 @@ void MongoDBBridge::readConfig(const boost::property_tree::ptree &pt)
   continual = pt.get<bool>("mongodb.continual");
   loop = pt.get<bool>("mongodb.loop");
   playbackSpeed = pt.get<double>("mongodb.playbackSpeed", 0.0);
+  file = pt.get<std::string>("mongodb.file", "");
+  lazyLoading = pt.get<bool>("mongodb.lazyLoading", false);
+  prefetch = pt.get<size_t>("mongodb.prefetch", 0);
 
-  outInfo("DB host:   " FG_BLUE << host);
-  outInfo("DB name:   " FG_BLUE << db);
+  if(file.empty())
+  {
+    outInfo("DB host:   " FG_BLUE << host);
+    outInfo("DB name:   " FG_BLUE << db);
+    outInfo("lazy:      " FG_BLUE << (lazyLoading ? "ON" : "OFF"));
+    outInfo("prefetch:  " FG_BLUE << prefetch);
+  }
+  else
+  {
+    outInfo("file:      " FG_BLUE << file);
+  }
   outInfo("continual: " FG_BLUE << (continual ? "ON" : "OFF"));
   outInfo("looping:   " FG_BLUE << (loop ? "ON" : "OFF"));
 
@@ -83,16 +139,178 @@ void MongoDBBridge::readConfig(const boost::property_tree::ptree &pt)
   }
 }
 
+void MongoDBBridge::getScenes(std::vector<uint64_t> &timestamps)
+{
+  if(file.empty())
+  {
+    storage.getScenes(timestamps);
+  }
+  else
+  {
+    fileStorage.getScenes(timestamps);
+  }
+}
+
+void MongoDBBridge::getNewScenes(std::vector<uint64_t> &timestamps)
+{
+  if(file.empty())
+  {
+    storage.getNewScenes(timestamps);
+  }
+  else
+  {
+    fileStorage.getNewScenes(timestamps);
+  }
+}
+
+bool MongoDBBridge::loadScene(uima::CAS &cas, const uint64_t timestamp)
+{
+  if(file.empty())
+  {
+    return storage.loadScene(cas, timestamp);
+  }
+  return fileStorage.loadScene(cas, timestamp);
+}
+
+void MongoDBBridge::prefetchWorker(size_t index, std::vector<uint64_t> timestamps)
+{
+  std::unique_lock<std::mutex> guard(prefetchLock);
+  while(prefetchRunning)
+  {
+    if(prefetched.size() >= prefetch)
+    {
+      prefetchCV.wait(guard);
+      continue;
+    }
+    guard.unlock();
+
+    // same order of frames as setData without prefetching
+    if(index >= timestamps.size())
+    {
+      if(continual)
+      {
+        prefetchStorage.getNewScenes(timestamps);
+        if(index >= timestamps.size())
+        {
+          guard.lock();
+          prefetchCV.wait_for(guard, std::chrono::milliseconds(100));
+          continue;
+        }
+      }
+      else if(loop)
+      {
+        index = 0;
+      }
+      else
+      {
+        guard.lock();
+        prefetchFinished = true;
+        prefetchCV.notify_all();
+        return;
+      }
+    }
+
+    PrefetchedScene scene;
+    scene.index = index;
+    scene.found = prefetchStorage.fetchScene(timestamps[index], scene.data);
+    ++index;
+
+    guard.lock();
+    prefetched.push_back(scene);
+    prefetchCV.notify_all();
+  }
+}
+
+bool MongoDBBridge::setPrefetchedData(uima::CAS &tcas)
+{
+  PrefetchedScene scene;
+  {
+    std::unique_lock<std::mutex> guard(prefetchLock);
+    while(prefetched.empty() && !prefetchFinished)
+    {
+      // in continual mode there might be no new scene for a long time
+      if(prefetchCV.wait_for(guard, std::chrono::milliseconds(100)) == std::cv_status::timeout && continual)
+      {
+        return false;
+      }
+    }
+    if(!prefetched.empty())
+    {
+      scene = std::move(prefetched.front());
+      prefetched.pop_front();
+      prefetchCV.notify_all();
+    }
+    else
+    {
+      guard.unlock();
+      outInfo("last frame. shuting down.");
+      cv::waitKey();
+      ros::shutdown();
+      return false;
+    }
+  }
+
+  actualFrame = scene.index;
+  outInfo("setting data from frame: " << actualFrame << " (" << scene.data.timestamp << ")");
+  if(!scene.found)
+  {
+    outInfo("No frame with that timestamp");
+    ++actualFrame;
+    return false;
+  }
+  storage.loadScene(*tcas.getBaseCas(), scene.data);
+
+  if(playbackSpeed > 0.0)
+  {
+    waitForPlayback(scene.data.timestamp);
+  }
+
+  ++actualFrame;
+  if(!continual && !loop && actualFrame == frames.size())
+  {
+    setNewData(false);
+  }
+  return true;
+}
+
+void MongoDBBridge::waitForPlayback(const uint64_t timestamp)
+{
+  if(lastTimestamp > timestamp)
+  {
+    lastTimestamp = timestamp;
+    simTimeLast = timestamp;
+    lastRun = ros::Time::now().toNSec();
+  }
+
+  uint64_t now = ros::Time::now().toNSec();
+  uint64_t simTime = (uint64_t)((now - lastRun) * playbackSpeed) + simTimeLast;
+  if(simTime <= timestamp)
+  {
+    uint64_t sleepTime = (timestamp - simTime) / playbackSpeed;
+    outDebug("waiting for " << sleepTime / 1000000.0 << " ms.");
+    std::this_thread::sleep_for(std::chrono::nanoseconds(sleepTime));
+  }
+
+  now = ros::Time::now().toNSec();
+  simTimeLast = (uint64_t)((now - lastRun) * playbackSpeed) + simTimeLast;
+  lastRun = now;
+}
+
 bool MongoDBBridge::setData(uima::CAS &tcas, uint64_t timestamp)
 {
   MEASURE_TIME;
   const bool isNextFrame = timestamp == std::numeric_limits<uint64_t>::max();
 
+  if(prefetch > 0 && isNextFrame)
+  {
+    return setPrefetchedData(tcas);
+  }
+
   if(actualFrame >= frames.size())
   {
     if(continual)
     {
-      storage.getScenes(frames);
+      getNewScenes(frames);
       if(actualFrame >= frames.size())
       {
         return false;
@@ -122,7 +340,7 @@ bool MongoDBBridge::setData(uima::CAS &tcas, uint64_t timestamp)
     outInfo("setting data from frame with timestamp: (" << timestamp << ")");
   }
 
-  if(!storage.loadScene(*tcas.getBaseCas(), timestamp))
+  if(!loadScene(*tcas.getBaseCas(), timestamp))
   {
     if(timestamp == 0)
     {
@@ -140,32 +358,14 @@ bool MongoDBBridge::setData(uima::CAS &tcas, uint64_t timestamp)
 
   if(playbackSpeed > 0.0 && isNextFrame)
   {
-    if(lastTimestamp > timestamp)
-    {
-      lastTimestamp = timestamp;
-      simTimeLast = frames[actualFrame];
-      lastRun = ros::Time::now().toNSec();
-    }
-
-    uint64_t now = ros::Time::now().toNSec();
-    uint64_t simTime = (uint64_t)((now - lastRun) * playbackSpeed) + simTimeLast;
-    if(simTime <= timestamp)
-    {
-      uint64_t sleepTime = (timestamp - simTime) / playbackSpeed;
-      outDebug("waiting for " << sleepTime / 1000000.0 << " ms.");
-      std::this_thread::sleep_for(std::chrono::nanoseconds(sleepTime));
-    }
-
-    now = ros::Time::now().toNSec();
-    simTimeLast = (uint64_t)((now - lastRun) * playbackSpeed) + simTimeLast;
-    lastRun = now;
+    waitForPlayback(timestamp);
   }
 
 
   ++actualFrame;
   if(!continual && !loop && actualFrame == frames.size())
   {
-    _newData = false;
+    setNewData(false);
   }
   return true;
 }
@@ -83,6 +83,11 @@ bool ROSCamInterface::lookupTransform(const ros::Time &timestamp)
 }
 
 void ROSCamInterface::setTransformAndTime(uima::CAS &tcas)
+{
+  setTransformAndTime(tcas, transform, timestamp);
+}
+
+void ROSCamInterface::setTransformAndTime(uima::CAS &tcas, const tf::StampedTransform &transform, const ros::Time &timestamp)
 {
   rs::Scene scene = rs::SceneCas(tcas).getScene();
   if(lookUpViewpoint)
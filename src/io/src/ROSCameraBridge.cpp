@@ -82,7 +82,7 @@ void ROSCameraBridge::cb_(const sensor_msgs::Image::ConstPtr rgb_img_msg,
   if(!lookupTransform(cameraInfo.header.stamp))
   {
     lock.lock();
-    _newData = false;
+    setNewData(false);
     lock.unlock();
     return;
   }
@@ -90,7 +90,7 @@ void ROSCameraBridge::cb_(const sensor_msgs::Image::ConstPtr rgb_img_msg,
   if(filterBlurredImages && detector.detectBlur(orig_rgb_img->image))
   {
     lock.lock();
-    _newData = false;
+    setNewData(false);
     lock.unlock();
     outWarn("Skipping blurred image!");
     return;
@@ -101,7 +101,7 @@ void ROSCameraBridge::cb_(const sensor_msgs::Image::ConstPtr rgb_img_msg,
   lock.lock();
   this->color = color;
   this->cameraInfo = cameraInfo;
-  _newData = true;
+  setNewData(true, cameraInfo.header.stamp.toNSec());
   lock.unlock();
 }
 
@@ -119,7 +119,7 @@ bool ROSCameraBridge::setData(uima::CAS &tcas, uint64_t ts)
   lock.lock();
   color = this->color;
   cameraInfo = this->cameraInfo;
-  _newData = false;
+  setNewData(false);
   lock.unlock();
 
   rs::SceneCas cas(tcas);
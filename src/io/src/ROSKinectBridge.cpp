@@ -30,7 +30,7 @@
 //OpenCV
 #include <cv_bridge/cv_bridge.h>
 
-ROSKinectBridge::ROSKinectBridge(const boost::property_tree::ptree &pt) : ROSCamInterface(pt), it(nodeHandle)
+ROSKinectBridge::ROSKinectBridge(const boost::property_tree::ptree &pt) : ROSCamInterface(pt), it(nodeHandle), bufferSize(1)
 {
   readConfig(pt);
   initSpinner();
@@ -62,6 +62,7 @@ void ROSKinectBridge::readConfig(const boost::property_tree::ptree &pt)
   filterBlurredImages = pt.get<bool>("camera.filterBlurredImages", false);
   depthOffset = pt.get<int>("camera.depthOffset", 0);
   scale = pt.get<bool>("camera.scale", true);
+  bufferSize = std::max(pt.get<int>("camera.bufferSize", 1), 1);
 
   image_transport::TransportHints hintsColor(color_hints);
   image_transport::TransportHints hintsDepth(depth_hints);
@@ -78,6 +79,7 @@ void ROSKinectBridge::readConfig(const boost::property_tree::ptree &pt)
   outInfo("  DepthOffset: " FG_BLUE << depthOffset);
   outInfo("  Blur filter: " FG_BLUE << (filterBlurredImages ? "ON" : "OFF"));
   outInfo("  Scale Input: " FG_BLUE << (scale ? "ON" : "OFF"));
+  outInfo("  Buffer Size: " FG_BLUE << bufferSize);
 }
 
 void ROSKinectBridge::cb_(const sensor_msgs::Image::ConstPtr rgb_img_msg,
@@ -86,9 +88,10 @@ void ROSKinectBridge::cb_(const sensor_msgs::Image::ConstPtr rgb_img_msg,
 {
   //  static int frame = 0;
   //  outWarn("got image: " << frame++);
-  cv::Mat color, depth;
+  Frame frame;
+  cv::Mat &color = frame.color, &depth = frame.depth;
   //  bool isHDColor;
-  sensor_msgs::CameraInfo cameraInfo, cameraInfoHD;
+  sensor_msgs::CameraInfo &cameraInfo = frame.cameraInfo, &cameraInfoHD = frame.cameraInfoHD;
 
   cv_bridge::CvImageConstPtr orig_rgb_img;
   orig_rgb_img = cv_bridge::toCvShare(rgb_img_msg, sensor_msgs::image_encodings::BGR8);
@@ -97,7 +100,7 @@ void ROSKinectBridge::cb_(const sensor_msgs::Image::ConstPtr rgb_img_msg,
   if(!lookupTransform(cameraInfo.header.stamp))
   {
     lock.lock();
-    _newData = false;
+    setNewData(false);
     lock.unlock();
     return;
   }
@@ -105,17 +108,21 @@ void ROSKinectBridge::cb_(const sensor_msgs::Image::ConstPtr rgb_img_msg,
   if(filterBlurredImages && detector.detectBlur(orig_rgb_img->image))
   {
     lock.lock();
-    _newData = false;
+    setNewData(false);
     lock.unlock();
     outWarn("Skipping blurred image!");
     return;
   }
+  frame.transform = transform;
+
   cv_bridge::CvImageConstPtr orig_depth_img;
   orig_depth_img = cv_bridge::toCvShare(depth_img_msg, depth_img_msg->encoding);
 
   if(depth_img_msg->encoding == sensor_msgs::image_encodings::TYPE_16UC1)
   {
-    depth = orig_depth_img->image.clone();
+    // no copy, the data is owned by the message kept alive by the frame
+    depth = orig_depth_img->image;
+    frame.depthMsg = orig_depth_img;
   }
   else if(depth_img_msg->encoding == sensor_msgs::image_encodings::TYPE_32FC1)
   {
@@ -127,7 +134,8 @@ void ROSKinectBridge::cb_(const sensor_msgs::Image::ConstPtr rgb_img_msg,
     return;
   }
 
-  color = orig_rgb_img->image.clone();
+  color = orig_rgb_img->image;
+  frame.colorMsg = orig_rgb_img;
   if(scale)
   {
     if(color.cols == 1280 || color.cols == 1920) // HD or Kinect 2
@@ -203,14 +211,12 @@ void ROSKinectBridge::cb_(const sensor_msgs::Image::ConstPtr rgb_img_msg,
 
   lock.lock();
 
-  this->color = color;
-  this->depth = depth;
-  this->cameraInfo = cameraInfo;
-  if(scale)
+  frames.push_back(frame);
+  while(frames.size() > bufferSize)
   {
-    this->cameraInfoHD = cameraInfoHD;
+    frames.pop_front();
   }
-  _newData = true;
+  setNewData(true, cameraInfo.header.stamp.toNSec());
   //  outWarn("new data");
 
   lock.unlock();
@@ -224,22 +230,16 @@ bool ROSKinectBridge::setData(uima::CAS &tcas, uint64_t ts)
   }
   MEASURE_TIME;
 
-  cv::Mat color, depth;
-  sensor_msgs::CameraInfo cameraInfo, cameraInfoHD;
-
   lock.lock();
-  color = this->color;
-  depth = this->depth;
-  cameraInfo = this->cameraInfo;
-  if(scale)
-  {
-    cameraInfoHD = this->cameraInfoHD;
-  }
-  _newData = false;
+  const Frame frame = findFrame(ts);
+  setNewData(false);
   lock.unlock();
 
+  const cv::Mat &color = frame.color, &depth = frame.depth;
+  const sensor_msgs::CameraInfo &cameraInfo = frame.cameraInfo, &cameraInfoHD = frame.cameraInfoHD;
+
   rs::SceneCas cas(tcas);
-  setTransformAndTime(tcas);
+  setTransformAndTime(tcas, frame.transform, cameraInfo.header.stamp);
 
   if(scale && color.cols >= 1280)
   {
@@ -264,3 +264,26 @@ bool ROSKinectBridge::setData(uima::CAS &tcas, uint64_t ts)
 
   return true;
 }
+
+const ROSKinectBridge::Frame &ROSKinectBridge::findFrame(const uint64_t ts) const
+{
+  if(ts == 0 || ts == std::numeric_limits<uint64_t>::max())
+  {
+    return frames.back();
+  }
+
+  size_t best = frames.size() - 1;
+  uint64_t bestDiff = std::numeric_limits<uint64_t>::max();
+  for(size_t i = 0; i < frames.size(); ++i)
+  {
+    const uint64_t stamp = frames[i].cameraInfo.header.stamp.toNSec();
+    const uint64_t diff = stamp > ts ? stamp - ts : ts - stamp;
+    if(diff < bestDiff)
+    {
+      best = i;
+      bestDiff = diff;
+    }
+  }
+  outDebug("frame for " << ts << " is " << bestDiff / 1000000.0 << " ms off.");
+  return frames[best];
+}
@@ -119,7 +119,7 @@ void ROSTangoBridge::cb_(const sensor_msgs::Image::ConstPtr color_img_msg,
     if(!lookupTransform(colorCameraInfo.header.stamp))
     {
       lock.lock();
-      _newData = false;
+      setNewData(false);
       lock.unlock();
       return;
     }
@@ -127,7 +127,7 @@ void ROSTangoBridge::cb_(const sensor_msgs::Image::ConstPtr color_img_msg,
     if(filterBlurredImages && detector.detectBlur(orig_color_img->image))
     {
       lock.lock();
-      _newData = false;
+      setNewData(false);
       lock.unlock();
       outWarn("Skipping blurred image!");
       return;
@@ -196,7 +196,7 @@ void ROSTangoBridge::cb_(const sensor_msgs::Image::ConstPtr color_img_msg,
     this->color = color;
     this->colorCameraInfo = colorCameraInfo;
     this->cloud_color = cloud_color;
-    _newData = true;
+    setNewData(true, colorCameraInfo.header.stamp.toNSec());
     lock.unlock();
 }
 
@@ -212,7 +212,7 @@ fisheyeCameraInfo = sensor_msgs::CameraInfo(*fisheye_info_msg);
 if(!lookupTransform(fisheyeCameraInfo.header.stamp))
 {
   lock.lock();
-  _newData = false;
+  setNewData(false);
   lock.unlock();
   return;
 }
@@ -220,7 +220,7 @@ if(!lookupTransform(fisheyeCameraInfo.header.stamp))
 if(filterBlurredImages && detector.detectBlur(orig_fisheye_img->image))
 {
   lock.lock();
-  _newData = false;
+  setNewData(false);
   lock.unlock();
   outWarn("Skipping blurred image!");
   return;
@@ -230,7 +230,7 @@ fisheye = orig_fisheye_img->image.clone();
 lock.lock();
 this->fisheye = fisheye;
 this->fisheyeCameraInfo = fisheyeCameraInfo;
-_newData = true;
+setNewData(true, fisheyeCameraInfo.header.stamp.toNSec());
 lock.unlock();
 }
 
@@ -260,7 +260,7 @@ bool ROSTangoBridge::setData(uima::CAS &tcas, uint64_t ts)
   outInfo("  Cloud Width: " FG_BLUE << cloud_color.width);
   outInfo("  Cloud Height: " FG_BLUE << cloud_color.height);
   outInfo("  Number of Point Cloud: " FG_BLUE << cloud_color.size());
-  _newData = false;
+  setNewData(false);
   lock.unlock();
 
   rs::SceneCas cas(tcas);
@@ -99,7 +99,7 @@ void ROSThermalCamBridge::cb_(const sensor_msgs::Image::ConstPtr thermal_img_msg
   if(!lookupTransform(cameraInfo.header.stamp))
   {
     lock.lock();
-    _newData = false;
+    setNewData(false);
     lock.unlock();
     return;
   }
@@ -151,7 +151,7 @@ void ROSThermalCamBridge::cb_(const sensor_msgs::Image::ConstPtr thermal_img_msg
   this->cameraInfo = cameraInfo;
   this->thermalRGBImage = thermalRGBImage;
   this->thermalDepthImage = thermalDepthImage;
-  _newData = true;
+  setNewData(true, cameraInfo.header.stamp.toNSec());
   lock.unlock();
 }
 
@@ -190,7 +190,7 @@ bool ROSThermalCamBridge::setData(uima::CAS &tcas, uint64_t ts)
   thermalImage = this->thermalImage;
   thermalRGBImage = this->thermalRGBImage;
   thermalDepthImage = this->thermalDepthImage;
-  _newData = false;
+  setNewData(false);
   lock.unlock();
 
   rs::SceneCas cas(tcas);
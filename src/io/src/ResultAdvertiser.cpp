@@ -25,7 +25,7 @@
 #include <rs/scene_cas.h>
 #include <rs/utils/time.h>
 
-#include <rs/conversion/bson.h>
+#include <rs/conversion/json.h>
 
 //#undef OUT_LEVEL
 //#define OUT_LEVEL OUT_LEVEL_DEBUG
@@ -40,6 +40,8 @@ private:
   ros::NodeHandle nh_;
   ros::Publisher resPub;
 
+  rs::conversion::JsonWriter writer;
+
 public:
   ResultAdvertiser() : nh_("~")
   {
@@ -49,6 +51,34 @@ public:
   TyErrorId initialize(AnnotatorContext &ctx)
   {
     outInfo("initialize");
+    std::vector<std::string *> deniedFields, allowedFields;
+    if(ctx.isParameterDefined("deniedFields"))
+    {
+      ctx.extractValue("deniedFields", deniedFields);
+    }
+    if(ctx.isParameterDefined("allowedFields"))
+    {
+      ctx.extractValue("allowedFields", allowedFields);
+    }
+
+    // fields that just pollute the resulting json, they are never read from the CAS
+    std::vector<std::string> fields;
+    if(!allowedFields.empty())
+    {
+      for(size_t i = 0; i < allowedFields.size(); ++i)
+      {
+        fields.push_back(*allowedFields[i]);
+      }
+      writer.setAllowedFields(fields);
+    }
+    else
+    {
+      for(size_t i = 0; i < deniedFields.size(); ++i)
+      {
+        fields.push_back(*deniedFields[i]);
+      }
+      writer.setDeniedFields(fields);
+    }
     return UIMA_ERR_NONE;
   }
 
@@ -67,48 +97,38 @@ public:
     std::vector<rs::Cluster> clusters;
     scene.identifiables.filter(clusters);
 
-    std::stringstream ss;
-    ss<<"{\"results\" : [";
-    int idx=0;
-    for (auto annotation: scene.annotations())
+    writer.clear();
+    std::string &json = writer.buffer;
+    json += "{\"results\" : [";
+    int idx = 0;
+    for(auto annotation : scene.annotations())
     {
-      ss<<(idx==0?"{\"scene_properties\" : [":"");
-      mongo::BSONObj bson;
-      rs::conversion::from(annotation, bson);
-      //fields that just polute the resulting json. if reaally needed comment them out
-      //TODO: recursive function to delete _od and _parent ->fields come from mongo and are not needed here
-      bson = bson.removeField(mongo::StringData("inliers"));
-      bson = bson.removeField(mongo::StringData("mask"));
-      bson = bson.removeField(mongo::StringData("indices"));
-      bson = bson.removeField(mongo::StringData("_id"));
-      bson = bson.removeField(mongo::StringData("_parent"));
-      ss << bson.jsonString(mongo::JsonStringFormat::Strict,1) << (idx++ < scene.annotations.size() - 1 ? "," : "");
+      json += idx == 0 ? "{\"scene_properties\" : [" : ",";
+      writer.write(annotation);
+      ++idx;
     }
-    ss<<(idx!=0 ? "]},":"");
+    json += idx != 0 ? "]}," : "";
 
     int i = 0;
     for(auto c : clusters)
     {
-      ss << (i==0?"{\"object_hypotheses:\": [":"");
-      ss << "{\"cluster\" : " << i << "," << std::endl << "\"annotations\" : [";
+      json += i == 0 ? "{\"object_hypotheses:\": [" : ",";
+      json += "{\"cluster\" : " + std::to_string(i) + ",\n\"annotations\" : [";
       rs::Cluster &cluster = c;
       int annotidx = 0;
       for(auto annotation : cluster.annotations())
       {
-        mongo::BSONObj bson;
-        rs::conversion::from(annotation, bson);
-        bson = bson.removeField(mongo::StringData("_id"));
-        bson = bson.removeField(mongo::StringData("_parent"));
-        ss << bson.jsonString(mongo::JsonStringFormat::Strict,1) << (annotidx++ < cluster.annotations.size() - 1 ? "," : "");
+        json += annotidx++ == 0 ? "" : ",";
+        writer.write(annotation);
       }
-      ss << "]}" << (i++ < clusters.size() - 1 ? "," : ""); //end of annotations
+      json += "]}"; //end of annotations
+      ++i;
     }
-    ss<<(i!=0? "]}":"");
-    ss<<"]}";
-
+    json += i != 0 ? "]}" : "";
+    json += "]}";
 
     std_msgs::String msg;
-    msg.data = ss.str();
+    msg.data = json;
     resPub.publish(msg);
     return UIMA_ERR_NONE;
   }
@@ -21,9 +21,21 @@
 #include <dirent.h>
 #include <sys/stat.h>
 
+// STL
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
 // UNICODE STRING
 #include <unicode/unistr.h>
 
+// OPENSSL
+#include <openssl/sha.h>
+
 // RS
 #include <rs/scene_cas.h>
 #include <rs/utils/output.h>
@@ -41,22 +53,28 @@ using namespace rs;
 #define DB_CAS      "cas"
 #define DB_SCRIPTS  "system.js"
 #define DB_CAS_TIME "_timestamp"
+#define DB_REFS     "_refs"
+#define DB_BLOBS    "blobs"
+#define BLOB_REFS   "_blobs"
+#define BLOB_CHUNK  (1 << 20)   // size of the chunks of large byte arrays
+#define FETCH_CONNECTIONS 4     // connections opened at most for fetching views in parallel
+#define INSERT_SIZE (16 << 20)  // documents are inserted in messages of about this size
 #define SCRIPT_EXT  ".js"
 
 /******************************************************************************
  * Storage
  *****************************************************************************/
 
-Storage::Storage() : dbHost(DB_HOST), dbName(DB_NAME), dbBase(dbName + "."), dbCAS(dbBase + DB_CAS), dbScripts(dbBase + DB_SCRIPTS), first(true)
+Storage::Storage() : openFetchConnections(0), fetchStopping(false), dbHost(DB_HOST), dbName(DB_NAME), dbBase(dbName + "."), dbCAS(dbBase + DB_CAS), dbScripts(dbBase + DB_SCRIPTS), dbBlobs(dbBase + DB_BLOBS), lazyLoading(false), blobThreshold(0)
 {
 }
 
-Storage::Storage(const Storage &other)
+Storage::Storage(const Storage &other) : openFetchConnections(0), fetchStopping(false)
 {
   this->operator =(other);
 }
 
-Storage::Storage(const std::string &dbHost, const std::string &dbName, const bool clear, const bool setupScripts) : dbHost(dbHost), dbName(dbName), dbBase(dbName + "."), dbCAS(dbBase + DB_CAS), dbScripts(dbBase + DB_SCRIPTS)
+Storage::Storage(const std::string &dbHost, const std::string &dbName, const bool clear, const bool setupScripts) : openFetchConnections(0), fetchStopping(false), dbHost(dbHost), dbName(dbName), dbBase(dbName + "."), dbCAS(dbBase + DB_CAS), dbScripts(dbBase + DB_SCRIPTS), dbBlobs(dbBase + DB_BLOBS), lazyLoading(false), blobThreshold(0)
 {
   db.connect(dbHost);
 
@@ -79,10 +97,25 @@ Storage::Storage(const std::string &dbHost, const std::string &dbName, const boo
       }
     }
   }
+
+  // scenes are looked up and enumerated by timestamp
+  db.createIndex(dbCAS, BSON(DB_CAS_TIME << 1));
+  // chunks are read per blob in order and removed per scene
+  db.createIndex(dbBlobs, BSON("blob" << 1 << "n" << 1));
+  db.createIndex(dbBlobs, BSON("_parent" << 1));
 }
 
 Storage::~Storage()
 {
+  {
+    std::lock_guard<std::mutex> lock(fetchLock);
+    fetchStopping = true;
+  }
+  fetchQueued.notify_all();
+  for(size_t w = 0; w < fetchWorkers.size(); ++w)
+  {
+    fetchWorkers[w].join();
+  }
 }
 
 Storage &Storage::operator=(const Storage &other)
@@ -92,8 +125,12 @@ Storage &Storage::operator=(const Storage &other)
   dbBase = other.dbBase;
   dbCAS = other.dbCAS;
   dbScripts = other.dbScripts;
+  dbBlobs = other.dbBlobs;
   storeViews = other.storeViews;
   loadViews = other.loadViews;
+  dedupViews = other.dedupViews;
+  lazyLoading = other.lazyLoading;
+  blobThreshold = other.blobThreshold;
   db.connect(dbHost);
   return *this;
 }
@@ -149,7 +186,7 @@ void Storage::setupDBScripts()
   }
 }
 
-bool Storage::readArrayFS(uima::FeatureStructure fs, mongo::BSONObjBuilder &builderCAS, const mongo::OID &casOID, const std::string &sofaId, const std::string &dbCollection)
+bool Storage::readArrayFS(uima::FeatureStructure fs, mongo::BSONObjBuilder &builderCAS, const mongo::OID &casOID, const std::string &sofaId, const std::string &dbCollection, WriteBatch &batch)
 {
   uima::ArrayFS array;
   try
@@ -161,63 +198,259 @@ bool Storage::readArrayFS(uima::FeatureStructure fs, mongo::BSONObjBuilder &buil
     return false;
   }
 
-  std::vector<mongo::BSONObj> objects(array.size());
   std::vector<mongo::OID> objectIds(array.size());
 
   for(size_t i = 0; i < array.size(); ++i)
   {
-    mongo::BSONObj object = rs::conversion::fromFeatureStructure(array.get(i), casOID);
-    objects[i] = object;
-
-    mongo::BSONElement elem;
-    object.getObjectID(elem);
-    objectIds[i] = elem.OID();
+    objectIds[i] = convertDocument(array.get(i), casOID, sofaId, dbCollection, batch);
   }
   builderCAS.append(sofaId, objectIds);
+  return true;
+}
 
-  outDebug("storing sofas to " << dbCollection << ".");
-  db.insert(dbCollection, objects);
+bool Storage::readFS(uima::FeatureStructure fs, mongo::BSONObjBuilder &builderCAS, const mongo::OID &casOID, const std::string &sofaId, const std::string &dbCollection, WriteBatch &batch)
+{
+  builderCAS.append(sofaId, convertDocument(fs, casOID, sofaId, dbCollection, batch));
   return true;
 }
 
-bool Storage::readFS(uima::FeatureStructure fs, mongo::BSONObjBuilder &builderCAS, const mongo::OID &casOID, const std::string &sofaId, const std::string &dbCollection)
+mongo::OID Storage::convertDocument(const uima::FeatureStructure &fs, const mongo::OID &casOID, const std::string &sofaId, const std::string &dbCollection, WriteBatch &batch)
+{
+  // deduplicated documents are identified by their content, collections are replaced as a whole
+  const bool cleared = std::find(batch.clear.begin(), batch.clear.end(), dbCollection) != batch.clear.end();
+  if(!blobThreshold || dedupViews[sofaId] || cleared)
+  {
+    return addDocument(rs::conversion::fromFeatureStructure(fs, casOID), sofaId, dbCollection, batch);
+  }
+
+  std::vector<std::pair<std::string, uima::ByteArrayFS> > blobs;
+  const mongo::BSONObj object = rs::conversion::fromFeatureStructure(fs, casOID, blobThreshold, blobs);
+  if(blobs.empty())
+  {
+    return addDocument(object, sofaId, dbCollection, batch);
+  }
+
+  mongo::BSONObjBuilder builder;
+  builder.appendElements(object);
+  mongo::BSONArrayBuilder refs(builder.subarrayStart(BLOB_REFS));
+
+  // the CAS is reused once the batch is converted, so the arrays are copied out as they are, the
+  // chunk documents are only built by writeBatch
+  for(size_t i = 0; i < blobs.size(); ++i)
+  {
+    const uima::ByteArrayFS &array = blobs[i].second;
+    const size_t size = array.size();
+    batch.blobs.push_back(WriteBatch::Blob());
+    WriteBatch::Blob &blob = batch.blobs.back();
+    blob.parent = casOID;
+    blob.id = mongo::OID::gen();
+    blob.bytes.resize(size);
+    array.copyToArray(0, blob.bytes.data(), 0, size);
+    refs.append(BSON("feature" << blobs[i].first << "id" << blob.id << "size" << (long long)size));
+  }
+  refs.done();
+  return addDocument(builder.obj(), sofaId, dbCollection, batch);
+}
+
+/**
+ * Hashes the content of a document. The ids and parents are generated for every conversion, so
+ * they are left out.
+ */
+static void hashDocument(const mongo::BSONObj &object, SHA256_CTX &context)
 {
-  mongo::BSONObj object = rs::conversion::fromFeatureStructure(fs, casOID);
+  mongo::BSONObjIterator it(object);
+  while(it.more())
+  {
+    const mongo::BSONElement elem = it.next();
+    const char *name = elem.fieldName();
+    if(!strcmp(name, "_id") || !strcmp(name, "_parent"))
+    {
+      continue;
+    }
 
-  if(first)
+    if(elem.type() == mongo::Object || elem.type() == mongo::Array)
+    {
+      // type and field name, then the content
+      SHA256_Update(&context, elem.rawdata(), 1 + elem.fieldNameSize());
+      hashDocument(elem.embeddedObject(), context);
+    }
+    else
+    {
+      SHA256_Update(&context, elem.rawdata(), elem.size());
+    }
+  }
+}
+
+mongo::OID Storage::addDocument(const mongo::BSONObj &object, const std::string &sofaId, const std::string &dbCollection, WriteBatch &batch)
+{
+  // collections replaced as a whole are not deduplicated
+  if(!dedupViews[sofaId] || std::find(batch.clear.begin(), batch.clear.end(), dbCollection) != batch.clear.end())
   {
+    batch.documents[dbCollection].push_back(object);
     mongo::BSONElement elem;
     object.getObjectID(elem);
-    builderCAS.append(sofaId, elem.OID());
-    if(sofaId.compare(0, std::string("camera_info").length(), "camera_info") == 0)
+    return elem.OID();
+  }
+
+  // the id is the leading 96 bits of the SHA-256 digest of the content
+  unsigned char digest[SHA256_DIGEST_LENGTH];
+  SHA256_CTX context;
+  SHA256_Init(&context);
+  hashDocument(object, context);
+  SHA256_Final(digest, &context);
+  char hex[25];
+  for(size_t i = 0; i < 12; ++i)
+  {
+    snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+  }
+  const mongo::OID id(hex);
+
+  std::vector<WriteBatch::SharedDocument> &shared = batch.shared[dbCollection];
+  for(size_t i = 0; i < shared.size(); ++i)
+  {
+    if(shared[i].id == id)
     {
-      camInfoOIDs[sofaId] = elem.OID();
+      ++shared[i].references;
+      return id;
     }
-    outDebug("storing sofas to " << dbCollection << ".");
-    db.insert(dbCollection, object);
-    return true;
   }
 
-  if(sofaId.compare(0, std::string("camera_info").length(), "camera_info") == 0)
+  WriteBatch::SharedDocument document;
+  document.id = id;
+  document.references = 1;
   {
-    builderCAS.append(sofaId, camInfoOIDs[sofaId]);
+    std::lock_guard<std::mutex> lock(sharedLock);
+    if(sharedDocuments.insert(dbCollection + ':' + id.toString()).second)
+    {
+      mongo::BSONObjBuilder content;
+      mongo::BSONObjIterator it(object);
+      while(it.more())
+      {
+        const mongo::BSONElement elem = it.next();
+        if(strcmp(elem.fieldName(), "_id"))
+        {
+          content.append(elem);
+        }
+      }
+      document.content = content.obj();
+    }
+  }
+  shared.push_back(document);
+  return id;
+}
+
+void Storage::WriteBatch::keepSharedContent(const WriteBatch &dropped)
+{
+  std::map<std::string, std::vector<SharedDocument> >::const_iterator it;
+  for(it = dropped.shared.begin(); it != dropped.shared.end(); ++it)
+  {
+    std::vector<SharedDocument> &documents = shared[it->first];
+    for(size_t i = 0; i < it->second.size(); ++i)
+    {
+      const SharedDocument &document = it->second[i];
+      if(document.content.isEmpty())
+      {
+        continue;
+      }
+
+      size_t j = 0;
+      for(; j < documents.size() && documents[j].id != document.id; ++j)
+      {
+      }
+      if(j == documents.size())
+      {
+        documents.push_back(document);
+        documents.back().references = 0;
+      }
+      else if(documents[j].content.isEmpty())
+      {
+        documents[j].content = document.content;
+      }
+    }
+  }
+}
+
+bool Storage::WriteBatch::hasSharedContent() const
+{
+  std::map<std::string, std::vector<SharedDocument> >::const_iterator it;
+  for(it = shared.begin(); it != shared.end(); ++it)
+  {
+    for(size_t i = 0; i < it->second.size(); ++i)
+    {
+      if(!it->second[i].content.isEmpty())
+      {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/**
+ * Queries the documents of ids in their order. $in returns every document only once and in the
+ * order of the collection, but deduplicated arrays reference the same document several times.
+ */
+static void queryInOrder(mongo::DBClientBase &connection, const std::string &collection, const std::vector<mongo::OID> &ids, std::vector<mongo::BSONObj> &objects)
+{
+  std::vector<mongo::OID> unique(ids);
+  std::sort(unique.begin(), unique.end());
+  unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+
+  mongo::auto_ptr<mongo::DBClientCursor> cursor;
+  if(unique.size() == 1)
+  {
+    cursor = connection.query(collection, mongo::Query(BSON("_id" << unique[0])), 1);
   }
   else
   {
-    mongo::BSONElement elem;
-    object.getObjectID(elem);
-    builderCAS.append(sofaId, elem.OID());
-    outDebug("storing sofas to " << dbCollection << ".");
-    db.insert(dbCollection, object);
+    cursor = connection.query(collection, mongo::Query(BSON("_id" << BSON("$in" << unique))), unique.size());
   }
 
+  std::map<mongo::OID, mongo::BSONObj> found;
+  while(cursor->more())
+  {
+    // the objects of a cursor are only valid until it fetches the next batch
+    const mongo::BSONObj object = cursor->next().getOwned();
+    found[object.getField("_id").OID()] = object;
+  }
+  outAssert(found.size() == unique.size(), "Returned objects (" << found.size() << ") do not match stored OIDs (" << unique.size() << ").");
 
-  return true;
+  objects.clear();
+  objects.reserve(ids.size());
+  for(size_t i = 0; i < ids.size(); ++i)
+  {
+    std::map<mongo::OID, mongo::BSONObj>::const_iterator it = found.find(ids[i]);
+    if(it != found.end())
+    {
+      objects.push_back(it->second);
+    }
+  }
 }
 
 void Storage::loadView(uima::CAS &cas, const mongo::BSONElement &elem)
 {
   const std::string &viewName = elem.fieldName();
+
+  if(lazyLoading)
+  {
+    // the element points into the scene document, keep an own copy for the loader
+    const mongo::BSONObj field = elem.wrap();
+    rs::SceneCas::setViewLoader(cas, viewName, [this, field](uima::CAS &view)
+    {
+      return loadViewData(&view, field.firstElement());
+    });
+    return;
+  }
+
+  uima::CAS *view = getView(cas, viewName);
+  const uima::FeatureStructure fs = loadViewData(view, elem);
+
+  const std::string mime = "application/x-" + viewName;
+  view->setSofaDataArray(fs, UnicodeString::fromUTF8(mime));
+}
+
+uima::CAS *Storage::getView(uima::CAS &cas, const std::string &viewName)
+{
   uima::CAS *view = nullptr;
   try
   {
@@ -229,55 +462,331 @@ void Storage::loadView(uima::CAS &cas, const mongo::BSONElement &elem)
     outDebug("create view " << viewName);
     view = cas.createView(UnicodeString::fromUTF8(viewName));
   }
+  return view;
+}
+
+uima::FeatureStructure Storage::loadViewData(uima::CAS *view, const mongo::BSONElement &elem)
+{
+  std::lock_guard<std::recursive_mutex> lock(dbLock);
 
   outDebug("getting referenced object...");
-  uima::FeatureStructure fs;
-  if(elem.isSimpleType())
+  SceneData::View data;
+  fetchViewData(db, elem, data);
+  return convertViewData(view, data);
+}
+
+uima::FeatureStructure Storage::loadArrayFS(uima::CAS *view, const std::string &viewName, const std::vector<mongo::OID> &ids)
+{
+  std::vector<mongo::BSONObj> objects;
+  queryInOrder(db, dbBase + viewName, ids, objects);
+
+  uima::ArrayFS array = view->createArrayFS(objects.size());
+  for(size_t i = 0; i < objects.size(); ++i)
+  {
+    array.set(i, rs::conversion::to(*view, objects[i]));
+  }
+  return array;
+}
+
+/**
+ * A connection of the fetch pool for the lifetime of the object, it is handed back to the pool even if
+ * the fetch throws.
+ */
+class Storage::FetchConnection
+{
+private:
+  Storage &storage;
+  std::unique_ptr<mongo::DBClientConnection> connection;
+
+public:
+  FetchConnection(Storage &storage) : storage(storage), connection(storage.acquireConnection())
+  {
+  }
+
+  ~FetchConnection()
+  {
+    storage.releaseConnection(connection);
+  }
+
+  mongo::DBClientConnection &operator*()
+  {
+    return *connection;
+  }
+};
+
+std::unique_ptr<mongo::DBClientConnection> Storage::acquireConnection()
+{
+  {
+    std::unique_lock<std::mutex> lock(fetchLock);
+    fetchReleased.wait(lock, [this]()
+    {
+      return !fetchConnections.empty() || openFetchConnections < FETCH_CONNECTIONS;
+    });
+    if(!fetchConnections.empty())
+    {
+      std::unique_ptr<mongo::DBClientConnection> connection(std::move(fetchConnections.back()));
+      fetchConnections.pop_back();
+      return connection;
+    }
+    ++openFetchConnections;
+  }
+
+  outDebug("opening additional connection to " << dbHost << ".");
+  std::unique_ptr<mongo::DBClientConnection> connection(new mongo::DBClientConnection());
+  try
+  {
+    connection->connect(dbHost);
+  }
+  catch(...)
+  {
+    std::lock_guard<std::mutex> lock(fetchLock);
+    --openFetchConnections;
+    fetchReleased.notify_one();
+    throw;
+  }
+  return connection;
+}
+
+void Storage::releaseConnection(std::unique_ptr<mongo::DBClientConnection> &connection)
+{
+  std::lock_guard<std::mutex> lock(fetchLock);
+  if(connection->isFailed())
   {
-    fs = loadFS(view, viewName, elem.OID());
+    // the connection broke during the fetch, the next one opens a new connection instead
+    --openFetchConnections;
+    connection.reset();
   }
   else
+  {
+    fetchConnections.push_back(std::move(connection));
+  }
+  fetchReleased.notify_one();
+}
+
+void Storage::fetchWorker()
+{
+  std::unique_lock<std::mutex> lock(fetchLock);
+  while(true)
+  {
+    fetchQueued.wait(lock, [this]()
+    {
+      return fetchStopping || !fetchTasks.empty();
+    });
+    if(fetchTasks.empty())
+    {
+      return;
+    }
+    std::function<void()> task(std::move(fetchTasks.front()));
+    fetchTasks.pop_front();
+
+    lock.unlock();
+    task();
+    lock.lock();
+  }
+}
+
+void Storage::fetchViews(const std::vector<mongo::BSONElement> &elems, std::vector<SceneData::View> &views,
+                         const std::function<void(const SceneData::View &)> &fetched)
+{
+  views.resize(elems.size());
+
+  // the views are queried in parallel by up to FETCH_CONNECTIONS workers, each on a connection of the pool, so
+  // that the scene takes only a few round trips. if no connection can be opened, the remaining views of the
+  // scene fail with the same error instead of each trying again
+  struct Failure
+  {
+    std::mutex lock;
+    std::exception_ptr connection;
+  };
+  std::shared_ptr<Failure> failure = std::make_shared<Failure>();
+
+  std::vector<std::future<void> > futures(elems.size());
+  {
+    std::lock_guard<std::mutex> lock(fetchLock);
+    for(size_t i = 0; i < elems.size(); ++i)
+    {
+      // the task owns its promise, the views and elements stay valid until all futures are ready
+      std::shared_ptr<std::promise<void> > done = std::make_shared<std::promise<void> >();
+      futures[i] = done->get_future();
+      const mongo::BSONElement *elem = &elems[i];
+      SceneData::View *view = &views[i];
+      fetchTasks.push_back([this, failure, done, elem, view]()
+      {
+        {
+          std::lock_guard<std::mutex> lock(failure->lock);
+          if(failure->connection)
+          {
+            done->set_exception(failure->connection);
+            return;
+          }
+        }
+        try
+        {
+          FetchConnection connection(*this);
+          try
+          {
+            fetchViewData(*connection, *elem, *view);
+            done->set_value();
+          }
+          catch(...)
+          {
+            done->set_exception(std::current_exception());
+          }
+        }
+        catch(...)
+        {
+          std::lock_guard<std::mutex> lock(failure->lock);
+          failure->connection = std::current_exception();
+          done->set_exception(failure->connection);
+        }
+      });
+    }
+    while(fetchWorkers.size() < std::min<size_t>(fetchTasks.size(), FETCH_CONNECTIONS))
+    {
+      fetchWorkers.push_back(std::thread(&Storage::fetchWorker, this));
+    }
+  }
+  fetchQueued.notify_all();
+
+  // hand out the views in order while the later ones are still being fetched, the workers use the views,
+  // so all of them have to be done before the first error is passed on
+  std::exception_ptr error;
+  for(size_t i = 0; i < futures.size(); ++i)
+  {
+    try
+    {
+      futures[i].get();
+      if(fetched && !error)
+      {
+        fetched(views[i]);
+      }
+    }
+    catch(...)
+    {
+      if(!error)
+      {
+        error = std::current_exception();
+      }
+    }
+  }
+  if(error)
+  {
+    std::rethrow_exception(error);
+  }
+}
+
+void Storage::fetchViewData(mongo::DBClientConnection &connection, const mongo::BSONElement &elem, SceneData::View &data)
+{
+  data.name = elem.fieldName();
+  data.isArray = !elem.isSimpleType();
+  data.objects.clear();
+
+  std::vector<mongo::OID> ids;
+  if(data.isArray)
   {
     const std::vector<mongo::BSONElement> &elems = elem.Array();
-    std::vector<mongo::OID> ids(elems.size());
+    ids.resize(elems.size());
     for(size_t i = 0; i < elems.size(); ++i)
     {
       ids[i] = elems[i].OID();
     }
-
-    fs = loadArrayFS(view, viewName, ids);
   }
+  else
+  {
+    ids.push_back(elem.OID());
+  }
+  queryInOrder(connection, dbBase + data.name, ids, data.objects);
 
-  const std::string mime = "application/x-" + viewName;
-  view->setSofaDataArray(fs, UnicodeString::fromUTF8(mime));
+  fetchBlobs(connection, data);
 }
 
-uima::FeatureStructure Storage::loadArrayFS(uima::CAS *view, const std::string &viewName, const std::vector<mongo::OID> &ids)
+void Storage::fetchBlobs(mongo::DBClientConnection &connection, SceneData::View &data)
 {
-  mongo::Query query(BSON("_id" << BSON("$in" << ids)));
-  mongo::auto_ptr<mongo::DBClientCursor> cursor = db.query(dbBase + viewName, query, ids.size());
+  data.blobs.clear();
+  for(size_t i = 0; i < data.objects.size(); ++i)
+  {
+    const mongo::BSONElement refs = data.objects[i].getField(BLOB_REFS);
+    if(refs.eoo())
+    {
+      continue;
+    }
 
-  uima::ArrayFS array = view->createArrayFS(ids.size());
-  size_t i = 0;
-  while(cursor->more())
+    const std::vector<mongo::BSONElement> &elems = refs.Array();
+    for(size_t j = 0; j < elems.size(); ++j)
+    {
+      const mongo::BSONObj ref = elems[j].Obj();
+      data.blobs.push_back(SceneData::Blob());
+      SceneData::Blob &blob = data.blobs.back();
+      blob.object = i;
+      blob.feature = ref.getStringField("feature");
+      const long long size = ref.getField("size").numberLong();
+      if(size < 0)
+      {
+        throw std::runtime_error("invalid size of blob \"" + blob.feature + "\" in view \"" + data.name + "\"");
+      }
+      blob.bytes.resize(size);
+
+      // the chunks are copied straight out of the cursor's messages, duplicated chunks of a retried write or
+      // a foreign document must not write past the blob, and a short blob must not be loaded partly zeroed
+      size_t pos = 0;
+      mongo::auto_ptr<mongo::DBClientCursor> cursor = connection.query(dbBlobs, mongo::Query(BSON("blob" << ref.getField("id").OID())).sort("n"));
+      while(cursor->more())
+      {
+        int length = 0;
+        const char *bytes = cursor->next().getField("data").binData(length);
+        if(length < 0 || (size_t)length > blob.bytes.size() - pos)
+        {
+          throw std::runtime_error("stored chunks exceed the size of blob \"" + blob.feature + "\" in view \"" + data.name + "\"");
+        }
+        std::memcpy(blob.bytes.data() + pos, bytes, length);
+        pos += length;
+      }
+      if(pos != blob.bytes.size())
+      {
+        throw std::runtime_error("stored chunks are missing from blob \"" + blob.feature + "\" in view \"" + data.name + "\"");
+      }
+    }
+  }
+}
+
+uima::FeatureStructure Storage::convertViewData(uima::CAS *view, const SceneData::View &data)
+{
+  std::vector<uima::FeatureStructure> elements(data.objects.size());
+  for(size_t i = 0; i < data.objects.size(); ++i)
+  {
+    elements[i] = rs::conversion::to(*view, data.objects[i]);
+  }
+
+  for(size_t i = 0; i < data.blobs.size(); ++i)
+  {
+    const SceneData::Blob &blob = data.blobs[i];
+    uima::ByteArrayFS array = view->createByteArrayFS(blob.bytes.size());
+    array.copyFromArray(blob.bytes.data(), 0, blob.bytes.size(), 0);
+
+    uima::FeatureStructure &fs = elements[blob.object];
+    fs.setFSValue(rs::getFeature(fs, blob.feature.c_str()), array);
+  }
+
+  if(!data.isArray)
   {
-    array.set(i++, rs::conversion::to(*view, cursor->next()));
+    return elements.empty() ? uima::FeatureStructure() : elements[0];
   }
 
-  outAssert(i == ids.size(), "Returned objects (" << i << ") do not match stored OIDs (" << ids.size() << ").");
+  uima::ArrayFS array = view->createArrayFS(elements.size());
+  for(size_t i = 0; i < elements.size(); ++i)
+  {
+    array.set(i, elements[i]);
+  }
   return array;
 }
 
-uima::FeatureStructure Storage::loadFS(uima::CAS *view, const std::string &viewName, const mongo::OID &id)
+void Storage::insertView(uima::CAS &cas, const SceneData::View &data)
 {
-  mongo::Query query(BSON("_id" << id));
-  mongo::auto_ptr<mongo::DBClientCursor> cursor = db.query(dbBase + viewName, query, 1);
+  uima::CAS *view = getView(cas, data.name);
+  const uima::FeatureStructure fs = convertViewData(view, data);
 
-  if(cursor->more())
-  {
-    return rs::conversion::to(*view, cursor->next());
-  }
-  return uima::FeatureStructure();
+  const std::string mime = "application/x-" + data.name;
+  view->setSofaDataArray(fs, UnicodeString::fromUTF8(mime));
 }
 
 void Storage::removeView(const mongo::BSONElement &elem)
@@ -285,20 +794,47 @@ void Storage::removeView(const mongo::BSONElement &elem)
   const std::string &viewName = elem.fieldName();
   const std::string dbCollection = dbBase + viewName;
 
+  std::vector<mongo::OID> ids;
   if(elem.isSimpleType())
   {
-    db.remove(dbCollection, mongo::Query(BSON("_id" << elem.OID())));
+    ids.push_back(elem.OID());
   }
   else
   {
     const std::vector<mongo::BSONElement> &elems = elem.Array();
-    std::vector<mongo::OID> ids(elems.size());
+    ids.resize(elems.size());
     for(size_t i = 0; i < elems.size(); ++i)
     {
       ids[i] = elems[i].OID();
     }
+  }
+
+  // documents of the scene only
+  db.remove(dbCollection, mongo::Query(BSON("_id" << BSON("$in" << ids) << DB_REFS << BSON("$exists" << false))));
 
-    db.remove(dbCollection, mongo::Query(BSON("_id" << BSON("$in" << ids))));
+  // shared documents, grouped by the number of references from this scene
+  std::map<mongo::OID, int> references;
+  for(size_t i = 0; i < ids.size(); ++i)
+  {
+    ++references[ids[i]];
+  }
+  std::map<int, std::vector<mongo::OID> > groups;
+  for(std::map<mongo::OID, int>::const_iterator it = references.begin(); it != references.end(); ++it)
+  {
+    groups[it->second].push_back(it->first);
+  }
+  for(std::map<int, std::vector<mongo::OID> >::const_iterator it = groups.begin(); it != groups.end(); ++it)
+  {
+    db.update(dbCollection, mongo::Query(BSON("_id" << BSON("$in" << it->second) << DB_REFS << BSON("$exists" << true))),
+              BSON("$inc" << BSON(DB_REFS << -it->first)), false, true);
+  }
+  db.remove(dbCollection, mongo::Query(BSON("_id" << BSON("$in" << ids) << DB_REFS << BSON("$lte" << 0))));
+
+  // they might have been removed, so their content has to be sent again
+  std::lock_guard<std::mutex> lock(sharedLock);
+  for(std::map<mongo::OID, int>::const_iterator it = references.begin(); it != references.end(); ++it)
+  {
+    sharedDocuments.erase(dbCollection + ':' + it->first.toString());
   }
 }
 
@@ -312,33 +848,75 @@ void Storage::enableViewLoading(const std::string &viewName, const bool enable)
   loadViews[viewName] = enable;
 }
 
+void Storage::enableViewDeduplication(const std::string &viewName, const bool enable)
+{
+  dedupViews[viewName] = enable;
+}
+
+void Storage::enableLazyLoading(const bool enable)
+{
+  lazyLoading = enable;
+}
+
+void Storage::setBlobThreshold(const size_t bytes)
+{
+  blobThreshold = bytes;
+}
+
 void Storage::getScenes(std::vector<uint64_t> &timestamps)
 {
+  getScenes(timestamps, 0, std::numeric_limits<uint64_t>::max());
+}
+
+void Storage::getScenes(std::vector<uint64_t> &timestamps, const uint64_t begin, const uint64_t end)
+{
+  std::lock_guard<std::recursive_mutex> lock(dbLock);
   timestamps.clear();
 
-  mongo::auto_ptr<mongo::DBClientCursor> cursor = db.query(dbCAS, mongo::Query());
+  // timestamps are stored as signed 64 bit integers
+  mongo::BSONObjBuilder range;
+  range.append("$gte", (long long)std::min(begin, (uint64_t)std::numeric_limits<long long>::max()));
+  if(end < (uint64_t)std::numeric_limits<long long>::max())
+  {
+    range.append("$lte", (long long)end);
+  }
+  const mongo::Query query = mongo::Query(BSON(DB_CAS_TIME << range.obj())).sort(DB_CAS_TIME);
+
+  // only return the timestamp, so that the query can be answered from the index
+  const mongo::BSONObj fields = BSON(DB_CAS_TIME << 1 << "_id" << 0);
+  mongo::auto_ptr<mongo::DBClientCursor> cursor = db.query(dbCAS, query, 0, 0, &fields);
 
   while(cursor->more())
   {
-    const mongo::BSONObj &object = cursor->next();
-    std::vector<mongo::BSONElement> elems;
-    object.elems(elems);
+    timestamps.push_back(cursor->next().getField(DB_CAS_TIME).Long());
+  }
+}
 
-    for(size_t i = 0; i < elems.size(); ++i)
-    {
-      const mongo::BSONElement &elem = elems[i];
-      const std::string &name = elem.fieldName();
-      if(name == DB_CAS_TIME)
-      {
-        timestamps.push_back(elem.Long());
-      }
-    }
+void Storage::getNewScenes(std::vector<uint64_t> &timestamps)
+{
+  if(timestamps.empty())
+  {
+    getScenes(timestamps);
+    return;
   }
+
+  std::vector<uint64_t> newScenes;
+  getScenes(newScenes, timestamps.back() + 1, std::numeric_limits<uint64_t>::max());
+  timestamps.insert(timestamps.end(), newScenes.begin(), newScenes.end());
 }
 
 bool Storage::storeScene(uima::CAS &cas, const uint64_t &timestamp)
 {
-  outDebug("converting CAS Views to BSON and writing to mongoDB...");
+  WriteBatch batch;
+  serializeScene(cas, timestamp, batch);
+  return writeBatch(batch);
+}
+
+void Storage::serializeScene(uima::CAS &cas, const uint64_t &timestamp, WriteBatch &batch, const bool update)
+{
+  outDebug("converting CAS Views to BSON...");
+  // load pending views first, their loaders lock the database connection themselves
+  rs::SceneCas::loadPendingViews(cas);
   mongo::BSONObjBuilder builder;
   builder.genOID();
   builder.append(DB_CAS_TIME, (long long)timestamp);
@@ -346,6 +924,9 @@ bool Storage::storeScene(uima::CAS &cas, const uint64_t &timestamp)
   builder.asTempObj().getObjectID(elemOID);
   const mongo::OID &casOID = elemOID.OID();
 
+  batch.timestamp = timestamp;
+  batch.update = update;
+
   uima::FSIterator it = cas.getSofaIterator();
   for(; it.isValid(); it.moveToNext())
   {
@@ -353,8 +934,8 @@ bool Storage::storeScene(uima::CAS &cas, const uint64_t &timestamp)
 
     const std::string sofaId = sofa.getSofaID().asUTF8();
 
-    //if sofa should not be stored or it's the cam info and it has already been stored
-    if(!storeViews[sofaId]) //|| ((sofaId == "camera_info" || sofaId == "camera_info_hd") && !first))
+    //if sofa should not be stored
+    if(!storeViews[sofaId])
     {
       outInfo("skipping sofa \"" << sofaId << "\".");
       continue;
@@ -366,20 +947,181 @@ bool Storage::storeScene(uima::CAS &cas, const uint64_t &timestamp)
 
     uima::FeatureStructure fs = sofa.getLocalFSData();
 
-    readArrayFS(fs, builder, casOID, sofaId, dbCollection) || readFS(fs, builder, casOID, sofaId, dbCollection);
+    readArrayFS(fs, builder, casOID, sofaId, dbCollection, batch) || readFS(fs, builder, casOID, sofaId, dbCollection, batch);
   }
 
-  outDebug("storing CAS information to " << DB_CAS << ".");
-  db.insert(dbCAS, builder.obj());
-  if(first)
+  batch.scene = builder.obj();
+}
+
+bool Storage::writeBatch(const WriteBatch &batch)
+{
+  std::lock_guard<std::recursive_mutex> lock(dbLock);
+
+  // references added to shared documents, taken back if the scene itself is not stored
+  std::vector<std::pair<const std::string *, const WriteBatch::SharedDocument *> > referenced;
+  const auto release = [this, &batch, &referenced]()
+  {
+    try
+    {
+      for(size_t i = 0; i < referenced.size(); ++i)
+      {
+        const WriteBatch::SharedDocument &document = *referenced[i].second;
+        db.update(*referenced[i].first, mongo::Query(BSON("_id" << document.id)), BSON("$inc" << BSON(DB_REFS << -document.references)));
+      }
+      const std::string error = db.getLastError();
+      if(!error.empty())
+      {
+        outError("releasing shared documents of scene " << batch.timestamp << " failed: " << error);
+      }
+    }
+    catch(const mongo::DBException &e)
+    {
+      outError("releasing shared documents of scene " << batch.timestamp << " failed: " << e.what());
+    }
+    referenced.clear();
+  };
+
+  // unacknowledged writes do not throw and the last error only covers the latest write, so every
+  // write is checked before the next one is sent
+  const auto failed = [this, &batch, &release]()
   {
-    first = false;
+    const std::string error = db.getLastError();
+    if(!error.empty())
+    {
+      outError("writing scene " << batch.timestamp << " failed: " << error);
+      release();
+      return true;
+    }
+    return false;
+  };
+
+  try
+  {
+    // add the references to shared documents before an updated scene drops its old ones
+    std::map<std::string, std::vector<WriteBatch::SharedDocument> >::const_iterator itS;
+    for(itS = batch.shared.begin(); itS != batch.shared.end(); ++itS)
+    {
+      for(size_t i = 0; i < itS->second.size(); ++i)
+      {
+        const WriteBatch::SharedDocument &document = itS->second[i];
+        const mongo::Query query(BSON("_id" << document.id));
+        if(document.content.isEmpty())
+        {
+          db.update(itS->first, query, BSON("$inc" << BSON(DB_REFS << document.references)));
+        }
+        else
+        {
+          db.update(itS->first, query, BSON("$setOnInsert" << document.content << "$inc" << BSON(DB_REFS << document.references)), true);
+        }
+        if(failed())
+        {
+          return false;
+        }
+        referenced.push_back(std::make_pair(&itS->first, &document));
+      }
+    }
+
+    if(batch.update)
+    {
+      removeScene(batch.timestamp);
+      if(failed())
+      {
+        return false;
+      }
+    }
+    for(size_t i = 0; i < batch.clear.size(); ++i)
+    {
+      db.remove(batch.clear[i], mongo::Query());
+      if(failed())
+      {
+        return false;
+      }
+    }
+
+    std::map<std::string, std::vector<mongo::BSONObj> >::const_iterator it;
+    for(it = batch.documents.begin(); it != batch.documents.end(); ++it)
+    {
+      outDebug("storing " << it->second.size() << " documents to " << it->first << ".");
+      // split large views into several messages, since a single one is limited in size
+      std::vector<mongo::BSONObj>::const_iterator begin = it->second.begin(), end = begin;
+      while(begin != it->second.end())
+      {
+        size_t size = 0;
+        for(; end != it->second.end() && (end == begin || size + end->objsize() <= INSERT_SIZE); ++end)
+        {
+          size += end->objsize();
+        }
+        db.insert(it->first, std::vector<mongo::BSONObj>(begin, end));
+        if(failed())
+        {
+          return false;
+        }
+        begin = end;
+      }
+    }
+
+    // chunks are built for one insert message at a time, instead of for all blobs up front
+    std::vector<mongo::BSONObj> chunks;
+    size_t size = 0;
+    for(size_t i = 0; i < batch.blobs.size(); ++i)
+    {
+      const WriteBatch::Blob &blob = batch.blobs[i];
+      int n = 0;
+      for(size_t pos = 0; pos < blob.bytes.size(); pos += BLOB_CHUNK, ++n)
+      {
+        const size_t count = std::min<size_t>(BLOB_CHUNK, blob.bytes.size() - pos);
+        if(!chunks.empty() && size + count > INSERT_SIZE)
+        {
+          db.insert(dbBlobs, chunks);
+          if(failed())
+          {
+            return false;
+          }
+          chunks.clear();
+          size = 0;
+        }
+
+        mongo::BSONObjBuilder builderChunk;
+        builderChunk.append("_parent", blob.parent);
+        builderChunk.append("blob", blob.id);
+        builderChunk.append("n", n);
+        builderChunk.appendBinData("data", count, mongo::BinDataGeneral, blob.bytes.data() + pos);
+        chunks.push_back(builderChunk.obj());
+        size += chunks.back().objsize();
+      }
+    }
+    if(!chunks.empty())
+    {
+      outDebug("storing " << batch.blobs.size() << " blobs to " << DB_BLOBS << ".");
+      db.insert(dbBlobs, chunks);
+      if(failed())
+      {
+        return false;
+      }
+    }
+
+    if(!batch.scene.isEmpty())
+    {
+      outDebug("storing CAS information to " << DB_CAS << ".");
+      db.insert(dbCAS, batch.scene);
+      if(failed())
+      {
+        return false;
+      }
+    }
+  }
+  catch(const mongo::DBException &e)
+  {
+    outError("writing scene " << batch.timestamp << " failed: " << e.what());
+    release();
+    return false;
   }
   return true;
 }
 
 bool Storage::removeScene(const uint64_t &timestamp)
 {
+  std::lock_guard<std::recursive_mutex> lock(dbLock);
   mongo::Query query(BSON(DB_CAS_TIME << (long long)timestamp));
   mongo::auto_ptr<mongo::DBClientCursor> cursor = db.query(dbCAS, query, 1);
 
@@ -399,6 +1141,7 @@ bool Storage::removeScene(const uint64_t &timestamp)
         removeView(elem);
       }
     }
+    db.remove(dbBlobs, mongo::Query(BSON("_parent" << object.getField("_id").OID())));
     db.remove(dbCAS, query);
   }
   else
@@ -410,42 +1153,134 @@ bool Storage::removeScene(const uint64_t &timestamp)
 
 bool Storage::updateScene(uima::CAS &cas, const uint64_t &timestamp)
 {
-  removeScene(timestamp);
-  return storeScene(cas, timestamp);
+  WriteBatch batch;
+  serializeScene(cas, timestamp, batch, true);
+  return writeBatch(batch);
 }
 
 bool Storage::loadScene(uima::CAS &cas, const uint64_t &timestamp)
 {
   const bool loadAll = loadViews.empty();
   mongo::Query query(BSON(DB_CAS_TIME << (long long)timestamp));
-  mongo::auto_ptr<mongo::DBClientCursor> cursor = db.query(dbCAS, query, 1);
+  mongo::BSONObj object;
+  {
+    std::lock_guard<std::recursive_mutex> lock(dbLock);
+    mongo::auto_ptr<mongo::DBClientCursor> cursor = db.query(dbCAS, query, 1);
+    if(!cursor->more())
+    {
+      return false;
+    }
+    object = cursor->next().getOwned();
+  }
 
-  if(cursor->more())
+  std::vector<mongo::BSONElement> elems, selected;
+  object.elems(elems);
+  for(size_t i = 0; i < elems.size(); ++i)
   {
-    const mongo::BSONObj &object = cursor->next();
-    std::vector<mongo::BSONElement> elems;
-    object.elems(elems);
+    const mongo::BSONElement &elem = elems[i];
+    const std::string &name = elem.fieldName();
+    if((loadAll && name[0] != '_') || (!loadAll && loadViews[name]))
+    {
+      selected.push_back(elem);
+    }
+  }
 
-    for(size_t i = 0; i < elems.size(); ++i)
+  if(lazyLoading)
+  {
+    for(size_t i = 0; i < selected.size(); ++i)
     {
-      const mongo::BSONElement &elem = elems[i];
-      const std::string &name = elem.fieldName();
-      if((loadAll && name[0] != '_') || (!loadAll && loadViews[name]))
-      {
-        outDebug("loading view: " << name);
-        loadView(cas, elem);
-      }
+      outDebug("loading view: " << selected[i].fieldName());
+      loadView(cas, selected[i]);
     }
+    return true;
   }
-  else
+
+  // the views are converted one after another, since the CAS is not thread safe
+  std::vector<SceneData::View> views;
+  try
+  {
+    fetchViews(selected, views, [this, &cas](const SceneData::View &data)
+    {
+      outDebug("loading view: " << data.name);
+      insertView(cas, data);
+    });
+  }
+  catch(const std::exception &e)
   {
+    outError("loading scene " << timestamp << " failed: " << e.what());
     return false;
   }
   return true;
 }
 
+bool Storage::fetchScene(const uint64_t &timestamp, SceneData &scene)
+{
+  const bool loadAll = loadViews.empty();
+  mongo::Query query(BSON(DB_CAS_TIME << (long long)timestamp));
+
+  scene.timestamp = timestamp;
+  scene.views.clear();
+
+  mongo::BSONObj object;
+  {
+    std::lock_guard<std::recursive_mutex> lock(dbLock);
+    mongo::auto_ptr<mongo::DBClientCursor> cursor = db.query(dbCAS, query, 1);
+    if(!cursor->more())
+    {
+      return false;
+    }
+    object = cursor->next().getOwned();
+  }
+
+  std::vector<mongo::BSONElement> elems, selected;
+  object.elems(elems);
+  for(size_t i = 0; i < elems.size(); ++i)
+  {
+    const mongo::BSONElement &elem = elems[i];
+    const std::string &name = elem.fieldName();
+    if((loadAll && name[0] != '_') || (!loadAll && loadViews[name]))
+    {
+      outDebug("fetching view: " << name);
+      selected.push_back(elem);
+    }
+  }
+  try
+  {
+    fetchViews(selected, scene.views);
+  }
+  catch(const std::exception &e)
+  {
+    outError("fetching scene " << timestamp << " failed: " << e.what());
+    scene.views.clear();
+    return false;
+  }
+  return true;
+}
+
+void Storage::loadScene(uima::CAS &cas, const SceneData &scene)
+{
+  for(size_t i = 0; i < scene.views.size(); ++i)
+  {
+    const SceneData::View &data = scene.views[i];
+    outDebug("loading view: " << data.name);
+
+    if(lazyLoading)
+    {
+      // the documents are already in memory, only the conversion is deferred
+      rs::SceneCas::setViewLoader(cas, data.name, [this, data](uima::CAS &view)
+      {
+        return convertViewData(&view, data);
+      });
+      continue;
+    }
+
+    insertView(cas, data);
+  }
+}
+
 void Storage::removeCollection(const std::string &collection)
 {
+  std::lock_guard<std::recursive_mutex> lock(dbLock);
   outDebug("removing collection '" << collection << "' from mongoDB...");
   const std::string dbCollection = dbBase + collection;
   db.dropCollection(dbCollection);
@@ -454,16 +1289,24 @@ void Storage::removeCollection(const std::string &collection)
 void Storage::storeCollection(uima::CAS &cas, const std::string &view, const std::string &collection)
 {
   outDebug("storing CAS View as Collection to mongoDB...");
+  WriteBatch batch;
+  serializeCollection(cas, view, collection, batch);
+  writeBatch(batch);
+}
+
+void Storage::serializeCollection(uima::CAS &cas, const std::string &view, const std::string &collection, WriteBatch &batch)
+{
+  rs::SceneCas::loadPendingViews(cas);
   mongo::BSONObjBuilder builder;
   const mongo::OID casOID;
   const std::string dbCollection = dbBase + collection;
 
-  db.remove(dbCollection, mongo::Query());
+  batch.clear.push_back(dbCollection);
   try
   {
     uima::CAS *_view = cas.getView(UnicodeString::fromUTF8(view));
     uima::FeatureStructure fs = _view->getSofaDataArray();
-    readArrayFS(fs, builder, casOID, view, dbCollection) || readFS(fs, builder, casOID, view, dbCollection);
+    readArrayFS(fs, builder, casOID, view, dbCollection, batch) || readFS(fs, builder, casOID, view, dbCollection, batch);
   }
   catch(uima::CASException e)
   {
@@ -473,6 +1316,7 @@ void Storage::storeCollection(uima::CAS &cas, const std::string &view, const std
 
 void Storage::loadCollection(uima::CAS &cas, const std::string &view, const std::string &collection)
 {
+  std::lock_guard<std::recursive_mutex> lock(dbLock);
   const std::string dbCollection = dbBase + collection;
   mongo::Query query;
   mongo::auto_ptr<mongo::DBClientCursor> cursor = db.query(dbCollection, query);
@@ -507,6 +1351,7 @@ void Storage::loadCollection(uima::CAS &cas, const std::string &view, const std:
 
 std::vector<rs::Cluster> Storage::getClusters(uima::CAS &cas, const std::string &collection, std::vector<std::string> ids)
 {
+  std::lock_guard<std::recursive_mutex> lock(dbLock);
   const std::string dbCollection = dbBase + collection;
   mongo::auto_ptr<mongo::DBClientCursor> cursor = db.query(dbCollection, mongo::Query());
 
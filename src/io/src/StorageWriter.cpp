@@ -17,6 +17,12 @@
  * limitations under the License.
  */
 
+// STL
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
 // UIMA
 #include <uima/api.hpp>
 
@@ -25,18 +31,151 @@
 #include <rs/utils/time.h>
 #include <rs/utils/output.h>
 #include <rs/io/Storage.h>
+#include <rs/io/FileStorage.h>
 
 using namespace uima;
 
 class StorageWriter : public Annotator
 {
 private:
+  enum QueuePolicy
+  {
+    BLOCK = 0,
+    DROP_OLDEST,
+    DROP_NEWEST
+  };
+
   std::string host;
   std::string db;
+  std::string storageFile;
   rs::Storage storage;
+  rs::FileStorage fileStorage;
+
+  // converted scenes waiting for the writer thread
+  size_t queueSize;
+  QueuePolicy queuePolicy;
+  std::deque<rs::Storage::WriteBatch> queue;
+  std::thread writer;
+  std::mutex queueLock;
+  std::condition_variable queueCV;
+  bool running;
+
+  // metrics
+  rs::LatencyHistogram *writeLatency;
+  rs::LatencyHistogram *waitLatency;
+  size_t maxDepth;
+  uint64_t queued, dropped, failed, reported;
+
+  void writerThread()
+  {
+    // shared content of failed batches, later batches only reference it
+    rs::Storage::WriteBatch carried;
+
+    std::unique_lock<std::mutex> guard(queueLock);
+    for(;;)
+    {
+      while(queue.empty() && running)
+      {
+        queueCV.wait(guard);
+      }
+      // write everything that was queued before stopping
+      if(queue.empty())
+      {
+        break;
+      }
+
+      rs::Storage::WriteBatch batch;
+      std::swap(batch, queue.front());
+      queue.pop_front();
+      queueCV.notify_all();
+      guard.unlock();
+
+      batch.keepSharedContent(carried);
+      rs::StopWatch clock;
+      bool written = false;
+      try
+      {
+        written = storage.writeBatch(batch);
+      }
+      catch(const std::exception &e)
+      {
+        outError("writing scene " << batch.timestamp << " failed: " << e.what());
+      }
+      writeLatency->add(clock.getTime());
+
+      carried = rs::Storage::WriteBatch();
+      if(!written)
+      {
+        carried.keepSharedContent(batch);
+      }
+
+      guard.lock();
+      if(!written)
+      {
+        ++failed;
+      }
+    }
+
+    if(carried.hasSharedContent())
+    {
+      outError("shared documents of failed scenes were not written, scenes referencing them are incomplete.");
+    }
+  }
+
+  bool enqueue(rs::Storage::WriteBatch &batch)
+  {
+    rs::StopWatch clock;
+    std::unique_lock<std::mutex> guard(queueLock);
+
+    // failures of the writer thread are reported to the next scene
+    const bool ok = failed == reported;
+    if(!ok)
+    {
+      outError((failed - reported) << " scenes could not be written to the storage.");
+      reported = failed;
+    }
+
+    // batches storing shared content for the first time are never dropped, they block instead
+    if(queue.size() >= queueSize && queuePolicy == DROP_NEWEST && !batch.hasSharedContent())
+    {
+      outWarn("storage queue full, dropping scene " << batch.timestamp << ".");
+      writeLatency->addDropped();
+      ++dropped;
+      return ok;
+    }
+    if(queue.size() >= queueSize && queuePolicy == DROP_OLDEST)
+    {
+      std::deque<rs::Storage::WriteBatch>::iterator it = queue.begin();
+      for(; it != queue.end() && it->hasSharedContent(); ++it)
+      {
+      }
+      if(it != queue.end())
+      {
+        outWarn("storage queue full, dropping scene " << it->timestamp << ".");
+        queue.erase(it);
+        writeLatency->addDropped();
+        ++dropped;
+      }
+    }
+    while(queue.size() >= queueSize)
+    {
+      queueCV.wait(guard);
+    }
+
+    queue.push_back(rs::Storage::WriteBatch());
+    std::swap(queue.back(), batch);
+    ++queued;
+    maxDepth = std::max(maxDepth, queue.size());
+    outDebug("storage queue depth: " << queue.size());
+    queueCV.notify_all();
+    guard.unlock();
+    waitLatency->add(clock.getTime());
+    return ok;
+  }
 
 public:
-  StorageWriter() : host(DB_HOST), db(DB_NAME)
+  StorageWriter() : host(DB_HOST), db(DB_NAME), queueSize(0), queuePolicy(BLOCK), running(false),
+    writeLatency(NULL), waitLatency(NULL), maxDepth(0), queued(0), dropped(0), failed(0), reported(0)
   {
   }
 
@@ -44,6 +183,7 @@ public:
   {
     outInfo("initialize");
     std::vector<std::string *> enableViews;
+    std::vector<std::string *> deduplicateViews;
     bool clearStorageOnStart = false;
     bool unique = false;
 
@@ -51,6 +191,10 @@ public:
     {
       ctx.extractValue("enableViews", enableViews);
     }
+    if(ctx.isParameterDefined("deduplicateViews"))
+    {
+      ctx.extractValue("deduplicateViews", deduplicateViews);
+    }
     if(ctx.isParameterDefined("host"))
     {
       ctx.extractValue("host", host);
@@ -67,6 +211,25 @@ public:
     {
       ctx.extractValue("newUniqueDB", unique);
     }
+    if(ctx.isParameterDefined("storageFile"))
+    {
+      ctx.extractValue("storageFile", storageFile);
+    }
+    int size = 0;
+    if(ctx.isParameterDefined("queueSize"))
+    {
+      ctx.extractValue("queueSize", size);
+    }
+    std::string policy = "block";
+    if(ctx.isParameterDefined("queuePolicy"))
+    {
+      ctx.extractValue("queuePolicy", policy);
+    }
+    int blobThreshold = 0;
+    if(ctx.isParameterDefined("blobThreshold"))
+    {
+      ctx.extractValue("blobThreshold", blobThreshold);
+    }
 
     if(unique)
     {
@@ -75,15 +238,68 @@ public:
       db = oss.str();
     }
 
-    storage = rs::Storage(host, db, clearStorageOnStart);
+    if(storageFile.empty())
+    {
+      storage = rs::Storage(host, db, clearStorageOnStart);
+      storage.setBlobThreshold(blobThreshold > 0 ? blobThreshold : 0);
+      outInfo("Setting db to: " << db);
+    }
+    else
+    {
+      if(unique)
+      {
+        std::ostringstream oss;
+        oss << storageFile << '_' << ros::Time::now().toNSec();
+        storageFile = oss.str();
+      }
+      if(!fileStorage.open(storageFile, clearStorageOnStart))
+      {
+        return UIMA_ERR_USER_ANNOTATOR_COULD_NOT_INIT;
+      }
+      outInfo("Setting file to: " << storageFile);
+    }
 
-    outInfo("Setting db to: " << db);
     outInfo("Views stored:");
     for(size_t i = 0; i < enableViews.size(); ++i)
     {
       storage.enableViewStoring(*enableViews[i], true);
+      fileStorage.enableViewStoring(*enableViews[i], true);
       outInfo(i<<" : "<<*enableViews[i]);
     }
+    for(size_t i = 0; i < deduplicateViews.size(); ++i)
+    {
+      storage.enableViewDeduplication(*deduplicateViews[i], true);
+      outInfo("deduplicated: " << *deduplicateViews[i]);
+    }
+
+    if(policy == "block")
+    {
+      queuePolicy = BLOCK;
+    }
+    else if(policy == "drop_oldest")
+    {
+      queuePolicy = DROP_OLDEST;
+    }
+    else if(policy == "drop_newest")
+    {
+      queuePolicy = DROP_NEWEST;
+    }
+    else
+    {
+      outError("unknown queue policy: " << policy);
+      return UIMA_ERR_USER_ANNOTATOR_COULD_NOT_INIT;
+    }
+
+    // the file storage writes directly to the page cache and stays on the pipeline thread
+    queueSize = storageFile.empty() && size > 0 ? size : 0;
+    if(queueSize)
+    {
+      writeLatency = &rs::LatencyRegistry::instance().get("storage/" + db + "/write");
+      waitLatency = &rs::LatencyRegistry::instance().get("storage/" + db + "/enqueue");
+      running = true;
+      writer = std::thread(&StorageWriter::writerThread, this);
+      outInfo("writing asynchronously, queue size: " << queueSize << ", policy: " << policy);
+    }
 
     return UIMA_ERR_NONE;
   }
@@ -91,6 +307,21 @@ public:
   TyErrorId destroy()
   {
     outInfo("destroy");
+    if(writer.joinable())
+    {
+      {
+        std::lock_guard<std::mutex> guard(queueLock);
+        running = false;
+        queueCV.notify_all();
+        outInfo("writing " << queue.size() << " queued scenes...");
+      }
+      writer.join();
+
+      rs::LatencyHistogram::Snapshot write;
+      writeLatency->snapshot(write);
+      outInfo("scenes queued: " << queued << ", dropped: " << dropped << ", failed: " << failed << ", max queue depth: " << maxDepth
+              << ", write latency p50: " << write.p50 << " ms, p99: " << write.p99 << " ms");
+    }
     return UIMA_ERR_NONE;
   }
 
@@ -103,6 +334,25 @@ public:
     rs::Scene scene = cas.getScene();
     const uint64_t timestamp = (uint64_t)scene.timestamp();
 
+    if(!storageFile.empty())
+    {
+      fileStorage.storeScene(*tcas.getBaseCas(), timestamp);
+      return UIMA_ERR_NONE;
+    }
+
+    if(queueSize)
+    {
+      // only the conversion to BSON needs the CAS, the writer thread does the rest
+      rs::Storage::WriteBatch batch;
+      storage.serializeScene(*tcas.getBaseCas(), timestamp, batch, !scene.id().empty());
+      if(cas.has(VIEW_OBJECTS))
+      {
+        outDebug("store persistent objects");
+        storage.serializeCollection(tcas, VIEW_OBJECTS, "persistent_objects", batch);
+      }
+      return enqueue(batch) ? UIMA_ERR_NONE : UIMA_ERR_USER_ANNOTATOR_COULD_NOT_PROCESS;
+    }
+
     if(scene.id().empty())
     {
       storage.storeScene(*tcas.getBaseCas(), timestamp);
@@ -247,7 +247,7 @@ void UnrealVisionBridge::receive()
       packet.pDepth = packet.pColor + packet.sizeColor;
       packet.pObject = packet.pDepth + packet.sizeDepth;
       packet.pMap = packet.pObject + packet.sizeColor;
-      _newData = true;
+      setNewData(true);
 
       pPackage = &bufferActive[0];
       header.size = 0;
@@ -274,7 +274,7 @@ bool UnrealVisionBridge::setData(uima::CAS &tcas, uint64_t ts)
   lockBuffer.lock();
   bufferComplete.swap(bufferInUse);
   Packet packet = this->packet;
-  _newData = false;
+  setNewData(false);
   lockBuffer.unlock();
 
   // set transform and timestamp
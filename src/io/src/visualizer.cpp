@@ -17,11 +17,18 @@
  * limitations under the License.
  */
 
+// STL
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
 // PCL
 #include <pcl/io/pcd_io.h>
 
 // ROS
 #include <cv_bridge/cv_bridge.h>
+#include <sensor_msgs/CompressedImage.h>
 
 // RS
 #include <rs/utils/output.h>
@@ -32,8 +39,12 @@ using namespace rs;
 bool *Visualizer::trigger = NULL;
 
 Visualizer::Visualizer(const std::string &savePath) : windowImage("Image Viewer"), windowCloud("Cloud Viewer"), annotator(NULL), names(), index(0),
-  running(false), updateImage(true), updateCloud(true), changedAnnotator(true), save(false), saveFrameImage(0), saveFrameCloud(0), savePath(savePath), nh("~")
+  running(false), updateImage(true), updateCloud(true), changedAnnotator(true), save(false), saveFrameImage(0), saveFrameCloud(0), savePath(savePath), nh("~"),
+  headless(false), headlessRate(5.0), headlessFormat("jpeg"), encoderPending(false), headlessNh("~")
 {
+  // the headless viewer handles its own callbacks, run() never spins
+  headlessNh.setCallbackQueue(&headlessQueue);
+
   this->savePath = savePath;
   if(this->savePath[this->savePath.size() - 1] != '/')
   {
@@ -45,6 +56,28 @@ Visualizer::~Visualizer()
 {
 }
 
+void Visualizer::setHeadless(const double rate, const std::string &format, const std::string &file)
+{
+  headless = true;
+  headlessFile = file;
+  if(rate > 0.0)
+  {
+    headlessRate = rate;
+  }
+  else
+  {
+    outWarn("invalid visualization rate " << rate << ", using " << headlessRate << " Hz.");
+  }
+  if(format == "png")
+  {
+    headlessFormat = "png";
+  }
+  else if(format != "jpeg" && format != "jpg")
+  {
+    outWarn("unknown image format \"" << format << "\", using jpeg.");
+  }
+}
+
 bool Visualizer::start()
 {
   outInfo("start");
@@ -58,11 +91,22 @@ bool Visualizer::start()
     return false;
   }
 
-  pub = nh.advertise<sensor_msgs::Image>("output_image", 1, true);
-
   index = 0;
   annotator = DrawingAnnotator::getAnnotator(names[index]);
 
+  if(headless)
+  {
+    pubCompressed = nh.advertise<sensor_msgs::CompressedImage>("output_image/compressed", 1);
+    subAnnotator = headlessNh.subscribe("select_annotator", 1, &Visualizer::selectAnnotator, this);
+    running = true;
+    headlessThread = std::thread(&Visualizer::headlessViewer, this);
+    encoderThread = std::thread(&Visualizer::encoder, this);
+    return true;
+  }
+
+  pub = nh.advertise<sensor_msgs::Image>("output_image", 1, true);
+  DrawingAnnotator::setDisplayed(annotator);
+
   imageViewerThread = std::thread(&Visualizer::imageViewer, this);
   cloudViewerThread = std::thread(&Visualizer::cloudViewer, this);
   running = true;
@@ -75,9 +119,24 @@ void Visualizer::stop()
   if(running)
   {
     running = false;
-    imageViewerThread.join();
-    cloudViewerThread.join();
-    pub.shutdown();
+    if(headless)
+    {
+      headlessThread.join();
+      {
+        std::lock_guard<std::mutex> guard(encoderLock);
+        encoderCV.notify_all();
+      }
+      encoderThread.join();
+      subAnnotator.shutdown();
+      pubCompressed.shutdown();
+    }
+    else
+    {
+      imageViewerThread.join();
+      cloudViewerThread.join();
+      pub.shutdown();
+    }
+    DrawingAnnotator::setDisplayed(NULL);
   }
   outInfo("visualizer stopped!");
 }
@@ -92,6 +151,10 @@ void Visualizer::callbackMouseHandler(const int event, const int x, const int y)
   try
   {
     bool needupdate_img = annotator->callbackMouse(event, x, y, DrawingAnnotator::IMAGE_VIEWER);
+    if(needupdate_img)
+    {
+      annotator->invalidateSnapshot();
+    }
     updateImage = needupdate_img | updateImage;
     updateCloud = needupdate_img | updateCloud;
   }
@@ -115,6 +178,10 @@ void Visualizer::callbackKeyHandler(const char key, const DrawingAnnotator::Sour
   try
   {
     bool needupdate_img = annotator->callbackKey(key, source);
+    if(needupdate_img)
+    {
+      annotator->invalidateSnapshot();
+    }
     updateImage = needupdate_img | updateImage;
     updateCloud = needupdate_img | updateCloud;
   }
@@ -130,6 +197,7 @@ void Visualizer::nextAnnotator()
   DrawingAnnotator::getAnnotatorNames(names);
   index = (index + 1) % names.size();
   annotator = DrawingAnnotator::getAnnotator(names[index]);
+  DrawingAnnotator::setDisplayed(annotator);
   annotator->update = false;
   updateImage = true;
   updateCloud = true;
@@ -144,6 +212,7 @@ void Visualizer::prevAnnotator()
   DrawingAnnotator::getAnnotatorNames(names);
   index = (names.size() + index - 1) % names.size();
   annotator = DrawingAnnotator::getAnnotator(names[index]);
+  DrawingAnnotator::setDisplayed(annotator);
   annotator->update = false;
   updateImage = true;
   updateCloud = true;
@@ -152,6 +221,26 @@ void Visualizer::prevAnnotator()
   outDebug("switching to annotator: " << names[index]);
 }
 
+void Visualizer::selectAnnotator(const std_msgs::String::ConstPtr &msg)
+{
+  lock.lock();
+  DrawingAnnotator::getAnnotatorNames(names);
+  const std::vector<std::string>::const_iterator it = std::find(names.begin(), names.end(), msg->data);
+  if(it == names.end())
+  {
+    lock.unlock();
+    outWarn("unknown annotator: " << msg->data);
+    return;
+  }
+  index = it - names.begin();
+  annotator = DrawingAnnotator::getAnnotator(names[index]);
+  annotator->update = false;
+  updateImage = true;
+  changedAnnotator = true;
+  lock.unlock();
+  outDebug("switching to annotator: " << names[index]);
+}
+
 void Visualizer::checkAnnotator()
 {
   lock.lock();
@@ -255,6 +344,111 @@ void Visualizer::cloudViewer()
   visualizer->spinOnce(10);
 }
 
+void Visualizer::headlessViewer()
+{
+  cv::Mat disp;
+  const cv::Point pos(5, 15);
+  const cv::Scalar color = CV_RGB(255, 255, 255);
+  const double sizeText = 0.5;
+  const int lineText = 1;
+  const int font = cv::FONT_HERSHEY_SIMPLEX;
+
+  const std::chrono::steady_clock::duration period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / headlessRate));
+  std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+  bool watched = false;
+
+  while(ros::ok() && running)
+  {
+    std::this_thread::sleep_until(next);
+    next = std::max(next + period, std::chrono::steady_clock::now());
+    headlessQueue.callAvailable();
+
+    // Without a viewer no annotator is displayed, so none of them renders anything while processing.
+    // Otherwise the displayed one renders its image once per period and never its cloud.
+    const bool watching = !headlessFile.empty() || pubCompressed.getNumSubscribers() > 0;
+    lock.lock();
+    if(watching != watched || changedAnnotator)
+    {
+      DrawingAnnotator::setDisplayed(watching ? annotator : NULL, true);
+      updateImage = updateImage || watching;
+      changedAnnotator = false;
+      watched = watching;
+    }
+    DrawingAnnotator *current = annotator;
+    const std::string name = names[index];
+    lock.unlock();
+
+    if(!watching)
+    {
+      continue;
+    }
+    current->requestSnapshot();
+    checkAnnotator();
+    if(!updateImage)
+    {
+      continue;
+    }
+    updateImage = false;
+
+    current->drawImage(disp);
+    cv::putText(disp, "Annotator: " + name, pos, font, sizeText, color, lineText, CV_AA);
+
+    // a frame not yet picked up by the encoder is replaced
+    std::lock_guard<std::mutex> guard(encoderLock);
+    cv::swap(disp, encoderImage);
+    encoderPending = true;
+    encoderCV.notify_one();
+  }
+}
+
+void Visualizer::encoder()
+{
+  const bool png = headlessFormat == "png";
+  const std::string extension = png ? ".png" : ".jpg";
+  const std::string format = png ? "bgr8; png compressed bgr8" : "bgr8; jpeg compressed bgr8";
+  std::vector<int> params;
+  params.push_back(png ? CV_IMWRITE_PNG_COMPRESSION : CV_IMWRITE_JPEG_QUALITY);
+  params.push_back(png ? 1 : 90);
+
+  cv::Mat image;
+  sensor_msgs::CompressedImage msg;
+  msg.format = format;
+
+  std::unique_lock<std::mutex> guard(encoderLock);
+  for(;;)
+  {
+    while(!encoderPending && running)
+    {
+      encoderCV.wait(guard);
+    }
+    if(!running)
+    {
+      return;
+    }
+    cv::swap(image, encoderImage);
+    encoderPending = false;
+    guard.unlock();
+
+    msg.header.stamp = ros::Time::now();
+    if(!cv::imencode(extension, image, msg.data, params))
+    {
+      outError("could not encode image as " << headlessFormat << "!");
+    }
+    else
+    {
+      if(pubCompressed.getNumSubscribers() > 0)
+      {
+        pubCompressed.publish(msg);
+      }
+      if(!headlessFile.empty())
+      {
+        writeFile(msg.data);
+      }
+    }
+    guard.lock();
+  }
+}
+
 void Visualizer::keyboardEventImageViewer(const cv::Mat &disp)
 {
   const int key = cv::waitKey(10);
@@ -346,3 +540,15 @@ void Visualizer::saveCloud(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud,
   lock.unlock();
 }
 
+void Visualizer::writeFile(const std::vector<uchar> &data)
+{
+  // replaced by renaming, so that readers never see a partially written image
+  const std::string tmpFile = headlessFile + ".tmp";
+  std::ofstream file(tmpFile.c_str(), std::ios::binary | std::ios::trunc);
+  file.write((const char *)data.data(), data.size());
+  file.close();
+  if(!file || std::rename(tmpFile.c_str(), headlessFile.c_str()))
+  {
+    outError("could not write image to " << headlessFile << "!");
+  }
+}
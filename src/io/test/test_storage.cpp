@@ -0,0 +1,116 @@
+/**
+ * Copyright 2014 University of Bremen, Institute for Artificial Intelligence
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// STL
+#include <memory>
+#include <sstream>
+
+// GTest
+#include <gtest/gtest.h>
+
+// System
+#include <unistd.h>
+
+// RS
+#include <rs/io/Storage.h>
+
+/**
+ * Needs a MongoDB server on localhost, the tests pass without checking anything otherwise.
+ */
+class StorageTest : public ::testing::Test
+{
+protected:
+  std::string dbName;
+  std::unique_ptr<rs::Storage> storage;
+
+  void SetUp()
+  {
+    std::ostringstream oss;
+    oss << "rs_test_storage_" << getpid();
+    dbName = oss.str();
+    try
+    {
+      storage.reset(new rs::Storage(DB_HOST, dbName, true, false));
+    }
+    catch(const mongo::DBException &e)
+    {
+      std::cerr << "no MongoDB server available: " << e.what() << std::endl;
+    }
+  }
+
+  void TearDown()
+  {
+    if(storage)
+    {
+      mongo::DBClientConnection db;
+      db.connect(DB_HOST);
+      db.dropDatabase(dbName);
+    }
+  }
+};
+
+// deduplicated arrays reference the same document several times and in any order
+TEST_F(StorageTest, FetchesArraysInStoredOrder)
+{
+  if(!storage)
+  {
+    return;
+  }
+
+  const std::string collection = dbName + ".clusters";
+  std::vector<mongo::OID> ids(3);
+  rs::Storage::WriteBatch batch;
+  batch.timestamp = 42;
+  for(size_t i = 0; i < ids.size(); ++i)
+  {
+    ids[i].init();
+    rs::Storage::WriteBatch::SharedDocument document;
+    document.id = ids[i];
+    document.content = BSON("index" << (int)i);
+    document.references = 1;
+    batch.shared[collection].push_back(document);
+  }
+
+  const mongo::OID order[] = {ids[2], ids[0], ids[2], ids[1], ids[0], ids[0]};
+  const size_t count = sizeof(order) / sizeof(order[0]);
+  mongo::BSONObjBuilder scene;
+  scene.genOID();
+  scene.append("_timestamp", (long long)batch.timestamp);
+  scene.append("clusters", std::vector<mongo::OID>(order, order + count));
+  batch.scene = scene.obj();
+  ASSERT_TRUE(storage->writeBatch(batch));
+
+  rs::Storage::SceneData data;
+  ASSERT_TRUE(storage->fetchScene(batch.timestamp, data));
+  ASSERT_EQ(1u, data.views.size());
+  const rs::Storage::SceneData::View &view = data.views[0];
+  EXPECT_EQ("clusters", view.name);
+  EXPECT_TRUE(view.isArray);
+  ASSERT_EQ(count, view.objects.size());
+  for(size_t i = 0; i < count; ++i)
+  {
+    EXPECT_EQ(order[i], view.objects[i].getField("_id").OID());
+  }
+  EXPECT_EQ(2, view.objects[0].getIntField("index"));
+  EXPECT_EQ(0, view.objects[1].getIntField("index"));
+  EXPECT_EQ(1, view.objects[3].getIntField("index"));
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
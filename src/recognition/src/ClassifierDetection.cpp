@@ -40,7 +40,8 @@ class ClassifierDetection : public DrawingAnnotator
 {
 
 private:
-  cv::Mat color;
+  rs::ImageView color;
+  std::vector<std::pair<cv::Rect, std::string> > results;
 public:
   ClassifierDetection() : DrawingAnnotator(__func__)
   {
@@ -68,7 +69,8 @@ private:
     std::vector<std::string> classNames;
     std::vector<int32_t> responses;
 
-    cas.get(VIEW_COLOR_IMAGE_HD, color);
+    cas.getImageView(VIEW_COLOR_IMAGE_HD, color);
+    results.clear();
     std::vector<rs::Cluster> clusters;
     scene.identifiables.filter(clusters);
     outInfo("iterating over clusters");
@@ -115,15 +117,11 @@ private:
         detection.name.set(className);
         detection.source.set("KNNClassifierDetection");
         detection.confidence.set(respD.at<float>(0));
-        //draw result on image
+        //remember result for drawing, color is shared with the CAS and must not be modified
         rs::ImageROI image_roi = it->rois.get();
         cv::Rect rect;
         rs::conversion::from(image_roi.roi_hires.get(), rect);
-        cv::rectangle(color, rect, CV_RGB(255, 0, 0), 2);
-        int offset = 15;
-        int baseLine;
-        cv::Size textSize = cv::getTextSize(className, cv::FONT_HERSHEY_PLAIN, 1.5, 2.0, &baseLine);
-        cv::putText(color, className, cv::Point(rect.x + (rect.width - textSize.width) / 2, rect.y - offset - textSize.height), cv::FONT_HERSHEY_PLAIN, 1.5, CV_RGB(0, 0, 0), 2.0);
+        results.push_back(std::make_pair(rect, className));
       }
     }
 
@@ -133,6 +131,16 @@ private:
   void drawImageWithLock(cv::Mat &disp)
   {
     disp = color.clone();
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+      const cv::Rect &rect = results[i].first;
+      const std::string &className = results[i].second;
+      cv::rectangle(disp, rect, CV_RGB(255, 0, 0), 2);
+      int offset = 15;
+      int baseLine;
+      cv::Size textSize = cv::getTextSize(className, cv::FONT_HERSHEY_PLAIN, 1.5, 2.0, &baseLine);
+      cv::putText(disp, className, cv::Point(rect.x + (rect.width - textSize.width) / 2, rect.y - offset - textSize.height), cv::FONT_HERSHEY_PLAIN, 1.5, CV_RGB(0, 0, 0), 2.0);
+    }
   }
 
 };
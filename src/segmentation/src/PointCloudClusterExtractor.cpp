@@ -284,6 +284,21 @@ private:
     }
   }
 
+  void snapshotCloudWithLock(pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr &cloud, double &pointSize)
+  {
+    pcl::PointCloud<PointT>::Ptr colored(new pcl::PointCloud<PointT>(*cloud_ptr));
+    for(size_t i = 0; i < cluster_indices.size(); ++i)
+    {
+      const pcl::PointIndices &indices = cluster_indices[i];
+      for(size_t j = 0; j < indices.indices.size(); ++j)
+      {
+        colored->points[indices.indices[j]].rgba = rs::common::colors[i % rs::common::numberOfColors];
+      }
+    }
+    cloud = colored;
+    pointSize = this->pointSize;
+  }
+
   void cloudPreProcessing(const pcl::PointCloud<PointT>::Ptr &cloud,
                           const pcl::ModelCoefficients::Ptr &plane_coeffs,
                           const pcl::PointIndices::Ptr &plane_inliers,
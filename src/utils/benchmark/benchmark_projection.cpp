@@ -0,0 +1,86 @@
+/**
+ * Copyright 2014 University of Bremen, Institute for Artificial Intelligence
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// STL
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+// RS
+#include <rs/utils/DepthImageProcessing.h>
+
+namespace dip = rs::DepthImageProcessing;
+
+/**
+ * Times rs::DepthImageProcessing::project with every supported instruction set on the usual
+ * camera resolutions. Usage: benchmark_projection [iterations]
+ */
+int main(int argc, char **argv)
+{
+  const int iterations = argc > 1 ? std::max(1, atoi(argv[1])) : 100;
+  const int sizes[][2] = {{640, 480}, {512, 424}, {1920, 1080}};
+  const dip::InstructionSet sets[] = {dip::INSTRUCTIONS_SCALAR, dip::INSTRUCTIONS_SSE41, dip::INSTRUCTIONS_AVX2};
+  const char *names[] = {"scalar", "sse4.1", "avx2"};
+
+  std::mt19937 rng(1);
+  for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+  {
+    const int width = sizes[i][0], height = sizes[i][1];
+    cv::Mat depth(height, width, CV_16U), color(height, width, CV_8UC3), alpha(height, width, CV_8U);
+    cv::Mat lookupX(1, width, CV_32F), lookupY(1, height, CV_32F);
+    for(int r = 0; r < height; ++r)
+    {
+      for(int c = 0; c < width; ++c)
+      {
+        // a few invalid pixels, like a real depth image
+        depth.at<uint16_t>(r, c) = rng() % 10 ? 500 + rng() % 4000 : 0;
+        color.at<cv::Vec3b>(r, c) = cv::Vec3b(rng(), rng(), rng());
+        alpha.at<uint8_t>(r, c) = 0;
+      }
+    }
+    for(int c = 0; c < width; ++c)
+    {
+      lookupX.at<float>(0, c) = (c - width * 0.5f) / 525.0f;
+    }
+    for(int r = 0; r < height; ++r)
+    {
+      lookupY.at<float>(0, r) = (r - height * 0.5f) / 525.0f;
+    }
+
+    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGBA>());
+    for(size_t j = 0; j < sizeof(sets) / sizeof(sets[0]); ++j)
+    {
+      if(!dip::isSupported(sets[j]))
+      {
+        printf("%4dx%-4d %-7s not supported\n", width, height, names[j]);
+        continue;
+      }
+
+      // the first run allocates the cloud
+      dip::project(depth, color, alpha, lookupX, lookupY, cloud, sets[j]);
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      for(int k = 0; k < iterations; ++k)
+      {
+        dip::project(depth, color, alpha, lookupX, lookupY, cloud, sets[j]);
+      }
+      const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / iterations;
+      printf("%4dx%-4d %-7s %8.3f ms\n", width, height, names[j], ms);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,81 @@
+/**
+ * Copyright 2014 University of Bremen, Institute for Artificial Intelligence
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// STL
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+// RS
+#include <rs/utils/DepthImageProcessing.h>
+
+namespace dip = rs::DepthImageProcessing;
+
+/**
+ * Times the depth smoothing filters of rs::DepthImageProcessing on the usual camera resolutions,
+ * with the defaults of the ImagePreprocessor. Usage: benchmark_smoothing [iterations]
+ */
+int main(int argc, char **argv)
+{
+  const int iterations = argc > 1 ? std::max(1, atoi(argv[1])) : 20;
+  const int sizes[][2] = {{640, 480}, {512, 424}, {1920, 1080}};
+  const float sigmaSpace = 8.0f, sigmaRange = 30.0f;
+  const char *names[] = {"domain", "guided", "grid"};
+
+  std::mt19937 rng(1);
+  for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+  {
+    const int width = sizes[i][0], height = sizes[i][1];
+    cv::Mat depth(height, width, CV_16U), guide(height, width, CV_8U);
+    for(int r = 0; r < height; ++r)
+    {
+      for(int c = 0; c < width; ++c)
+      {
+        // a few invalid pixels and a step, like a real depth image
+        depth.at<uint16_t>(r, c) = rng() % 10 ? (c < width / 2 ? 1000 : 2000) + rng() % 50 : 0;
+        guide.at<uint8_t>(r, c) = (c < width / 2 ? 60 : 180) + rng() % 16;
+      }
+    }
+
+    for(int j = 0; j < 3; ++j)
+    {
+      double ms = 0;
+      for(int k = 0; k < iterations; ++k)
+      {
+        // the filters work in place, so every run gets a fresh copy that is not timed
+        cv::Mat image = depth.clone();
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        switch(j)
+        {
+        case 0:
+          dip::domainTransformSmoothing(image, sigmaSpace, sigmaRange);
+          break;
+        case 1:
+          dip::guidedSmoothing(image, guide, (int)(sigmaSpace + 0.5f), sigmaRange);
+          break;
+        case 2:
+          dip::bilateralGridSmoothing(image, guide, sigmaSpace, sigmaRange);
+          break;
+        }
+        ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      }
+      printf("%4dx%-4d %-7s %8.3f ms\n", width, height, names[j], ms / iterations);
+    }
+  }
+  return 0;
+}
@@ -32,8 +32,39 @@ namespace rs
 namespace DepthImageProcessing
 {
 
+/*
+ * Instruction sets of the vectorized kernels. By default the best one supported by the CPU is used,
+ * forcing another one is meant for tests and benchmarks.
+ */
+enum InstructionSet
+{
+  INSTRUCTIONS_BEST = 0,
+  INSTRUCTIONS_SCALAR,
+  INSTRUCTIONS_SSE41,
+  INSTRUCTIONS_AVX2
+};
+
+// whether the CPU and the point layout allow the kernels to use set
+bool isSupported(const InstructionSet set);
+
 void fillHoles(cv::Mat &image);
-void project(const cv::Mat &depth, const cv::Mat &color, const cv::Mat &alpha, const cv::Mat &lookupX, const cv::Mat &lookupY, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud);
+// unsupported instruction sets fall back to the scalar kernel
+void project(const cv::Mat &depth, const cv::Mat &color, const cv::Mat &alpha, const cv::Mat &lookupX, const cv::Mat &lookupY, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud,
+             const InstructionSet set = INSTRUCTIONS_BEST);
+
+/*
+ * Edge preserving smoothing of CV_16U depth images. Invalid (zero) pixels are ignored and stay
+ * invalid. Spatial sigmas and radii are given in pixels. The guides are CV_8U gray images with the
+ * size of the depth image, their range sigmas are given in gray values.
+ */
+
+// recursive domain transform filter, sigmaRange in depth units; sigmaSpace of 4 or more is filtered on cells of
+// sigmaSpace / 2 pixels and upsampled with depth weights
+void domainTransformSmoothing(cv::Mat &depth, const float sigmaSpace, const float sigmaRange, const int iterations = 3);
+// fast guided filter with the guide image
+void guidedSmoothing(cv::Mat &depth, const cv::Mat &guide, const int radius, const float sigmaRange);
+// joint bilateral filter on a grid with one cell per sigma
+void bilateralGridSmoothing(cv::Mat &depth, const cv::Mat &guide, const float sigmaSpace, const float sigmaRange);
 
 }
 } // end namespace
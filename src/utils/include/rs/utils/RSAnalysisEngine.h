@@ -26,6 +26,11 @@
 
 #include <uima/api.hpp>
 
+#include <string>
+#include <vector>
+
+class RSParallelScheduler;
+
 class RSAnalysisEngine
 {
 public:
@@ -35,6 +40,8 @@ public:
 protected:
   uima::AnalysisEngine *engine;
   uima::CAS *cas;
+  RSParallelScheduler *scheduler;
+  rs::LatencyHistogram *latency;
 
 public:
 
@@ -48,14 +55,49 @@ public:
 
   virtual void process();
 
-  inline void resetCas()
-  {
-    cas->reset();
-  }
+  void resetCas();
+
   uima::CAS* getCas()
   {
       return cas;
   }
 
+  /**
+   * Gets the latency histogram of this engine, available after init.
+   */
+  rs::LatencyHistogram *getLatency()
+  {
+    return latency;
+  }
+
+  /**
+   * Creates an additional CAS for this engine, e.g. to have several frames in flight. The caller
+   * takes ownership and has to clear its caches (rs::SceneCas::clearCache) before deleting it.
+   */
+  uima::CAS *newCas();
+
+  /**
+   * Gets the names of the annotators of the fixed flow. Returns false if the engine is not an
+   * aggregate with a fixed flow.
+   */
+  bool getFlow(std::vector<std::string> &annotators) const;
+
+  /**
+   * Gets the engine of the annotator at index of the fixed flow.
+   */
+  uima::AnalysisEngine *getDelegate(const size_t index);
+
+  /**
+   * Runs independent annotators of the fixed flow in parallel in process(). Returns false if the
+   * engine is not an aggregate with a fixed flow.
+   */
+  bool enableParallelProcessing(const size_t threads = 0);
+
+  /**
+   * Processes cas with the annotators [begin, end) of the fixed flow. Returns false if the frame
+   * was filtered or processing failed, in which case the remaining annotators should be skipped.
+   */
+  bool processFlow(uima::CAS &cas, const size_t begin, const size_t end);
+
 };
 #endif // RSANALYSISENGINE_H
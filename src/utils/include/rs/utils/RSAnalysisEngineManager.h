@@ -20,20 +20,115 @@
 #ifndef RSANALYSISENGINEMANAGER_H
 #define RSANALYSISENGINEMANAGER_H
 
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <algorithm>
+
+#include <ros/ros.h>
+#include <std_msgs/String.h>
+
 #include <rs/utils/RSAnalysisEngine.h>
 #include <rs/io/visualizer.h>
+#include <rs/scene_cas.h>
 
 template <class AEType>
 class RSAnalysisEngineManager
 {
 protected:
+  /**
+   * A CAS traveling through the stages of a pipelined engine.
+   */
+  struct Frame
+  {
+    uima::CAS *cas;
+    uint64_t number;
+    bool dropped;
+    rs::StopWatch clock;
+  };
+
+  /**
+   * Queue between two stages. It needs no size limit of its own, the number of frames in flight
+   * is bounded by the number of CASes.
+   */
+  class FrameQueue
+  {
+  private:
+    std::mutex lock;
+    std::condition_variable cv;
+    std::deque<Frame> frames;
+    bool closed;
+
+  public:
+    FrameQueue() : closed(false)
+    {
+    }
+
+    void push(const Frame &frame)
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      frames.push_back(frame);
+      cv.notify_one();
+    }
+
+    bool pop(Frame &frame)
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      while(frames.empty() && !closed)
+      {
+        cv.wait(guard);
+      }
+      if(closed)
+      {
+        return false;
+      }
+      frame = frames.front();
+      frames.pop_front();
+      return true;
+    }
+
+    bool pop(Frame &frame, const std::chrono::milliseconds &timeout)
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      if(!cv.wait_for(guard, timeout, [this]() { return !frames.empty() || closed; }) || closed)
+      {
+        return false;
+      }
+      frame = frames.front();
+      frames.pop_front();
+      return true;
+    }
+
+    void close()
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      closed = true;
+      cv.notify_all();
+    }
+  };
+
   std::vector<AEType> engines;
 
   const bool useVisualizer;
   rs::Visualizer visualizer;
 
+  size_t casesInFlight;
+  std::vector<std::string> cutPoints;
+  std::vector<std::string> parallelEngines;
+
+  double latencyPeriod;
+  std::string latencyFile;
+  ros::Publisher latencyPub;
+  std::thread latencyThread;
+  std::mutex latencyLock;
+  std::condition_variable latencyCV;
+  bool latencyRunning;
+
 public:
-  RSAnalysisEngineManager(const bool useVisualizer, const std::string &savePath): useVisualizer(useVisualizer), visualizer(savePath)
+  RSAnalysisEngineManager(const bool useVisualizer, const std::string &savePath): useVisualizer(useVisualizer), visualizer(savePath), casesInFlight(1),
+    latencyPeriod(0.0), latencyRunning(false)
   {
     // Create/link up to a UIMACPP resource manager instance (singleton)
     outInfo("Creating resource manager"); // TODO: DEBUG
@@ -65,15 +160,82 @@ public:
     for(size_t i = 0; i < engines.size(); ++i)
     {
       engines[i].init(files[i]);
+
+      const size_t start = files[i].rfind('/') + 1;
+      const std::string engineName = files[i].substr(start, files[i].rfind(".xml") - start);
+      if(std::find(parallelEngines.begin(), parallelEngines.end(), engineName) != parallelEngines.end()
+         && !engines[i].enableParallelProcessing())
+      {
+        outWarn("analysis engine " << engineName << " has no fixed flow, processing sequentially.");
+      }
     }
     if(useVisualizer)
     {
       visualizer.start();
     }
+    if(latencyPeriod > 0.0)
+    {
+      ros::NodeHandle nh("~");
+      latencyPub = nh.advertise<std_msgs::String>("latency", 1, true);
+      latencyRunning = true;
+      latencyThread = std::thread(&RSAnalysisEngineManager::reportLatency, this);
+    }
+  }
+
+  /**
+   * Enables pipelined execution with up to casesInFlight frames processed at the same time. The
+   * fixed flow is split into stages in front of each annotator named in cutPoints, every stage
+   * runs in its own thread. Frames are finished in the order they entered the pipeline. Only
+   * used if there is a single aggregate engine, casesInFlight <= 1 disables it.
+   */
+  void setPipelining(const size_t casesInFlight, const std::vector<std::string> &cutPoints)
+  {
+    this->casesInFlight = casesInFlight;
+    this->cutPoints = cutPoints;
+  }
+
+  /**
+   * Runs independent annotators of the given analysis engines (file names without ".xml") in
+   * parallel, based on the capabilities declared in their descriptors. Has to be called before init.
+   */
+  void setParallelEngines(const std::vector<std::string> &names)
+  {
+    parallelEngines = names;
+  }
+
+  /**
+   * Publishes snapshots of the latency histograms (see rs::LatencyRegistry) as JSON on the topic
+   * "~latency" every period seconds and writes them to file, if given. Has to be called before init,
+   * period <= 0 disables it.
+   */
+  void setLatencyReporting(const double period, const std::string &file)
+  {
+    latencyPeriod = period;
+    latencyFile = file;
+  }
+
+  /**
+   * Runs the visualizer without windows, see rs::Visualizer::setHeadless. Has to be called before
+   * init, only used if the visualizer is enabled.
+   */
+  void setHeadlessVisualization(const double rate, const std::string &format, const std::string &file)
+  {
+    visualizer.setHeadless(rate, format, file);
   }
 
   virtual void run()
   {
+    if(casesInFlight > 1)
+    {
+      std::vector<size_t> stages;
+      if(engines.size() == 1 && getStages(engines[0], stages))
+      {
+        runPipelined(engines[0], stages);
+        return;
+      }
+      outWarn("pipelining needs a single aggregate engine with a fixed flow, processing sequentially.");
+    }
+
     for(; ros::ok();)
     {
       for(size_t i = 0; i < engines.size(); ++i)
@@ -84,12 +246,169 @@ public:
     }
   }
 
+protected:
+  /**
+   * Gets the index of the first annotator of each stage, followed by the number of annotators.
+   */
+  bool getStages(AEType &engine, std::vector<size_t> &stages)
+  {
+    std::vector<std::string> flow;
+    if(!engine.getFlow(flow))
+    {
+      return false;
+    }
+
+    stages.clear();
+    stages.push_back(0);
+    for(size_t i = 0; i < cutPoints.size(); ++i)
+    {
+      const size_t index = std::find(flow.begin(), flow.end(), cutPoints[i]) - flow.begin();
+      if(index == flow.size())
+      {
+        outWarn("cut point " << cutPoints[i] << " is not part of the fixed flow, ignoring it.");
+        continue;
+      }
+      stages.push_back(index);
+    }
+    stages.push_back(flow.size());
+    std::sort(stages.begin(), stages.end());
+    stages.erase(std::unique(stages.begin(), stages.end()), stages.end());
+
+    outInfo("pipelining " << casesInFlight << " CASes through " << stages.size() - 1 << " stages:");
+    for(size_t s = 0; s + 1 < stages.size(); ++s)
+    {
+      outInfo("  stage " << s << ": " FG_BLUE << flow[stages[s]] << NO_COLOR " ... " FG_BLUE << flow[stages[s + 1] - 1]);
+    }
+    return true;
+  }
+
+  void runPipelined(AEType &engine, const std::vector<size_t> &stages)
+  {
+    const size_t stageCount = stages.size() - 1;
+
+    // queues[0] holds the free CASes, queues[stageCount] the finished frames
+    std::vector<FrameQueue> queues(stageCount + 1);
+    std::vector<uima::CAS *> cases;
+    cases.push_back(engine.getCas());
+    for(size_t i = 1; i < casesInFlight; ++i)
+    {
+      cases.push_back(engine.newCas());
+    }
+
+    uint64_t nextFrame = 0;
+    for(size_t i = 0; i < cases.size(); ++i)
+    {
+      Frame frame;
+      frame.cas = cases[i];
+      frame.number = nextFrame++;
+      frame.dropped = false;
+      queues[0].push(frame);
+    }
+
+    std::vector<std::thread> threads;
+    for(size_t s = 0; s < stageCount; ++s)
+    {
+      threads.push_back(std::thread([&engine, &queues, &stages, s]()
+      {
+        Frame frame;
+        while(queues[s].pop(frame))
+        {
+          if(!frame.dropped)
+          {
+            frame.dropped = !engine.processFlow(*frame.cas, stages[s], stages[s + 1]);
+          }
+          queues[s + 1].push(frame);
+        }
+      }));
+    }
+
+    Frame frame;
+    while(ros::ok())
+    {
+      if(!queues[stageCount].pop(frame, std::chrono::milliseconds(100)))
+      {
+        continue;
+      }
+      const double time = frame.clock.getTime();
+      engine.getLatency()->add(time);
+      if(frame.dropped)
+      {
+        engine.getLatency()->addDropped();
+      }
+      outInfo("frame " << frame.number << (frame.dropped ? " dropped" : " finished") << " after " << time << " ms.");
+      rs::SceneCas::clearCache(*frame.cas);
+      frame.cas->reset();
+
+      frame.number = nextFrame++;
+      frame.dropped = false;
+      frame.clock.reset();
+      queues[0].push(frame);
+    }
+
+    for(size_t i = 0; i < queues.size(); ++i)
+    {
+      queues[i].close();
+    }
+    for(size_t i = 0; i < threads.size(); ++i)
+    {
+      threads[i].join();
+    }
+
+    // the first CAS belongs to the engine, it is reset in stop()
+    for(size_t i = 1; i < cases.size(); ++i)
+    {
+      rs::SceneCas::clearCache(*cases[i]);
+      delete cases[i];
+    }
+  }
+
+  void publishLatency()
+  {
+    std::vector<rs::LatencyHistogram::Snapshot> snapshots;
+    rs::LatencyRegistry::instance().snapshot(snapshots);
+
+    std::ostringstream oss;
+    rs::LatencyRegistry::writeJSON(oss, snapshots);
+    std_msgs::String msg;
+    msg.data = oss.str();
+    latencyPub.publish(msg);
+
+    if(!latencyFile.empty())
+    {
+      rs::LatencyRegistry::instance().dump(latencyFile);
+    }
+  }
+
+  void reportLatency()
+  {
+    std::unique_lock<std::mutex> guard(latencyLock);
+    const std::chrono::milliseconds period((int64_t)(latencyPeriod * 1000.0));
+    while(latencyRunning)
+    {
+      if(!latencyCV.wait_for(guard, period, [this]() { return !latencyRunning; }))
+      {
+        publishLatency();
+      }
+    }
+    publishLatency();
+  }
+
+public:
   void stop()
   {
     if(useVisualizer)
     {
       visualizer.stop();
     }
+    if(latencyThread.joinable())
+    {
+      {
+        std::lock_guard<std::mutex> guard(latencyLock);
+        latencyRunning = false;
+        latencyCV.notify_all();
+      }
+      latencyThread.join();
+    }
     for(size_t i = 0; i < engines.size(); ++i)
     {
       engines[i].resetCas();
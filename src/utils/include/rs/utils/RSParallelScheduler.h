@@ -0,0 +1,108 @@
+/**
+ * Copyright 2014 University of Bremen, Institute for Artificial Intelligence
+ * Author(s): Ferenc Balint-Benczedi <balintbe@cs.uni-bremen.de>
+ *         Thiemo Wiedemeyer <wiedemeyer@cs.uni-bremen.de>
+ *         Jan-Hendrik Worch <jworch@cs.uni-bremen.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RSPARALLELSCHEDULER_H
+#define RSPARALLELSCHEDULER_H
+
+#include <set>
+#include <deque>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <uima/api.hpp>
+
+#include <rs/utils/write_gate.h>
+
+class RSAnalysisEngine;
+
+/**
+ * Runs the annotators of an aggregate engine in parallel where their declared capabilities allow
+ * it. An annotator depends on every earlier annotator of the fixed flow that writes a type or sofa
+ * it reads or writes, or reads one it writes. Annotators declaring no capabilities at all are run
+ * after all earlier and before all later ones.
+ *
+ * Annotators are started in flow order as soon as their dependencies are done. Their writes to the
+ * CAS (see rs::WriteGate) are held back until all earlier annotators have finished, so that the CAS
+ * is written in the same order as by sequential processing.
+ */
+class RSParallelScheduler
+{
+private:
+  struct Node
+  {
+    std::string name;
+    std::set<std::string> reads;
+    std::set<std::string> writes;
+    std::vector<size_t> successors;
+    size_t dependencies;
+  };
+
+  class Gate : public rs::WriteGate
+  {
+  public:
+    RSParallelScheduler *scheduler;
+    size_t index;
+
+    void wait();
+  };
+
+  RSAnalysisEngine &engine;
+  std::vector<Node> nodes;
+  std::vector<Gate> gates;
+
+  std::vector<std::thread> workers;
+  std::mutex lock;
+  std::condition_variable cvTasks;
+  std::condition_variable cvDone;
+  std::deque<size_t> tasks;
+  bool running;
+
+  // state of the frame being processed, guarded by lock
+  uima::CAS *cas;
+  std::vector<size_t> pending;
+  std::vector<bool> finished;
+  std::vector<double> times;
+  size_t finishedCount;
+  size_t finishedPrefix;
+  bool dropped;
+
+  void worker();
+  void waitForTurn(const size_t index);
+  bool dependsOn(const uima::TypeSystem &ts, const Node &later, const Node &earlier) const;
+
+public:
+  RSParallelScheduler(RSAnalysisEngine &engine);
+  ~RSParallelScheduler();
+
+  /**
+   * Builds the dependency graph from the capabilities of the delegates and starts the workers.
+   * Returns false if the engine is no aggregate with a fixed flow.
+   */
+  bool init(const uima::TypeSystem &ts, const size_t threads = 0);
+
+  /**
+   * Processes cas with all annotators. Returns false if the frame was filtered or processing failed.
+   */
+  bool process(uima::CAS &cas);
+};
+
+#endif // RSPARALLELSCHEDULER_H
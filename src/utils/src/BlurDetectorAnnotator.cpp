@@ -38,7 +38,8 @@ class BlurDetectorAnnotator : public DrawingAnnotator
 {
 private:
   BlurDetector detector;
-  cv::Mat color, grey;
+  rs::ImageView color;
+  cv::Mat grey;
 
   typedef double(*function)(const cv::Mat &img);
   std::vector<function> functions;
@@ -126,8 +127,8 @@ private:
     outInfo("process begins");
     rs::SceneCas cas(tcas);
 
-    cas.get(VIEW_COLOR_IMAGE_HD, color);
-    cv::cvtColor(color, grey, CV_BGR2GRAY);
+    cas.getImageView(VIEW_COLOR_IMAGE_HD, color);
+    cv::cvtColor(color.get(), grey, CV_BGR2GRAY);
 
     ros::Time start, end;
     double result;
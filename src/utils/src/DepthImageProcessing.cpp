@@ -17,281 +17,1148 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
 #include <rs/utils/DepthImageProcessing.h>
 #include <rs/utils/output.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RS_SIMD_X86
+#include <immintrin.h>
+
+static bool haveSSE41()
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse4.1");
+}
+#endif
+
+/******************************************************************************
+ * Hole filling kernels
+ *****************************************************************************/
+
+static void binomialRowScalar(const uint16_t *predecessor, const uint16_t *center, const uint16_t *successor, uint16_t *centerOutput,
+                              const int begin, const int end, const uint16_t minValue, const uint16_t maxValue)
+{
+  for(int x = begin; x < end; ++x)
+  {
+    // 3x3-Umgebung
+    // v0 v1 v2
+    // v3 v4 v5
+    // v6 v7 v8
+    const uint16_t v[9] = {predecessor[x - 1], predecessor[x], predecessor[x + 1],
+                           center[x - 1], center[x], center[x + 1],
+                           successor[x - 1], successor[x], successor[x + 1]
+                          };
+    const int weights[9] = {1, 2, 1, 2, 4, 2, 1, 2, 1};
+
+    int sum = 0, count = 0;
+    for(int i = 0; i < 9; ++i)
+    {
+      const int valid = v[i] >= minValue && v[i] <= maxValue;
+      sum += valid * weights[i] * v[i];
+      count += valid * weights[i];
+    }
+    centerOutput[x] = count ? sum / count : v[4];
+  }
+}
+
+static void downsamplingRowScalar(const uint16_t *predecessor, const uint16_t *center, uint16_t *centerOut,
+                                  const int begin, const int end, const uint16_t minValue, const uint16_t maxValue)
+{
+  for(int xOut = begin; xOut < end; ++xOut)
+  {
+    const int x = 2 * xOut + 1;
+    const uint16_t v[4] = {predecessor[x - 1], predecessor[x], center[x - 1], center[x]};
+
+    int sum = 0, count = 0;
+    for(int i = 0; i < 4; ++i)
+    {
+      const int valid = v[i] >= minValue && v[i] <= maxValue;
+      sum += valid * v[i];
+      count += valid;
+    }
+    centerOut[xOut] = count ? sum / count : v[0];
+  }
+}
+
+#ifdef RS_SIMD_X86
+
+/*
+ * Both kernels mask invalid values instead of branching on them. Sums are accumulated in 32 bit and
+ * divided in float, which is exact for these ranges, so the results equal the scalar ones.
+ */
+
+__attribute__((target("sse4.1")))
+static inline __m128i inRangeSSE(const __m128i v, const __m128i minValue, const __m128i maxValue)
+{
+  return _mm_cmpeq_epi16(_mm_min_epu16(_mm_max_epu16(v, minValue), maxValue), v);
+}
+
+__attribute__((target("sse4.1")))
+static inline void accumulateSSE(const uint16_t *values, const int shift, const __m128i minValue, const __m128i maxValue,
+                                 __m128i &sumLo, __m128i &sumHi, __m128i &count)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i v = _mm_loadu_si128((const __m128i *)values);
+  const __m128i valid = inRangeSSE(v, minValue, maxValue);
+  const __m128i masked = _mm_and_si128(v, valid);
+
+  sumLo = _mm_add_epi32(sumLo, _mm_slli_epi32(_mm_unpacklo_epi16(masked, zero), shift));
+  sumHi = _mm_add_epi32(sumHi, _mm_slli_epi32(_mm_unpackhi_epi16(masked, zero), shift));
+  count = _mm_add_epi16(count, _mm_slli_epi16(_mm_srli_epi16(valid, 15), shift));
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i divideSSE(const __m128i sumLo, const __m128i sumHi, const __m128i count, const __m128i fallback)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i noValue = _mm_cmpeq_epi16(count, zero);
+  // zero counts divide by one, they are replaced by the fallback anyway
+  const __m128i divisor = _mm_or_si128(count, _mm_srli_epi16(noValue, 15));
+
+  const __m128i lo = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(sumLo), _mm_cvtepi32_ps(_mm_unpacklo_epi16(divisor, zero))));
+  const __m128i hi = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(sumHi), _mm_cvtepi32_ps(_mm_unpackhi_epi16(divisor, zero))));
+  return _mm_blendv_epi8(_mm_packus_epi32(lo, hi), fallback, noValue);
+}
+
+__attribute__((target("sse4.1")))
+static void binomialRowSSE(const uint16_t *predecessor, const uint16_t *center, const uint16_t *successor, uint16_t *centerOutput,
+                           const int begin, const int end, const uint16_t minValue, const uint16_t maxValue)
+{
+  const __m128i minV = _mm_set1_epi16((short)minValue);
+  const __m128i maxV = _mm_set1_epi16((short)maxValue);
+
+  int x = begin;
+  for(; x + 8 <= end; x += 8)
+  {
+    __m128i sumLo = _mm_setzero_si128(), sumHi = _mm_setzero_si128(), count = _mm_setzero_si128();
+    accumulateSSE(predecessor + x - 1, 0, minV, maxV, sumLo, sumHi, count);
+    accumulateSSE(predecessor + x, 1, minV, maxV, sumLo, sumHi, count);
+    accumulateSSE(predecessor + x + 1, 0, minV, maxV, sumLo, sumHi, count);
+    accumulateSSE(center + x - 1, 1, minV, maxV, sumLo, sumHi, count);
+    accumulateSSE(center + x, 2, minV, maxV, sumLo, sumHi, count);
+    accumulateSSE(center + x + 1, 1, minV, maxV, sumLo, sumHi, count);
+    accumulateSSE(successor + x - 1, 0, minV, maxV, sumLo, sumHi, count);
+    accumulateSSE(successor + x, 1, minV, maxV, sumLo, sumHi, count);
+    accumulateSSE(successor + x + 1, 0, minV, maxV, sumLo, sumHi, count);
+
+    const __m128i v4 = _mm_loadu_si128((const __m128i *)(center + x));
+    _mm_storeu_si128((__m128i *)(centerOutput + x), divideSSE(sumLo, sumHi, count, v4));
+  }
+  binomialRowScalar(predecessor, center, successor, centerOutput, x, end, minValue, maxValue);
+}
+
+__attribute__((target("sse4.1")))
+static inline void pairsSSE(const uint16_t *values, const __m128i minValue, const __m128i maxValue, __m128i &sum, __m128i &count)
+{
+  const __m128i low = _mm_set1_epi32(0xFFFF);
+  const __m128i v = _mm_loadu_si128((const __m128i *)values);
+  const __m128i valid = inRangeSSE(v, minValue, maxValue);
+  const __m128i masked = _mm_and_si128(v, valid);
+  const __m128i ones = _mm_srli_epi16(valid, 15);
+
+  // adds the two 16 bit values of each 32 bit lane
+  sum = _mm_add_epi32(sum, _mm_add_epi32(_mm_and_si128(masked, low), _mm_srli_epi32(masked, 16)));
+  count = _mm_add_epi32(count, _mm_add_epi32(_mm_and_si128(ones, low), _mm_srli_epi32(ones, 16)));
+}
+
+__attribute__((target("sse4.1")))
+static void downsamplingRowSSE(const uint16_t *predecessor, const uint16_t *center, uint16_t *centerOut,
+                               const int begin, const int end, const uint16_t minValue, const uint16_t maxValue)
+{
+  const __m128i minV = _mm_set1_epi16((short)minValue);
+  const __m128i maxV = _mm_set1_epi16((short)maxValue);
+  const __m128i low = _mm_set1_epi32(0xFFFF);
+
+  int xOut = begin;
+  for(; xOut + 8 <= end; xOut += 8)
+  {
+    const int x = 2 * xOut;
+    __m128i sumLo = _mm_setzero_si128(), sumHi = _mm_setzero_si128(), countLo = _mm_setzero_si128(), countHi = _mm_setzero_si128();
+    pairsSSE(predecessor + x, minV, maxV, sumLo, countLo);
+    pairsSSE(center + x, minV, maxV, sumLo, countLo);
+    pairsSSE(predecessor + x + 8, minV, maxV, sumHi, countHi);
+    pairsSSE(center + x + 8, minV, maxV, sumHi, countHi);
+
+    const __m128i count = _mm_packus_epi32(countLo, countHi);
+    const __m128i v0 = _mm_packus_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i *)(predecessor + x)), low),
+                                        _mm_and_si128(_mm_loadu_si128((const __m128i *)(predecessor + x + 8)), low));
+    _mm_storeu_si128((__m128i *)(centerOut + xOut), divideSSE(sumLo, sumHi, count, v0));
+  }
+  downsamplingRowScalar(predecessor, center, centerOut, xOut, end, minValue, maxValue);
+}
+
+#endif // RS_SIMD_X86
+
+typedef void (*BinomialRow)(const uint16_t *, const uint16_t *, const uint16_t *, uint16_t *, const int, const int, const uint16_t, const uint16_t);
+typedef void (*DownsamplingRow)(const uint16_t *, const uint16_t *, uint16_t *, const int, const int, const uint16_t, const uint16_t);
+
 void selectiveBinomialFiltering(const cv::Mat &input, cv::Mat &output, const uint16_t minValue, const uint16_t maxValue)
 {
+#ifdef RS_SIMD_X86
+  static const BinomialRow filterRow = haveSSE41() ? &binomialRowSSE : &binomialRowScalar;
+#else
+  static const BinomialRow filterRow = &binomialRowScalar;
+#endif
+
   output.create(input.rows, input.cols, input.type());
 
-  int rowsEnd = input.rows - 1;
-  int colsEnd = input.cols - 1;
+  const int rowsEnd = input.rows - 1;
+  const int colsEnd = input.cols - 1;
 
-  for(int y = 1; y < rowsEnd; y++)
+  #pragma omp parallel for
+  for(int y = 0; y < input.rows; ++y)
   {
-    const uint16_t *predecessor = input.ptr<uint16_t>(y - 1);
     const uint16_t *center = input.ptr<uint16_t>(y);
-    const uint16_t *successor = input.ptr<uint16_t>(y + 1);
-
     uint16_t *centerOutput = output.ptr<uint16_t>(y);
-    for(int x = 1; x < colsEnd; x++)
+
+    // Bildränder nicht filtern
+    if(y == 0 || y == rowsEnd || colsEnd < 1)
     {
-      // 3x3-Umgebung
-      // v0 v1 v2
-      // v3 v4 v5
-      // v6 v7 v8
+      memcpy(centerOutput, center, input.cols * sizeof(uint16_t));
+      continue;
+    }
+    filterRow(input.ptr<uint16_t>(y - 1), center, input.ptr<uint16_t>(y + 1), centerOutput, 1, colsEnd, minValue, maxValue);
+    centerOutput[0] = center[0];
+    centerOutput[colsEnd] = center[colsEnd];
+  }
+}
 
-      uint16_t sum = 0;
-      int count = 0;
+void selectiveDownsampling(const cv::Mat &input, cv::Mat &output, const uint16_t minValue, const uint16_t maxValue)
+{
+#ifdef RS_SIMD_X86
+  static const DownsamplingRow downsampleRow = haveSSE41() ? &downsamplingRowSSE : &downsamplingRowScalar;
+#else
+  static const DownsamplingRow downsampleRow = &downsamplingRowScalar;
+#endif
 
-      const uint16_t v0 = predecessor[x - 1];
-      if(v0 >= minValue && v0 <= maxValue)
-      {
-        sum += v0;
-        ++count;
-      }
-      const uint16_t v2 = predecessor[x + 1];
-      if(v2 >= minValue && v2 <= maxValue)
-      {
-        sum += v2;
-        ++count;
-      }
-      const uint16_t v6 = successor[x - 1];
-      if(v6 >= minValue && v6 <= maxValue)
-      {
-        sum += v6;
-        ++count;
-      }
-      const uint16_t v8 = successor[x + 1];
-      if(v8 >= minValue && v8 <= maxValue)
-      {
-        sum += v8;
-        ++count;
-      }
+  // Ausgabegröße
+  const int resultWidth = input.cols / 2;
+  const int resultHeight = input.rows / 2;
+
+  output.create(resultHeight, resultWidth, input.type());
+
+  #pragma omp parallel for
+  for(int yOut = 0; yOut < resultHeight; ++yOut)
+  {
+    const int y = 2 * yOut + 1;
+    downsampleRow(input.ptr<uint16_t>(y - 1), input.ptr<uint16_t>(y), output.ptr<uint16_t>(yOut), 0, resultWidth, minValue, maxValue);
+  }
+}
+
+/**
+ * Replaces the zeros in input by the value of their parent in the next coarser level, if there is one.
+ */
+static void pullLevel(const cv::Mat &input, const cv::Mat &parent, cv::Mat &output)
+{
+  #pragma omp parallel for
+  for(int y = 0; y < input.rows; ++y)
+  {
+    const uint16_t *center = input.ptr<uint16_t>(y);
+    uint16_t *centerOut = output.ptr<uint16_t>(y);
+    const int yParent = y / 2;
+    const int colsParent = yParent < parent.rows ? std::min(2 * parent.cols, input.cols) : 0;
+    const uint16_t *centerParent = yParent < parent.rows ? parent.ptr<uint16_t>(yParent) : NULL;
+
+    int x = 0;
+    for(; x < colsParent; ++x)
+    {
+      centerOut[x] = center[x] ? center[x] : centerParent[x / 2];
+    }
+    for(; x < input.cols; ++x)
+    {
+      centerOut[x] = center[x];
+    }
+  }
+}
+
+/******************************************************************************
+ * Projection kernels
+ *****************************************************************************/
+
+typedef void (*ProjectRow)(const uint16_t *itD, const cv::Vec3b *itC, const uint8_t *itA, const float *itX, const float y, pcl::PointXYZRGBA *itP, const size_t cols);
+
+static void projectRowScalar(const uint16_t *itD, const cv::Vec3b *itC, const uint8_t *itA, const float *itX, const float y, pcl::PointXYZRGBA *itP, const size_t cols)
+{
+  const float badPoint = std::numeric_limits<float>::quiet_NaN();
+
+  for(size_t c = 0; c < cols; ++c, ++itP, ++itD, ++itC, ++itA, ++itX)
+  {
+    register const float depthValue = *itD / 1000.0f;
+    // Check for invalid measurements
+    if(depthValue == 0.0f)
+    {
+      // not valid
+      itP->x = itP->y = itP->z = badPoint;
+      itP->rgba = 0;
+      continue;
+    }
+    itP->z = depthValue;
+    itP->x = *itX * depthValue;
+    itP->y = y * depthValue;
+    itP->b = itC->val[0];
+    itP->g = itC->val[1];
+    itP->r = itC->val[2];
+    itP->a = 255 - *itA;
+  }
+}
+
+#ifdef RS_SIMD_X86
+
+/*
+ * The vector kernels write whole points: x, y, z, 1 followed by rgba and zeroed padding. Invalid
+ * depths are masked instead of branched on, the results are the same as the scalar ones. Colors
+ * are read in 12 byte steps, so that nothing behind the end of a row is touched.
+ */
+
+__attribute__((target("sse4.1")))
+static inline __m128i loadColorsSSE(const cv::Vec3b *itC, const uint8_t *itA)
+{
+  int tail, alpha;
+  memcpy(&tail, itC[2].val + 2, sizeof(int));
+  memcpy(&alpha, itA, sizeof(int));
+
+  const __m128i bgr = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)itC), _mm_cvtsi32_si128(tail));
+  const __m128i bgr0 = _mm_shuffle_epi8(bgr, _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1));
+  const __m128i a = _mm_sub_epi32(_mm_set1_epi32(255), _mm_cvtepu8_epi32(_mm_cvtsi32_si128(alpha)));
+  return _mm_or_si128(bgr0, _mm_slli_epi32(a, 24));
+}
+
+__attribute__((target("sse4.1")))
+static inline void projectSSE(const uint16_t *itD, const cv::Vec3b *itC, const uint8_t *itA, const float *itX, const __m128 y, pcl::PointXYZRGBA *itP)
+{
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 badPoint = _mm_set1_ps(std::numeric_limits<float>::quiet_NaN());
+
+  const __m128 depthValue = _mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)itD))), _mm_set1_ps(1000.0f));
+  const __m128 valid = _mm_cmpneq_ps(depthValue, zero);
+
+  const __m128 x = _mm_blendv_ps(badPoint, _mm_mul_ps(_mm_loadu_ps(itX), depthValue), valid);
+  const __m128 yv = _mm_blendv_ps(badPoint, _mm_mul_ps(y, depthValue), valid);
+  const __m128 z = _mm_blendv_ps(badPoint, depthValue, valid);
+  const __m128 rgba = _mm_and_ps(_mm_castsi128_ps(loadColorsSSE(itC, itA)), valid);
+
+  const __m128 xyLo = _mm_unpacklo_ps(x, yv), xyHi = _mm_unpackhi_ps(x, yv);
+  const __m128 zwLo = _mm_unpacklo_ps(z, one), zwHi = _mm_unpackhi_ps(z, one);
+  const __m128 cLo = _mm_unpacklo_ps(rgba, zero), cHi = _mm_unpackhi_ps(rgba, zero);
+
+  float *out = &itP->x;
+  _mm_storeu_ps(out, _mm_movelh_ps(xyLo, zwLo));
+  _mm_storeu_ps(out + 4, _mm_movelh_ps(cLo, zero));
+  _mm_storeu_ps(out + 8, _mm_movehl_ps(zwLo, xyLo));
+  _mm_storeu_ps(out + 12, _mm_movehl_ps(zero, cLo));
+  _mm_storeu_ps(out + 16, _mm_movelh_ps(xyHi, zwHi));
+  _mm_storeu_ps(out + 20, _mm_movelh_ps(cHi, zero));
+  _mm_storeu_ps(out + 24, _mm_movehl_ps(zwHi, xyHi));
+  _mm_storeu_ps(out + 28, _mm_movehl_ps(zero, cHi));
+}
+
+__attribute__((target("sse4.1")))
+static void projectRowSSE(const uint16_t *itD, const cv::Vec3b *itC, const uint8_t *itA, const float *itX, const float y, pcl::PointXYZRGBA *itP, const size_t cols)
+{
+  const __m128 yv = _mm_set1_ps(y);
+  size_t c = 0;
+  for(; c + 8 <= cols; c += 8)
+  {
+    projectSSE(itD + c, itC + c, itA + c, itX + c, yv, itP + c);
+    projectSSE(itD + c + 4, itC + c + 4, itA + c + 4, itX + c + 4, yv, itP + c + 4);
+  }
+  projectRowScalar(itD + c, itC + c, itA + c, itX + c, y, itP + c, cols - c);
+}
+
+__attribute__((target("avx2")))
+static inline void projectAVX2(const uint16_t *itD, const cv::Vec3b *itC, const uint8_t *itA, const float *itX, const __m256 y, pcl::PointXYZRGBA *itP)
+{
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 badPoint = _mm256_set1_ps(std::numeric_limits<float>::quiet_NaN());
+
+  const __m256 depthValue = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)itD))), _mm256_set1_ps(1000.0f));
+  const __m256 valid = _mm256_cmp_ps(depthValue, zero, _CMP_NEQ_UQ);
+
+  const __m256 x = _mm256_blendv_ps(badPoint, _mm256_mul_ps(_mm256_loadu_ps(itX), depthValue), valid);
+  const __m256 yv = _mm256_blendv_ps(badPoint, _mm256_mul_ps(y, depthValue), valid);
+  const __m256 z = _mm256_blendv_ps(badPoint, depthValue, valid);
+  const __m256i colors = _mm256_inserti128_si256(_mm256_castsi128_si256(loadColorsSSE(itC, itA)), loadColorsSSE(itC + 4, itA + 4), 1);
+  const __m256 rgba = _mm256_and_ps(_mm256_castsi256_ps(colors), valid);
+
+  // lanes hold points 0, 1, 4, 5 and 2, 3, 6, 7
+  const __m256 xyLo = _mm256_unpacklo_ps(x, yv), xyHi = _mm256_unpackhi_ps(x, yv);
+  const __m256 zwLo = _mm256_unpacklo_ps(z, one), zwHi = _mm256_unpackhi_ps(z, one);
+  const __m256 cLo = _mm256_unpacklo_ps(rgba, zero), cHi = _mm256_unpackhi_ps(rgba, zero);
+
+  const __m256 p04 = _mm256_shuffle_ps(xyLo, zwLo, 0x44), c04 = _mm256_shuffle_ps(cLo, zero, 0x44);
+  const __m256 p15 = _mm256_shuffle_ps(xyLo, zwLo, 0xEE), c15 = _mm256_shuffle_ps(cLo, zero, 0xEE);
+  const __m256 p26 = _mm256_shuffle_ps(xyHi, zwHi, 0x44), c26 = _mm256_shuffle_ps(cHi, zero, 0x44);
+  const __m256 p37 = _mm256_shuffle_ps(xyHi, zwHi, 0xEE), c37 = _mm256_shuffle_ps(cHi, zero, 0xEE);
+
+  float *out = &itP->x;
+  _mm256_storeu_ps(out, _mm256_permute2f128_ps(p04, c04, 0x20));
+  _mm256_storeu_ps(out + 8, _mm256_permute2f128_ps(p15, c15, 0x20));
+  _mm256_storeu_ps(out + 16, _mm256_permute2f128_ps(p26, c26, 0x20));
+  _mm256_storeu_ps(out + 24, _mm256_permute2f128_ps(p37, c37, 0x20));
+  _mm256_storeu_ps(out + 32, _mm256_permute2f128_ps(p04, c04, 0x31));
+  _mm256_storeu_ps(out + 40, _mm256_permute2f128_ps(p15, c15, 0x31));
+  _mm256_storeu_ps(out + 48, _mm256_permute2f128_ps(p26, c26, 0x31));
+  _mm256_storeu_ps(out + 56, _mm256_permute2f128_ps(p37, c37, 0x31));
+}
+
+__attribute__((target("avx2")))
+static void projectRowAVX2(const uint16_t *itD, const cv::Vec3b *itC, const uint8_t *itA, const float *itX, const float y, pcl::PointXYZRGBA *itP, const size_t cols)
+{
+  const __m256 yv = _mm256_set1_ps(y);
+  size_t c = 0;
+  for(; c + 16 <= cols; c += 16)
+  {
+    projectAVX2(itD + c, itC + c, itA + c, itX + c, yv, itP + c);
+    projectAVX2(itD + c + 8, itC + c + 8, itA + c + 8, itX + c + 8, yv, itP + c + 8);
+  }
+  projectRowScalar(itD + c, itC + c, itA + c, itX + c, y, itP + c, cols - c);
+}
+
+#endif // RS_SIMD_X86
+
+static ProjectRow getProjectRow(const rs::DepthImageProcessing::InstructionSet set)
+{
+  if(!rs::DepthImageProcessing::isSupported(set))
+  {
+    return NULL;
+  }
+
+  switch(set)
+  {
+#ifdef RS_SIMD_X86
+  case rs::DepthImageProcessing::INSTRUCTIONS_AVX2:
+    return &projectRowAVX2;
+  case rs::DepthImageProcessing::INSTRUCTIONS_SSE41:
+    return &projectRowSSE;
+#endif
+  default:
+    return &projectRowScalar;
+  }
+}
+
+static ProjectRow selectProjectRow()
+{
+  if(rs::DepthImageProcessing::isSupported(rs::DepthImageProcessing::INSTRUCTIONS_AVX2))
+  {
+    outInfo("using AVX2 projection.");
+    return getProjectRow(rs::DepthImageProcessing::INSTRUCTIONS_AVX2);
+  }
+  if(rs::DepthImageProcessing::isSupported(rs::DepthImageProcessing::INSTRUCTIONS_SSE41))
+  {
+    outInfo("using SSE4.1 projection.");
+    return getProjectRow(rs::DepthImageProcessing::INSTRUCTIONS_SSE41);
+  }
+  return &projectRowScalar;
+}
+
+/******************************************************************************
+ * Smoothing
+ *****************************************************************************/
+
+/*
+ * The smoothing filters work on float copies of the depth values multiplied by their weights, which
+ * are 1 for valid and 0 for invalid pixels. Both are filtered the same way and divided afterwards,
+ * so invalid pixels neither pull their neighbors towards zero nor get a value themselves.
+ */
+
+static void splitDepth(const cv::Mat &depth, std::vector<float> &values, std::vector<float> &weights)
+{
+  values.resize(depth.rows * depth.cols);
+  weights.resize(depth.rows * depth.cols);
+
+  #pragma omp parallel for
+  for(int y = 0; y < depth.rows; ++y)
+  {
+    const uint16_t *itD = depth.ptr<uint16_t>(y);
+    float *itV = &values[y * depth.cols];
+    float *itW = &weights[y * depth.cols];
+    for(int x = 0; x < depth.cols; ++x)
+    {
+      itV[x] = itD[x];
+      itW[x] = itD[x] ? 1.0f : 0.0f;
+    }
+  }
+}
+
+static void mergeDepth(const cv::Mat &depth, const std::vector<float> &values, const std::vector<float> &weights, cv::Mat &output)
+{
+  output.create(depth.rows, depth.cols, CV_16U);
 
-      // Die Seiten der Filtermaske
-      const uint16_t v1 = predecessor[x];
-      if(v1 >= minValue && v1 <= maxValue)
+  #pragma omp parallel for
+  for(int y = 0; y < depth.rows; ++y)
+  {
+    const uint16_t *itD = depth.ptr<uint16_t>(y);
+    const float *itV = &values[y * depth.cols];
+    const float *itW = &weights[y * depth.cols];
+    uint16_t *itO = output.ptr<uint16_t>(y);
+    for(int x = 0; x < depth.cols; ++x)
+    {
+      itO[x] = itD[x] && itW[x] > 1e-6f ? cv::saturate_cast<uint16_t>(itV[x] / itW[x]) : itD[x];
+    }
+  }
+}
+
+/**
+ * Cells a full resolution position is interpolated from, and the weight of the second one. The
+ * positions along a row are the same for every row, so they are computed once per filter call.
+ */
+struct Interpolation
+{
+  int first, second;
+  float weight;
+};
+
+static void interpolation(const int size, const int cells, const int scale, std::vector<Interpolation> &positions)
+{
+  positions.resize(size);
+  for(int i = 0; i < size; ++i)
+  {
+    const float f = std::min(std::max((i + 0.5f) / scale - 0.5f, 0.0f), (float)(cells - 1));
+    positions[i].first = std::min((int)f, cells - 1);
+    positions[i].second = std::min(positions[i].first + 1, cells - 1);
+    positions[i].weight = f - positions[i].first;
+  }
+}
+
+/**
+ * Sums the valid depths and their weights over cells of scale x scale pixels.
+ */
+static void subsampleDepth(const cv::Mat &depth, const int scale, std::vector<float> &values, std::vector<float> &weights)
+{
+  const int rows = (depth.rows + scale - 1) / scale, cols = (depth.cols + scale - 1) / scale;
+  values.assign(rows * cols, 0.0f);
+  weights.assign(rows * cols, 0.0f);
+
+  #pragma omp parallel for
+  for(int y = 0; y < rows; ++y)
+  {
+    float *itV = &values[y * cols];
+    float *itW = &weights[y * cols];
+    for(int yI = y * scale; yI < std::min((y + 1) * scale, depth.rows); ++yI)
+    {
+      const uint16_t *itD = depth.ptr<uint16_t>(yI);
+      for(int xI = 0; xI < depth.cols; ++xI)
       {
-        sum += v1 + v1;
-        count += 2;
+        if(itD[xI])
+        {
+          itV[xI / scale] += itD[xI];
+          itW[xI / scale] += 1.0f;
+        }
       }
-      const uint16_t v7 = successor[x];
-      if(v7 >= minValue && v7 <= maxValue)
+    }
+  }
+}
+
+/**
+ * Interpolates the smoothed depth of subsampled cells at the valid pixels of depth. The cells are
+ * weighted by exp(-|difference| / sigmaRange) to the depth of the pixel, so that cells on the other
+ * side of an edge do not contribute. Pixels without similar cells keep their depth.
+ */
+static void upsampleDepth(const cv::Mat &depth, std::vector<float> &values, const std::vector<float> &weights, const int rows, const int cols,
+                          const int scale, const float sigmaRange, std::vector<float> &table, cv::Mat &output)
+{
+  for(int i = 0; i < rows * cols; ++i)
+  {
+    values[i] = weights[i] > 1e-6f ? values[i] / weights[i] : 0.0f;
+  }
+
+  table.clear();
+  for(int i = 0; i < 65536; ++i)
+  {
+    table.push_back(std::exp(-i / sigmaRange));
+    if(table.back() < 1e-7f)
+    {
+      table.back() = 0.0f;
+      break;
+    }
+  }
+  const int last = (int)table.size() - 1;
+  const float *coeff = &table[0];
+
+  std::vector<Interpolation> rowsI, colsI;
+  interpolation(depth.rows, rows, scale, rowsI);
+  interpolation(depth.cols, cols, scale, colsI);
+
+  output.create(depth.rows, depth.cols, CV_16U);
+
+  #pragma omp parallel for
+  for(int yI = 0; yI < depth.rows; ++yI)
+  {
+    const uint16_t *itD = depth.ptr<uint16_t>(yI);
+    uint16_t *itO = output.ptr<uint16_t>(yI);
+    const int y0 = rowsI[yI].first, y1 = rowsI[yI].second;
+    const float dy = rowsI[yI].weight;
+
+    for(int xI = 0; xI < depth.cols; ++xI)
+    {
+      if(!itD[xI])
       {
-        sum += v7 + v7;
-        count += 2;
+        itO[xI] = 0;
+        continue;
       }
-      const uint16_t v3 = center[x - 1];
-      if(v3 >= minValue && v3 <= maxValue)
+      const int x0 = colsI[xI].first, x1 = colsI[xI].second;
+      const float dx = colsI[xI].weight;
+
+      const int cells[4] = {y0 * cols + x0, y0 * cols + x1, y1 * cols + x0, y1 * cols + x1};
+      const float factors[4] = {(1 - dy) * (1 - dx), (1 - dy) * dx, dy * (1 - dx), dy * dx};
+      float value = 0.0f, weight = 0.0f;
+      for(int c = 0; c < 4; ++c)
       {
-        sum += v3 + v3;
-        count += 2;
+        const float v = values[cells[c]];
+        if(v > 0.0f)
+        {
+          const float f = factors[c] * coeff[std::min((int)std::abs(v - itD[xI]), last)];
+          value += f * v;
+          weight += f;
+        }
       }
-      const uint16_t v5 = center[x + 1];
-      if(v5 >= minValue && v5 <= maxValue)
+      itO[xI] = weight > 1e-6f ? cv::saturate_cast<uint16_t>(value / weight) : itD[xI];
+    }
+  }
+}
+
+/**
+ * Sums over a (2 * radius + 1)^2 window, clipped at the image borders.
+ */
+static void boxSum(std::vector<float> &data, const int rows, const int cols, const int radius, std::vector<float> &buffer)
+{
+  buffer.resize(data.size());
+
+  #pragma omp parallel for
+  for(int y = 0; y < rows; ++y)
+  {
+    const float *itI = &data[y * cols];
+    float *itO = &buffer[y * cols];
+    double sum = 0;
+    for(int x = 0; x <= radius && x < cols; ++x)
+    {
+      sum += itI[x];
+    }
+    for(int x = 0; x < cols; ++x)
+    {
+      itO[x] = (float)sum;
+      if(x + radius + 1 < cols)
       {
-        sum += v5 + v5;
-        count += 2;
+        sum += itI[x + radius + 1];
       }
-
-      // Das Zentrum der Filtermaske
-      const uint16_t v4 = center[x];
-      if(v4 >= minValue && v4 <= maxValue)
+      if(x - radius >= 0)
       {
-        sum += 4 * v4;
-        count += 4;
+        sum -= itI[x - radius];
       }
+    }
+  }
 
-      // Ergebnis setzen
-      if(count)
+  // columns in blocks, so that the rows are read sequentially
+  #pragma omp parallel for
+  for(int x0 = 0; x0 < cols; x0 += 64)
+  {
+    const int width = std::min(64, cols - x0);
+    double sums[64] = {0};
+    for(int y = 0; y <= radius && y < rows; ++y)
+    {
+      const float *itI = &buffer[y * cols + x0];
+      for(int x = 0; x < width; ++x)
       {
-        centerOutput[x] = sum / count;
+        sums[x] += itI[x];
       }
-      else
+    }
+    for(int y = 0; y < rows; ++y)
+    {
+      float *itO = &data[y * cols + x0];
+      const float *itAdd = y + radius + 1 < rows ? &buffer[(y + radius + 1) * cols + x0] : NULL;
+      const float *itSub = y - radius >= 0 ? &buffer[(y - radius) * cols + x0] : NULL;
+      for(int x = 0; x < width; ++x)
       {
-        centerOutput[x] = v4;
+        itO[x] = (float)sums[x];
+        sums[x] += (itAdd ? itAdd[x] : 0.0f) - (itSub ? itSub[x] : 0.0f);
       }
     }
-    // linken und rechten Bildrand nicht filtern
-    centerOutput[0] = center[0];
-    centerOutput[input.cols - 1] = center[input.cols - 1];
   }
 }
 
-void selectiveDownsampling(const cv::Mat &input, cv::Mat &output, const uint16_t minValue, const uint16_t maxValue)
+/**
+ * One iteration of the recursive domain transform filter along the rows and along the columns. The
+ * coefficients are a^d, with d = 1 + ratio * |difference of neighboring depths| being their distance
+ * in the transformed domain. Since the differences are integers, a^d is looked up in a table.
+ */
+static void recursiveFilter(std::vector<float> &values, std::vector<float> &weights, const std::vector<uint16_t> &diffX, const std::vector<uint16_t> &diffY,
+                            const int rows, const int cols, const float a, const float ratio, std::vector<float> &table)
 {
-  int cols = input.cols, rows = input.rows;
-
-  // Ausgabegröße
-  const int resultWidth = cols / 2;
-  const int resultHeight = rows / 2;
-
-  output.create(resultHeight, resultWidth, input.type());
-
-  for(int y = 1, yOut = 0; y < rows; y += 2, ++yOut)
+  const float logA = std::log(a);
+  table.clear();
+  for(int i = 0; i < 65536; ++i)
   {
-
-    const uint16_t *predecessor = input.ptr<uint16_t>(y - 1);
-    const uint16_t *center = input.ptr<uint16_t>(y);
-
-    uint16_t *centerOut = output.ptr<uint16_t>(yOut);
-    for(int x = 1, xOut = 0; x < cols; x += 2, ++xOut)
+    table.push_back(std::exp(logA * (1.0f + ratio * i)));
+    // all further coefficients do not change anything anymore
+    if(table.back() < 1e-7f)
     {
-      float sum = 0.f;
-      int count = 0;
+      table.back() = 0.0f;
+      break;
+    }
+  }
+  const int last = (int)table.size() - 1;
+  const float *coeff = &table[0];
 
-      const uint16_t v0 = predecessor[x - 1];
-      if(v0 >= minValue && v0 <= maxValue)
+  // Each sweep depends on the previous pixel, so lanes of independent rows (columns) are filtered
+  // side by side. Rows are transposed into blocks of 16 for that. The blocks are allocated once per
+  // thread, lanes of a partial last block keep values of the previous one but are never read back.
+  #pragma omp parallel
+  {
+    std::vector<float> blockV(cols * 16, 0.0f), blockW(cols * 16, 0.0f), blockC(cols * 16, 0.0f);
+    #pragma omp for
+    for(int y0 = 0; y0 < rows; y0 += 16)
+    {
+      const int height = std::min(16, rows - y0);
+      for(int r = 0; r < height; ++r)
       {
-        sum += v0;
-        ++count;
+        const int offset = (y0 + r) * cols;
+        for(int x = 0; x < cols; ++x)
+        {
+          blockV[x * 16 + r] = values[offset + x];
+          blockW[x * 16 + r] = weights[offset + x];
+          blockC[x * 16 + r] = coeff[std::min((int)diffX[offset + x], last)];
+        }
       }
-
-      const uint16_t v1 = predecessor[x];
-      if(v1 >= minValue && v1 <= maxValue)
+      for(int i = 16; i < cols * 16; ++i)
       {
-        sum += v1;
-        ++count;
+        blockV[i] += blockC[i] * (blockV[i - 16] - blockV[i]);
+        blockW[i] += blockC[i] * (blockW[i - 16] - blockW[i]);
       }
-
-      const uint16_t v2 = center[x - 1];
-      if(v2 >= minValue && v2 <= maxValue)
+      for(int i = (cols - 1) * 16 - 1; i >= 0; --i)
       {
-        sum += v2;
-        ++count;
+        blockV[i] += blockC[i + 16] * (blockV[i + 16] - blockV[i]);
+        blockW[i] += blockC[i + 16] * (blockW[i + 16] - blockW[i]);
       }
-
-      const uint16_t v3 = center[x];
-      if(v3 >= minValue && v3 <= maxValue)
+      for(int r = 0; r < height; ++r)
       {
-        sum += v3;
-        ++count;
+        const int offset = (y0 + r) * cols;
+        for(int x = 0; x < cols; ++x)
+        {
+          values[offset + x] = blockV[x * 16 + r];
+          weights[offset + x] = blockW[x * 16 + r];
+        }
       }
+    }
+  }
 
-      if(count > 0)
+  #pragma omp parallel
+  {
+    std::vector<float> blockC(rows * 64);
+    #pragma omp for
+    for(int x0 = 0; x0 < cols; x0 += 64)
+    {
+      const int width = std::min(64, cols - x0);
+      for(int y = 0; y < rows; ++y)
       {
-        centerOut[xOut] = sum / count;
+        for(int x = 0; x < width; ++x)
+        {
+          blockC[y * 64 + x] = coeff[std::min((int)diffY[y * cols + x0 + x], last)];
+        }
       }
-      else
+      for(int y = 1; y < rows; ++y)
       {
-        centerOut[xOut] = v0;
+        float *itV = &values[y * cols + x0], *itW = &weights[y * cols + x0];
+        const float *itC = &blockC[y * 64];
+        for(int x = 0; x < width; ++x)
+        {
+          itV[x] += itC[x] * (itV[x - cols] - itV[x]);
+          itW[x] += itC[x] * (itW[x - cols] - itW[x]);
+        }
+      }
+      for(int y = rows - 2; y >= 0; --y)
+      {
+        float *itV = &values[y * cols + x0], *itW = &weights[y * cols + x0];
+        const float *itC = &blockC[(y + 1) * 64];
+        for(int x = 0; x < width; ++x)
+        {
+          itV[x] += itC[x] * (itV[x + cols] - itV[x]);
+          itW[x] += itC[x] * (itW[x + cols] - itW[x]);
+        }
       }
     }
   }
 }
 
+/**
+ * Convolves the grid with [1 2 1] along one axis. The grid consists of outer blocks of size cells
+ * along that axis, neighboring cells are inner values apart.
+ */
+static void blurGrid(const std::vector<float> &input, std::vector<float> &output, const int outer, const int size, const int inner)
+{
+  output.resize(input.size());
+
+  #pragma omp parallel for
+  for(int j = 0; j < outer * size; ++j)
+  {
+    const int s = j % size;
+    const float *itI = &input[j * inner];
+    float *itO = &output[j * inner];
+    const float *itPrev = s > 0 ? itI - inner : NULL;
+    const float *itNext = s + 1 < size ? itI + inner : NULL;
+    for(int i = 0; i < inner; ++i)
+    {
+      itO[i] = 2 * itI[i] + (itPrev ? itPrev[i] : 0.0f) + (itNext ? itNext[i] : 0.0f);
+    }
+  }
+}
+
 namespace rs
 {
 namespace DepthImageProcessing
 {
 
+bool isSupported(const InstructionSet set)
+{
+  switch(set)
+  {
+  case INSTRUCTIONS_BEST:
+  case INSTRUCTIONS_SCALAR:
+    return true;
+#ifdef RS_SIMD_X86
+  case INSTRUCTIONS_SSE41:
+  case INSTRUCTIONS_AVX2:
+  {
+    // the vector kernels write whole points, which needs the usual 32 byte layout with rgba behind x, y, z, w
+    pcl::PointXYZRGBA point;
+    const bool layout = sizeof(pcl::PointXYZRGBA) == 8 * sizeof(float) && (char *)&point.rgba - (char *)&point.x == 4 * sizeof(float);
+
+    __builtin_cpu_init();
+    return layout && (set == INSTRUCTIONS_AVX2 ? __builtin_cpu_supports("avx2") : __builtin_cpu_supports("sse4.1"));
+  }
+#endif
+  default:
+    return false;
+  }
+}
+
 void fillHoles(cv::Mat &image)
 {
-  cv::Mat output(image.rows, image.cols, image.type());
+  // push: the whole pyramid of smoothed and downsampled levels, up to the first one smaller than 10 pixels
   std::vector<cv::Mat> pyramid;
+  cv::Mat smoothed;
+  do
+  {
+    selectiveBinomialFiltering(pyramid.empty() ? image : pyramid.back(), smoothed, 1, 10000);
+    cv::Mat upperPyrLevel;
+    selectiveDownsampling(smoothed, upperPyrLevel, 1, 10000);
+    pyramid.push_back(upperPyrLevel);
+  }
+  while(MIN(pyramid.back().cols, pyramid.back().rows) >= 10);
 
-  int rows = image.rows;
-  int cols = image.cols;
+  // pull: holes take the value of the first valid level above them
+  for(int i = (int)pyramid.size() - 2; i >= 0; --i)
+  {
+    pullLevel(pyramid[i], pyramid[i + 1], pyramid[i]);
+  }
+  cv::Mat output(image.rows, image.cols, image.type());
+  pullLevel(image, pyramid[0], output);
+  image = output;
+}
 
+void project(const cv::Mat &depth, const cv::Mat &color, const cv::Mat &alpha, const cv::Mat &lookupX, const cv::Mat &lookupY, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud,
+             const InstructionSet set)
+{
+  cloud->height = depth.rows;
+  cloud->width = depth.cols;
+  cloud->is_dense = false;
+  cloud->points.resize(cloud->height * cloud->width);
+
+  static const ProjectRow best = selectProjectRow();
+  ProjectRow projectRow = best;
+  if(set != INSTRUCTIONS_BEST)
+  {
+    projectRow = getProjectRow(set);
+    if(!projectRow)
+    {
+      outWarn("instruction set " << set << " not supported, using the scalar projection.");
+      projectRow = &projectRowScalar;
+    }
+  }
+
+  #pragma omp parallel for
+  for(size_t r = 0; r < (size_t)depth.rows; ++r)
+  {
+    projectRow(depth.ptr<uint16_t>(r), color.ptr<cv::Vec3b>(r), alpha.ptr<uint8_t>(r), lookupX.ptr<float>(), lookupY.at<float>(0, r),
+               &cloud->points[r * depth.cols], depth.cols);
+  }
+}
+
+void domainTransformSmoothing(cv::Mat &depth, const float sigmaSpace, const float sigmaRange, const int iterations)
+{
+  // large spatial sigmas are filtered on a subsampled image, like the coefficients of the guided filter
+  const int scale = std::max(1, (int)(sigmaSpace / 2));
+  const int rows = (depth.rows + scale - 1) / scale, cols = (depth.cols + scale - 1) / scale;
+  const float sigma = sigmaSpace / scale;
+  std::vector<float> values, weights, table;
+  std::vector<uint16_t> diffX(rows * cols), diffY(rows * cols);
+
+  cv::Mat input = depth;
+  if(scale > 1)
+  {
+    subsampleDepth(depth, scale, values, weights);
+    // the mean depths of the cells give the differences, empty cells are invalid
+    input.create(rows, cols, CV_16U);
+    for(int i = 0; i < rows * cols; ++i)
+    {
+      input.ptr<uint16_t>()[i] = weights[i] > 0.5f ? cv::saturate_cast<uint16_t>(values[i] / weights[i]) : 0;
+    }
+  }
+  else
+  {
+    splitDepth(depth, values, weights);
+  }
+
+  // differences to the left and upper neighbors, first column and row are never used
+  #pragma omp parallel for
   for(int y = 0; y < rows; ++y)
   {
-    const uint16_t *center = image.ptr<uint16_t>(y);
-    uint16_t *output_center = output.ptr<uint16_t>(y);
+    const uint16_t *itD = input.ptr<uint16_t>(y);
+    const uint16_t *itP = input.ptr<uint16_t>(std::max(y - 1, 0));
+    uint16_t *itX = &diffX[y * cols];
+    uint16_t *itY = &diffY[y * cols];
+    itX[0] = 0;
+    for(int x = 1; x < cols; ++x)
+    {
+      itX[x] = (uint16_t)std::abs((int)itD[x] - (int)itD[x - 1]);
+    }
     for(int x = 0; x < cols; ++x)
     {
-      uint16_t depth = center[x];
-      if(depth == 0)
-      {
-        int pyramidLayer = -1;
-        uint16_t replacement = 0;
-        int xPyr = x;
-        int yPyr = y;
-        int pyramidTop = 0;
+      itY[x] = (uint16_t)std::abs((int)itD[x] - (int)itP[x]);
+    }
+  }
 
-        do
+  for(int i = 0; i < iterations; ++i)
+  {
+    const float sigmaH = sigma * std::sqrt(3.0f) * std::pow(2.0f, (float)(iterations - i - 1)) / std::sqrt(std::pow(4.0f, (float)iterations) - 1.0f);
+    recursiveFilter(values, weights, diffX, diffY, rows, cols, std::exp(-std::sqrt(2.0f) / sigmaH), sigma / sigmaRange, table);
+  }
+
+  cv::Mat output;
+  if(scale > 1)
+  {
+    upsampleDepth(depth, values, weights, rows, cols, scale, sigmaRange, table, output);
+  }
+  else
+  {
+    mergeDepth(depth, values, weights, output);
+  }
+  depth = output;
+}
+
+void guidedSmoothing(cv::Mat &depth, const cv::Mat &guide, const int radius, const float sigmaRange)
+{
+  // fast guided filter: the coefficients are computed on a subsampled image and upsampled
+  const int scale = std::max(1, radius / 4);
+  const int radiusLow = std::max(1, radius / scale);
+  const int rows = (depth.rows + scale - 1) / scale, cols = (depth.cols + scale - 1) / scale;
+  const float eps = (sigmaRange / 255.0f) * (sigmaRange / 255.0f);
+
+  // weighted sums of I, I^2, p and I*p per cell, I is the guide and p the depth
+  std::vector<float> w(rows * cols), wI(rows * cols), wII(rows * cols), wP(rows * cols), wIP(rows * cols), buffer;
+
+  #pragma omp parallel for
+  for(int y = 0; y < rows; ++y)
+  {
+    for(int yI = y * scale; yI < std::min((y + 1) * scale, depth.rows); ++yI)
+    {
+      const uint16_t *itD = depth.ptr<uint16_t>(yI);
+      const uint8_t *itG = guide.ptr<uint8_t>(yI);
+      for(int xI = 0; xI < depth.cols; ++xI)
+      {
+        if(!itD[xI])
         {
-          ++pyramidLayer;
-          xPyr /= 2;
-          yPyr /= 2;
-
-          if(pyramidLayer >= pyramid.size())
-          {
-            cv::Mat lowerPyrLevel = image.clone();
-            if(pyramidLayer > 0)
-            {
-              lowerPyrLevel = pyramid[pyramidLayer - 1];
-            }
-
-            cv::Mat smoothed;
-            selectiveBinomialFiltering(lowerPyrLevel, smoothed, 1, 10000);
-
-            cv::Mat upperPyrLevel;
-            selectiveDownsampling(smoothed, upperPyrLevel, 1, 10000);
-            pyramid.push_back(upperPyrLevel);
-
-          }
-          cv::Mat pyrLevel = pyramid[pyramidLayer];
-          if(MIN(pyrLevel.cols, pyrLevel.rows) < 10)
-          {
-            pyramidTop = 1;
-          }
-
-          if(xPyr < pyrLevel.cols && yPyr < pyrLevel.rows)
-          {
-            replacement = image.at<uint16_t>(yPyr, xPyr);
-          }
-          else
-          {
-            pyramidTop = 1;
-          }
+          continue;
         }
-        while(!replacement && !pyramidTop);
-        output_center[x] = replacement;
+        const int i = y * cols + xI / scale;
+        const float I = itG[xI] / 255.0f, p = itD[xI];
+        w[i] += 1.0f;
+        wI[i] += I;
+        wII[i] += I * I;
+        wP[i] += p;
+        wIP[i] += I * p;
       }
     }
   }
-  image = output;
+
+  boxSum(w, rows, cols, radiusLow, buffer);
+  boxSum(wI, rows, cols, radiusLow, buffer);
+  boxSum(wII, rows, cols, radiusLow, buffer);
+  boxSum(wP, rows, cols, radiusLow, buffer);
+  boxSum(wIP, rows, cols, radiusLow, buffer);
+
+  // linear coefficients q = a * I + b, weighted by whether there was any valid depth around
+  #pragma omp parallel for
+  for(int i = 0; i < rows * cols; ++i)
+  {
+    if(w[i] < 0.5f)
+    {
+      wI[i] = wP[i] = w[i] = 0.0f;
+      continue;
+    }
+    const float meanI = wI[i] / w[i], meanP = wP[i] / w[i];
+    const float varI = wII[i] / w[i] - meanI * meanI;
+    const float covIP = wIP[i] / w[i] - meanI * meanP;
+    const float a = covIP / (varI + eps);
+    wI[i] = a;
+    wP[i] = meanP - a * meanI;
+    w[i] = 1.0f;
+  }
+
+  boxSum(wI, rows, cols, radiusLow, buffer);
+  boxSum(wP, rows, cols, radiusLow, buffer);
+  boxSum(w, rows, cols, radiusLow, buffer);
+
+  std::vector<Interpolation> rowsI, colsI;
+  interpolation(depth.rows, rows, scale, rowsI);
+  interpolation(depth.cols, cols, scale, colsI);
+
+  cv::Mat output(depth.rows, depth.cols, CV_16U);
+
+  #pragma omp parallel for
+  for(int yI = 0; yI < depth.rows; ++yI)
+  {
+    const uint16_t *itD = depth.ptr<uint16_t>(yI);
+    const uint8_t *itG = guide.ptr<uint8_t>(yI);
+    uint16_t *itO = output.ptr<uint16_t>(yI);
+    const int y0 = rowsI[yI].first, y1 = rowsI[yI].second;
+    const float dy = rowsI[yI].weight;
+
+    for(int xI = 0; xI < depth.cols; ++xI)
+    {
+      if(!itD[xI])
+      {
+        itO[xI] = 0;
+        continue;
+      }
+      const int x0 = colsI[xI].first, x1 = colsI[xI].second;
+      const float dx = colsI[xI].weight;
+
+      const int i00 = y0 * cols + x0, i01 = y0 * cols + x1, i10 = y1 * cols + x0, i11 = y1 * cols + x1;
+      const float w00 = (1 - dy) * (1 - dx), w01 = (1 - dy) * dx, w10 = dy * (1 - dx), w11 = dy * dx;
+      const float n = w00 * w[i00] + w01 * w[i01] + w10 * w[i10] + w11 * w[i11];
+      if(n < 1e-6f)
+      {
+        itO[xI] = itD[xI];
+        continue;
+      }
+      const float a = w00 * wI[i00] + w01 * wI[i01] + w10 * wI[i10] + w11 * wI[i11];
+      const float b = w00 * wP[i00] + w01 * wP[i01] + w10 * wP[i10] + w11 * wP[i11];
+      itO[xI] = cv::saturate_cast<uint16_t>((a * (itG[xI] / 255.0f) + b) / n);
+    }
+  }
+  depth = output;
 }
-void project(const cv::Mat &depth, const cv::Mat &color, const cv::Mat &alpha, const cv::Mat &lookupX, const cv::Mat &lookupY, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud)
+
+void bilateralGridSmoothing(cv::Mat &depth, const cv::Mat &guide, const float sigmaSpace, const float sigmaRange)
 {
-  cloud->height = depth.rows;
-  cloud->width = depth.cols;
-  cloud->is_dense = false;
-  cloud->points.resize(cloud->height * cloud->width);
+  // one empty cell on each side, so that blurring and interpolating never leave the grid
+  const int pad = 1;
+  const int width = (int)((depth.cols - 1) / sigmaSpace + 0.5f) + 1 + 2 * pad;
+  const int height = (int)((depth.rows - 1) / sigmaSpace + 0.5f) + 1 + 2 * pad;
+  const int range = (int)(255 / sigmaRange + 0.5f) + 1 + 2 * pad;
+  const int size = width * height * range;
 
-  const float badPoint = std::numeric_limits<float>::quiet_NaN();
+  // values and weights are interleaved, so that slicing reads both from the same cache line
+  std::vector<float> grid(2 * size, 0.0f), buffer;
 
+  // grid cells of every column and guide value, with the weights of the next cell for slicing
+  std::vector<int> cellX(depth.cols), sliceX(depth.cols), cellZ(256), sliceZ(256);
+  std::vector<float> weightX(depth.cols), weightZ(256);
+  for(int x = 0; x < depth.cols; ++x)
+  {
+    const float fx = x / sigmaSpace + pad;
+    cellX[x] = (int)(x / sigmaSpace + 0.5f) + pad;
+    sliceX[x] = std::min((int)fx, width - 2);
+    weightX[x] = fx - sliceX[x];
+  }
+  for(int g = 0; g < 256; ++g)
+  {
+    const float fz = g / sigmaRange + pad;
+    cellZ[g] = (int)(g / sigmaRange + 0.5f) + pad;
+    sliceZ[g] = std::min((int)fz, range - 2);
+    weightZ[g] = fz - sliceZ[g];
+  }
+
+  // splat: every grid row is filled by one thread only
   #pragma omp parallel for
-  for(size_t r = 0; r < (size_t)depth.rows; ++r)
+  for(int gy = pad; gy < height - pad; ++gy)
   {
-    pcl::PointXYZRGBA *itP = &cloud->points[r * depth.cols];
-    const uint16_t *itD = depth.ptr<uint16_t>(r);
-    const uint8_t *itA = alpha.ptr<uint8_t>(r);
-    const cv::Vec3b *itC = color.ptr<cv::Vec3b>(r);
-    const float y = lookupY.at<float>(0, r);
-    const float *itX = lookupX.ptr<float>();
+    const int yBegin = std::max(0, (int)std::ceil((gy - pad - 0.5f) * sigmaSpace));
+    const int yEnd = std::min(depth.rows, (int)std::ceil((gy - pad + 0.5f) * sigmaSpace));
+    for(int y = yBegin; y < yEnd; ++y)
+    {
+      const uint16_t *itD = depth.ptr<uint16_t>(y);
+      const uint8_t *itG = guide.ptr<uint8_t>(y);
+      for(int x = 0; x < depth.cols; ++x)
+      {
+        if(!itD[x])
+        {
+          continue;
+        }
+        const int i = 2 * ((gy * width + cellX[x]) * range + cellZ[itG[x]]);
+        grid[i] += itD[x];
+        grid[i + 1] += 1.0f;
+      }
+    }
+  }
+
+  // blur along range, x and y
+  blurGrid(grid, buffer, height * width, range, 2);
+  grid.swap(buffer);
+  blurGrid(grid, buffer, height, width, 2 * range);
+  grid.swap(buffer);
+  blurGrid(grid, buffer, 1, height, 2 * width * range);
+  grid.swap(buffer);
+
+  // slice: trilinear interpolation at the position of each pixel
+  cv::Mat output(depth.rows, depth.cols, CV_16U);
+
+  #pragma omp parallel for
+  for(int y = 0; y < depth.rows; ++y)
+  {
+    const uint16_t *itD = depth.ptr<uint16_t>(y);
+    const uint8_t *itG = guide.ptr<uint8_t>(y);
+    uint16_t *itO = output.ptr<uint16_t>(y);
+
+    const float fy = y / sigmaSpace + pad;
+    const int y0 = std::min((int)fy, height - 2);
+    const float dy = fy - y0;
+    const float *itY0 = &grid[2 * y0 * width * range], *itY1 = itY0 + 2 * width * range;
 
-    for(size_t c = 0; c < (size_t)depth.cols; ++c, ++itP, ++itD, ++itC, ++itA, ++itX)
+    for(int x = 0; x < depth.cols; ++x)
     {
-      register const float depthValue = *itD / 1000.0f;
-      // Check for invalid measurements
-      if(depthValue == 0.0f)
+      if(!itD[x])
       {
-        // not valid
-        itP->x = itP->y = itP->z = badPoint;
-        itP->rgba = 0;
+        itO[x] = 0;
         continue;
       }
-      itP->z = depthValue;
-      itP->x = *itX * depthValue;
-      itP->y = y * depthValue;
-      itP->b = itC->val[0];
-      itP->g = itC->val[1];
-      itP->r = itC->val[2];
-      itP->a = 255 - *itA;
+      const int x0 = sliceX[x], z0 = sliceZ[itG[x]];
+      const float dx = weightX[x], dz = weightZ[itG[x]];
+
+      // the four corners in x and y, each with the two neighboring cells in range
+      const float *corners[4] = {itY0 + 2 * (x0 * range + z0), itY0 + 2 * ((x0 + 1) * range + z0),
+                                 itY1 + 2 * (x0 * range + z0), itY1 + 2 * ((x0 + 1) * range + z0)
+                                };
+      const float factors[4] = {(1 - dy) * (1 - dx), (1 - dy) * dx, dy * (1 - dx), dy * dx};
+      float value = 0.0f, weight = 0.0f;
+      for(int c = 0; c < 4; ++c)
+      {
+        const float *itC = corners[c];
+        const float f0 = factors[c] * (1 - dz), f1 = factors[c] * dz;
+        value += f0 * itC[0] + f1 * itC[2];
+        weight += f0 * itC[1] + f1 * itC[3];
+      }
+      itO[x] = weight > 1e-6f ? cv::saturate_cast<uint16_t>(value / weight) : itD[x];
     }
   }
+  depth = output;
 }
 
 }
@@ -52,6 +52,15 @@ private:
 
   bool enableDepthSmoothing, enableHoleFilling, thresholdThermalImages;
   int thermalImageThreshold, borderErosion, borderDilation;
+  float smoothingSigmaSpace, smoothingSigmaRange;
+
+  enum
+  {
+    BILATERAL,
+    DOMAIN_TRANSFORM,
+    GUIDED,
+    BILATERAL_GRID
+  } smoothingMode;
 
   double pointSize;
 
@@ -79,7 +88,7 @@ private:
 
 public:
   ImagePreprocessor() : DrawingAnnotator(__func__), borderErosion(6), borderDilation(12),
-    pointSize(1), displayMode(MASK), pclDispMode(PCL_RGBD), nh_("~")
+    smoothingSigmaSpace(8.0f), smoothingSigmaRange(30.0f), smoothingMode(BILATERAL), pointSize(1), displayMode(MASK), pclDispMode(PCL_RGBD), nh_("~")
   {
     cloud = pcl::PointCloud<pcl::PointXYZRGBA>::Ptr(new pcl::PointCloud<pcl::PointXYZRGBA>);
     thermalCloud = pcl::PointCloud<pcl::PointXYZRGBA>::Ptr(new pcl::PointCloud<pcl::PointXYZRGBA>);
@@ -96,6 +105,55 @@ public:
     {
       ctx.extractValue("enableDepthSmoothing", enableDepthSmoothing);
     }
+    if(ctx.isParameterDefined("depthSmoothing"))
+    {
+      std::string mode;
+      ctx.extractValue("depthSmoothing", mode);
+      if(mode == "bilateral")
+      {
+        smoothingMode = BILATERAL;
+      }
+      else if(mode == "domain_transform")
+      {
+        smoothingMode = DOMAIN_TRANSFORM;
+      }
+      else if(mode == "guided")
+      {
+        smoothingMode = GUIDED;
+      }
+      else if(mode == "bilateral_grid")
+      {
+        smoothingMode = BILATERAL_GRID;
+      }
+      else
+      {
+        outWarn("unknown depth smoothing \"" << mode << "\", using bilateral.");
+      }
+    }
+    if(ctx.isParameterDefined("smoothingSigmaSpace"))
+    {
+      ctx.extractValue("smoothingSigmaSpace", smoothingSigmaSpace);
+    }
+    if(ctx.isParameterDefined("smoothingSigmaRange"))
+    {
+      ctx.extractValue("smoothingSigmaRange", smoothingSigmaRange);
+    }
+    if(!(smoothingSigmaSpace > 0.0f) || !(smoothingSigmaRange > 0.0f))
+    {
+      outError("smoothingSigmaSpace (" << smoothingSigmaSpace << ") and smoothingSigmaRange (" << smoothingSigmaRange << ") have to be positive.");
+      return UIMA_ERR_USER_ANNOTATOR_COULD_NOT_INIT;
+    }
+    // the guided filter needs a radius of at least one pixel, the grid cells have to cover at least one pixel and gray value
+    if(smoothingMode == GUIDED && smoothingSigmaSpace < 0.5f)
+    {
+      outError("smoothingSigmaSpace (" << smoothingSigmaSpace << ") has to be at least 0.5 for guided smoothing.");
+      return UIMA_ERR_USER_ANNOTATOR_COULD_NOT_INIT;
+    }
+    if(smoothingMode == BILATERAL_GRID && (smoothingSigmaSpace < 1.0f || smoothingSigmaRange < 1.0f))
+    {
+      outError("smoothingSigmaSpace (" << smoothingSigmaSpace << ") and smoothingSigmaRange (" << smoothingSigmaRange << ") have to be at least 1 for bilateral_grid smoothing.");
+      return UIMA_ERR_USER_ANNOTATOR_COULD_NOT_INIT;
+    }
     if(ctx.isParameterDefined("enableHoleFilling"))
     {
       ctx.extractValue("enableHoleFilling", enableHoleFilling);
@@ -410,6 +468,19 @@ public:
     }
   }
 
+  void snapshotCloudWithLock(pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr &outCloud, double &pointSize)
+  {
+    if(pclDispMode == PCL_RGBDT)
+    {
+      outCloud = thermalCloud;
+    }
+    else
+    {
+      outCloud = cloud;
+    }
+    pointSize = this->pointSize;
+  }
+
 private:
   /*******************************************************************************
    * Color
@@ -487,13 +558,13 @@ private:
 
     if((enableDepthSmoothing || enableHoleFilling) && hasDepthHD)
     {
-      filterDepth(depthHD);
+      filterDepth(depthHD, colorHD);
       cas.set(VIEW_DEPTH_IMAGE_HD, depthHD);
       hasDepth = false;
     }
     else if(enableDepthSmoothing || enableHoleFilling)
     {
-      filterDepth(depth);
+      filterDepth(depth, color);
       cas.set(VIEW_DEPTH_IMAGE, depth);
     }
 
@@ -514,11 +585,11 @@ private:
     }
   }
 
-  void filterDepth(cv::Mat &depth)
+  void filterDepth(cv::Mat &depth, const cv::Mat &color)
   {
     if(enableDepthSmoothing)
     {
-      bilateralSmoothing(depth);
+      smoothDepth(depth, color);
     }
 
     if(enableHoleFilling)
@@ -605,6 +676,8 @@ private:
     if((forceNewCloud || !cas.has(VIEW_CLOUD)) && hasDepth && hasColor)
     {
       outDebug("create point cloud.");
+      // a new cloud every frame, the previous one might still be shown by the visualizer
+      cloud.reset(new pcl::PointCloud<pcl::PointXYZRGBA>());
       rs::DepthImageProcessing::project(depth, color, alpha, lookupX, lookupY, cloud);
       cas.set(VIEW_CLOUD, *cloud);
     }
@@ -623,7 +696,7 @@ private:
 
     if(hasThermal)
     {
-      filterDepth(thermalDepth);
+      filterDepth(thermalDepth, thermalColor);
       if(thresholdThermalImages)
       {
         thresholdRGBDT(thermalColor, thermal, thermalDepth, thermalImageThreshold);
@@ -651,6 +724,7 @@ private:
 
     if(hasThermal && (thresholdThermalImages || forceNewCloud || !cas.has(VIEW_CLOUD)))
     {
+      thermalCloud.reset(new pcl::PointCloud<pcl::PointXYZRGBA>());
       rs::DepthImageProcessing::project(thermalDepth, thermalColor, thermal, lookupXThermal, lookupYThermal, thermalCloud);
       cas.set(VIEW_THERMAL_CLOUD, *thermalCloud);
     }
@@ -683,6 +757,41 @@ private:
     }
   }
 
+  void smoothDepth(cv::Mat &depth, const cv::Mat &color)
+  {
+    cv::Mat guide;
+    if(smoothingMode == GUIDED || smoothingMode == BILATERAL_GRID)
+    {
+      if(color.empty())
+      {
+        // nothing to guide the filter, using the one that only needs the depth
+        rs::DepthImageProcessing::domainTransformSmoothing(depth, smoothingSigmaSpace, smoothingSigmaRange);
+        return;
+      }
+      cv::cvtColor(color, guide, CV_BGR2GRAY);
+      if(guide.size() != depth.size())
+      {
+        cv::resize(guide, guide, depth.size(), 0, 0, cv::INTER_AREA);
+      }
+    }
+
+    switch(smoothingMode)
+    {
+    case BILATERAL:
+      bilateralSmoothing(depth);
+      break;
+    case DOMAIN_TRANSFORM:
+      rs::DepthImageProcessing::domainTransformSmoothing(depth, smoothingSigmaSpace, smoothingSigmaRange);
+      break;
+    case GUIDED:
+      rs::DepthImageProcessing::guidedSmoothing(depth, guide, (int)(smoothingSigmaSpace + 0.5f), smoothingSigmaRange);
+      break;
+    case BILATERAL_GRID:
+      rs::DepthImageProcessing::bilateralGridSmoothing(depth, guide, smoothingSigmaSpace, smoothingSigmaRange);
+      break;
+    }
+  }
+
   void bilateralSmoothing(const cv::Mat &image)
   {
     cv::Mat in, out;
@@ -79,6 +79,8 @@ public:
     pcl::VoxelGrid<PointT> vg;
     vg.setInputCloud(cloud_ptr);
     vg.setLeafSize(leaf_size, leaf_size, leaf_size);
+    // a new cloud every frame, the previous one might still be shown by the visualizer
+    cloud_filtered.reset(new pcl::PointCloud<PointT>);
     vg.filter(*cloud_filtered);
 
     outInfo("Downsampled size: " << cloud_filtered->points.size());
@@ -112,6 +114,12 @@ public:
     }
   }
 
+  void snapshotCloudWithLock(pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr &cloud, double &pointSize)
+  {
+    cloud = cloud_filtered;
+    pointSize = this->pointSize;
+  }
+
 };
 
 // This macro exports an entry point that is used to create the annotator.
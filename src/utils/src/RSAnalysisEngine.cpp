@@ -18,16 +18,27 @@
  */
 
 #include <rs/utils/RSAnalysisEngine.h>
+#include <rs/utils/RSParallelScheduler.h>
+#include <rs/scene_cas.h>
 
+#include <uima/internal_aggregate_engine.hpp>
+#include <uima/annotator_mgr.hpp>
 
-RSAnalysisEngine::RSAnalysisEngine() : engine(NULL), cas(NULL)
+
+RSAnalysisEngine::RSAnalysisEngine() : engine(NULL), cas(NULL), scheduler(NULL), latency(NULL)
 {
 }
 
 RSAnalysisEngine::~RSAnalysisEngine()
 {
+  if(scheduler)
+  {
+    delete scheduler;
+    scheduler = NULL;
+  }
   if(cas)
   {
+    rs::SceneCas::clearCache(*cas);
     delete cas;
     cas = NULL;
   }
@@ -54,6 +65,7 @@ void RSAnalysisEngine::init(const std::string &file)
   }
   const uima::AnalysisEngineMetaData &data = engine->getAnalysisEngineMetaData();
   data.getName().toUTF8String(name);
+  latency = &rs::LatencyRegistry::instance().get("engine/" + name);
 
   // Get a new CAS
   outInfo("Creating a new CAS");
@@ -80,6 +92,12 @@ void RSAnalysisEngine::stop()
   outInfo("Analysis engine stopped: " << name);
 }
 
+void RSAnalysisEngine::resetCas()
+{
+  rs::SceneCas::clearCache(*cas);
+  cas->reset();
+}
+
 void RSAnalysisEngine::process()
 {
   outInfo("executing analisys engine: " << name);
@@ -90,26 +108,41 @@ void RSAnalysisEngine::process()
     cas->setDocumentText(uima::UnicodeStringRef(ustrInputText));
 
     rs::StopWatch clock;
+    bool dropped = false;
     outInfo("processing CAS");
-    try
+    if(scheduler)
     {
-      uima::CASIterator casIter = engine->processAndOutputNewCASes(*cas);
-
-      for(int i = 0; casIter.hasNext(); ++i)
+      dropped = !scheduler->process(*cas);
+    }
+    else
+    {
+      try
       {
-        uima::CAS &outCas = casIter.next();
+        uima::CASIterator casIter = engine->processAndOutputNewCASes(*cas);
 
-        // release CAS
-        outInfo("release CAS " << i);
-        engine->getAnnotatorContext().releaseCAS(outCas);
+        for(int i = 0; casIter.hasNext(); ++i)
+        {
+          uima::CAS &outCas = casIter.next();
+
+          // release CAS
+          outInfo("release CAS " << i);
+          engine->getAnnotatorContext().releaseCAS(outCas);
+        }
+      }
+      catch(const rs::FrameFilterException &)
+      {
+        dropped = true;
       }
     }
-    catch(const rs::FrameFilterException &)
+
+    const double time = clock.getTime();
+    latency->add(time);
+    if(dropped)
     {
+      latency->addDropped();
     }
-
     outInfo("processing finished");
-    outInfo(clock.getTime() << " ms." << std::endl << std::endl << FG_YELLOW
+    outInfo(time << " ms." << std::endl << std::endl << FG_YELLOW
             << "********************************************************************************" << std::endl);
   }
   catch(const rs::Exception &e)
@@ -129,3 +162,104 @@ void RSAnalysisEngine::process()
     outError("Unknown exception!");
   }
 }
+
+uima::CAS *RSAnalysisEngine::newCas()
+{
+  uima::CAS *newCas = engine->newCAS();
+  if(newCas == NULL)
+  {
+    throw uima::Exception(uima::ErrorMessage(UIMA_ERR_ENGINE_NO_CAS), UIMA_ERR_ENGINE_NO_CAS, uima::ErrorInfo::unrecoverable);
+  }
+  return newCas;
+}
+
+bool RSAnalysisEngine::getFlow(std::vector<std::string> &annotators) const
+{
+  annotators.clear();
+  uima::FlowConstraints const *pFlow = engine->getAnalysisEngineMetaData().getFlowConstraints();
+  if(pFlow == NULL)
+  {
+    return false;
+  }
+  uima::FlowConstraints *flow = CONST_CAST(uima::FlowConstraints *, pFlow);
+
+  const std::vector<icu::UnicodeString> &nodes = flow->getNodes();
+  annotators.resize(nodes.size());
+  for(size_t i = 0; i < nodes.size(); ++i)
+  {
+    nodes[i].toUTF8String(annotators[i]);
+  }
+  return !annotators.empty();
+}
+
+uima::AnalysisEngine *RSAnalysisEngine::getDelegate(const size_t index)
+{
+  uima::internal::AggregateEngine *aengine = (uima::internal::AggregateEngine *)engine;
+  return aengine->iv_annotatorMgr.iv_vecEntries.at(index).iv_pEngine;
+}
+
+bool RSAnalysisEngine::enableParallelProcessing(const size_t threads)
+{
+  if(scheduler)
+  {
+    return true;
+  }
+
+  scheduler = new RSParallelScheduler(*this);
+  if(!scheduler->init(cas->getTypeSystem(), threads))
+  {
+    delete scheduler;
+    scheduler = NULL;
+    return false;
+  }
+  outInfo("parallel processing enabled for " << name);
+  return true;
+}
+
+bool RSAnalysisEngine::processFlow(uima::CAS &cas, const size_t begin, const size_t end)
+{
+  // same access to the delegates as RSPipelineManager, entries are in the order of the flow
+  uima::internal::AggregateEngine *aengine = (uima::internal::AggregateEngine *)engine;
+  uima::internal::AnnotatorManager::TyAnnotatorEntries &entries = aengine->iv_annotatorMgr.iv_vecEntries;
+
+  try
+  {
+    if(begin == 0)
+    {
+      UnicodeString ustrInputText;
+      ustrInputText.fromUTF8(name);
+      cas.setDocumentText(uima::UnicodeStringRef(ustrInputText));
+    }
+
+    for(size_t i = begin; i < end && i < entries.size(); ++i)
+    {
+      const uima::TyErrorId err = entries[i].iv_pEngine->process(cas);
+      if(err != UIMA_ERR_NONE)
+      {
+        outError("processing failed with error " << err << ".");
+        return false;
+      }
+    }
+    return true;
+  }
+  catch(const rs::FrameFilterException &)
+  {
+  }
+  catch(const rs::Exception &e)
+  {
+    outError("Exception: " << std::endl << e.what());
+  }
+  catch(const uima::Exception &e)
+  {
+    outError("Exception: " << std::endl << e);
+  }
+  catch(const std::exception &e)
+  {
+    outError("Exception: " << std::endl << e.what());
+  }
+  catch(...)
+  {
+    outError("Unknown exception!");
+  }
+  return false;
+}
@@ -0,0 +1,263 @@
+/**
+ * Copyright 2014 University of Bremen, Institute for Artificial Intelligence
+ * Author(s): Ferenc Balint-Benczedi <balintbe@cs.uni-bremen.de>
+ *         Thiemo Wiedemeyer <wiedemeyer@cs.uni-bremen.de>
+ *         Jan-Hendrik Worch <jworch@cs.uni-bremen.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#include <rs/utils/RSParallelScheduler.h>
+#include <rs/utils/RSAnalysisEngine.h>
+#include <rs/utils/output.h>
+#include <rs/utils/time.h>
+
+void RSParallelScheduler::Gate::wait()
+{
+  scheduler->waitForTurn(index);
+}
+
+RSParallelScheduler::RSParallelScheduler(RSAnalysisEngine &engine) : engine(engine), running(false), cas(NULL), finishedCount(0), finishedPrefix(0), dropped(false)
+{
+}
+
+RSParallelScheduler::~RSParallelScheduler()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    running = false;
+    cvTasks.notify_all();
+  }
+  for(size_t i = 0; i < workers.size(); ++i)
+  {
+    workers[i].join();
+  }
+}
+
+static void insertNames(const std::vector<icu::UnicodeString> &names, std::set<std::string> &output)
+{
+  for(size_t i = 0; i < names.size(); ++i)
+  {
+    std::string name;
+    names[i].toUTF8String(name);
+    output.insert(name);
+  }
+}
+
+bool RSParallelScheduler::init(const uima::TypeSystem &ts, const size_t threads)
+{
+  std::vector<std::string> flow;
+  if(!engine.getFlow(flow))
+  {
+    return false;
+  }
+
+  nodes.resize(flow.size());
+  for(size_t i = 0; i < flow.size(); ++i)
+  {
+    Node &node = nodes[i];
+    node.name = flow[i];
+    node.dependencies = 0;
+
+    const uima::AnalysisEngineMetaData::TyVecpCapabilities &capabilities = engine.getDelegate(i)->getAnalysisEngineMetaData().getCapabilites();
+    for(size_t j = 0; j < capabilities.size(); ++j)
+    {
+      insertNames(capabilities[j]->getCapabilityTypes(uima::Capability::INPUT), node.reads);
+      insertNames(capabilities[j]->getCapabilitySofas(uima::Capability::INPUTSOFA), node.reads);
+      insertNames(capabilities[j]->getCapabilityTypes(uima::Capability::OUTPUT), node.writes);
+      insertNames(capabilities[j]->getCapabilitySofas(uima::Capability::OUTPUTSOFA), node.writes);
+    }
+  }
+
+  outInfo("annotator dependencies:");
+  for(size_t i = 0; i < nodes.size(); ++i)
+  {
+    std::ostringstream oss;
+    for(size_t j = 0; j < i; ++j)
+    {
+      if(dependsOn(ts, nodes[i], nodes[j]))
+      {
+        nodes[j].successors.push_back(i);
+        ++nodes[i].dependencies;
+        oss << ' ' << nodes[j].name;
+      }
+    }
+    outInfo("  " FG_BLUE << nodes[i].name << NO_COLOR " <-" << (nodes[i].dependencies ? oss.str() : " none"));
+  }
+
+  gates.resize(nodes.size());
+  for(size_t i = 0; i < gates.size(); ++i)
+  {
+    gates[i].scheduler = this;
+    gates[i].index = i;
+  }
+
+  const size_t count = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+  running = true;
+  for(size_t i = 0; i < count; ++i)
+  {
+    workers.push_back(std::thread(&RSParallelScheduler::worker, this));
+  }
+  return true;
+}
+
+bool RSParallelScheduler::dependsOn(const uima::TypeSystem &ts, const Node &later, const Node &earlier) const
+{
+  // nothing declared, nothing known about the annotator
+  if((later.reads.empty() && later.writes.empty()) || (earlier.reads.empty() && earlier.writes.empty()))
+  {
+    return true;
+  }
+
+  std::set<std::string> laterAccess(later.reads);
+  laterAccess.insert(later.writes.begin(), later.writes.end());
+
+  for(std::set<std::string>::const_iterator itE = earlier.writes.begin(); itE != earlier.writes.end(); ++itE)
+  {
+    const uima::Type typeE = ts.getType(icu::UnicodeString::fromUTF8(*itE));
+    for(std::set<std::string>::const_iterator itL = laterAccess.begin(); itL != laterAccess.end(); ++itL)
+    {
+      if(*itE == *itL)
+      {
+        return true;
+      }
+      const uima::Type typeL = ts.getType(icu::UnicodeString::fromUTF8(*itL));
+      if(typeE.isValid() && typeL.isValid() && (typeE.subsumes(typeL) || typeL.subsumes(typeE)))
+      {
+        return true;
+      }
+    }
+  }
+
+  for(std::set<std::string>::const_iterator itW = later.writes.begin(); itW != later.writes.end(); ++itW)
+  {
+    if(earlier.reads.find(*itW) != earlier.reads.end())
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+void RSParallelScheduler::waitForTurn(const size_t index)
+{
+  // Also after a drop: annotators still running must not write to the CAS at the same time. All
+  // earlier annotators have been started before, so they finish or get skipped eventually.
+  std::unique_lock<std::mutex> guard(lock);
+  while(finishedPrefix < index)
+  {
+    cvDone.wait(guard);
+  }
+}
+
+void RSParallelScheduler::worker()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  for(;;)
+  {
+    while(tasks.empty() && running)
+    {
+      cvTasks.wait(guard);
+    }
+    if(!running)
+    {
+      return;
+    }
+    const size_t index = tasks.front();
+    tasks.pop_front();
+
+    // queued before the frame was dropped, skipped without touching the CAS
+    bool success = false;
+    double time = 0.0;
+    if(!dropped)
+    {
+      uima::CAS &tcas = *cas;
+      guard.unlock();
+
+      rs::WriteGate::current() = &gates[index];
+      rs::StopWatch clock;
+      success = engine.processFlow(tcas, index, index + 1);
+      time = clock.getTime();
+      rs::WriteGate::current() = nullptr;
+
+      guard.lock();
+    }
+    times[index] = time;
+    finished[index] = true;
+    ++finishedCount;
+    dropped = dropped || !success;
+    for(size_t i = 0; i < nodes[index].successors.size(); ++i)
+    {
+      --pending[nodes[index].successors[i]];
+    }
+    while(finishedPrefix < finished.size() && finished[finishedPrefix])
+    {
+      ++finishedPrefix;
+    }
+    cvDone.notify_all();
+  }
+}
+
+bool RSParallelScheduler::process(uima::CAS &tcas)
+{
+  rs::StopWatch clock;
+  std::unique_lock<std::mutex> guard(lock);
+  cas = &tcas;
+  pending.resize(nodes.size());
+  for(size_t i = 0; i < nodes.size(); ++i)
+  {
+    pending[i] = nodes[i].dependencies;
+  }
+  finished.assign(nodes.size(), false);
+  times.assign(nodes.size(), 0.0);
+  finishedCount = 0;
+  finishedPrefix = 0;
+  dropped = false;
+
+  size_t next = 0, started = 0;
+  while(finishedCount < started || next < nodes.size())
+  {
+    // start annotators in flow order, so that the one holding back the writes of the others always runs
+    while(next < nodes.size() && pending[next] == 0 && !dropped)
+    {
+      tasks.push_back(next++);
+      ++started;
+      cvTasks.notify_one();
+    }
+    if(dropped && finishedCount == started)
+    {
+      break;
+    }
+    cvDone.wait(guard);
+  }
+  cas = NULL;
+
+  // longest chain of dependent annotators, the lower bound for the latency of a frame
+  std::vector<double> path(nodes.size(), 0.0);
+  double criticalPath = 0.0, sum = 0.0;
+  for(size_t i = 0; i < nodes.size(); ++i)
+  {
+    path[i] += times[i];
+    sum += times[i];
+    criticalPath = std::max(criticalPath, path[i]);
+    for(size_t j = 0; j < nodes[i].successors.size(); ++j)
+    {
+      const size_t s = nodes[i].successors[j];
+      path[s] = std::max(path[s], path[i]);
+    }
+  }
+  outInfo("parallel processing: " << clock.getTime() << " ms, critical path: " << criticalPath << " ms, sum of annotators: " << sum << " ms.");
+  return !dropped;
+}
@@ -51,7 +51,16 @@ void help()
             << "               _ae:=engine1[,...]  shorter version for _analysis_engines" << std::endl
             << "    _visualization:=true|false     Enable/disable visualization" << std::endl
             << "              _vis:=true|false     shorter version for _visualization" << std::endl
+            << "         _headless:=true|false     Visualize without windows, on ~output_image/compressed only" << std::endl
+            << "         _vis_rate:=HZ             Maximum rate of the headless visualization (default 5)" << std::endl
+            << "       _vis_format:=jpeg|png       Image format of the headless visualization (default jpeg)" << std::endl
+            << "         _vis_file:=FILE           File replaced with every image of the headless visualization" << std::endl
             << "        _save_path:=PATH           Path to where images and point clouds should be stored" << std::endl
+            << "   _pipeline_depth:=N              Number of frames processed at the same time (default 1)" << std::endl
+            << "    _pipeline_cuts:=annotator[,...] Annotators starting a new pipeline stage" << std::endl
+            << " _parallel_engines:=engine1[,...]  Engines running independent annotators in parallel" << std::endl
+            << "   _latency_period:=SECONDS        Period for publishing latency statistics on ~latency (default 5, 0 disables)" << std::endl
+            << "     _latency_file:=FILE           File the latency statistics are written to, JSON if it ends with .json, CSV otherwise" << std::endl
             << std::endl
             << "Usage: roslaunch robosherlock rs.launch [options]" << std::endl
             << "Options:" << std::endl
@@ -59,7 +68,16 @@ void help()
             << "                ae:=engine1[,...]  shorter version for analysis_engines" << std::endl
             << "     visualization:=true|false     Enable/disable visualization" << std::endl
             << "               vis:=true|false     shorter version for visualization" << std::endl
-            << "         save_path:=PATH           Path to where images and point clouds should be stored" << std::endl;
+            << "          headless:=true|false     Visualize without windows, on ~output_image/compressed only" << std::endl
+            << "          vis_rate:=HZ             Maximum rate of the headless visualization (default 5)" << std::endl
+            << "        vis_format:=jpeg|png       Image format of the headless visualization (default jpeg)" << std::endl
+            << "          vis_file:=FILE           File replaced with every image of the headless visualization" << std::endl
+            << "         save_path:=PATH           Path to where images and point clouds should be stored" << std::endl
+            << "    pipeline_depth:=N              Number of frames processed at the same time (default 1)" << std::endl
+            << "     pipeline_cuts:=annotator[,...] Annotators starting a new pipeline stage" << std::endl
+            << "  parallel_engines:=engine1[,...]  Engines running independent annotators in parallel" << std::endl
+            << "    latency_period:=SECONDS        Period for publishing latency statistics on ~latency (default 5, 0 disables)" << std::endl
+            << "      latency_file:=FILE           File the latency statistics are written to, JSON if it ends with .json, CSV otherwise" << std::endl;
 }
 
 /* ----------------------------------------------------------------------- */
@@ -78,9 +96,11 @@ int main(int argc, char *argv[])
     ros::init(argc, argv, std::string("RoboSherlock"));
   }
 
-  std::string analysisEnginesArg, savePath;
-  std::vector<std::string> analysisEngines, analysisEnginesCL;
-  bool visualization;
+  std::string analysisEnginesArg, savePath, pipelineCutsArg, parallelEnginesArg, latencyFile, visFormat, visFile;
+  std::vector<std::string> analysisEngines, analysisEnginesCL, pipelineCuts, parallelEngines;
+  bool visualization, headless;
+  int pipelineDepth;
+  double latencyPeriod, visRate;
 
   ros::NodeHandle priv_nh = ros::NodeHandle("~");
 
@@ -100,15 +120,34 @@ int main(int argc, char *argv[])
 
   priv_nh.param("vis", visualization, true);
   priv_nh.param("visualization", visualization, visualization);
+  priv_nh.param("headless", headless, false);
+  priv_nh.param("vis_rate", visRate, 5.0);
+  priv_nh.param("vis_format", visFormat, std::string("jpeg"));
+  priv_nh.param("vis_file", visFile, std::string(""));
 
   priv_nh.param("save_path", savePath, std::string(getenv("HOME")));
 
+  priv_nh.param("pipeline_depth", pipelineDepth, 1);
+  priv_nh.param("pipeline_cuts", pipelineCutsArg, std::string(""));
+  priv_nh.param("parallel_engines", parallelEnginesArg, std::string(""));
+  priv_nh.param("latency_period", latencyPeriod, 5.0);
+  priv_nh.param("latency_file", latencyFile, std::string(""));
+
   // Do not cache parameters to prevent false behaviour with short parameter versions.
   priv_nh.deleteParam("ae");
   priv_nh.deleteParam("analysis_engines");
   priv_nh.deleteParam("vis");
   priv_nh.deleteParam("visualization");
+  priv_nh.deleteParam("headless");
+  priv_nh.deleteParam("vis_rate");
+  priv_nh.deleteParam("vis_format");
+  priv_nh.deleteParam("vis_file");
   priv_nh.deleteParam("save_path");
+  priv_nh.deleteParam("pipeline_depth");
+  priv_nh.deleteParam("pipeline_cuts");
+  priv_nh.deleteParam("parallel_engines");
+  priv_nh.deleteParam("latency_period");
+  priv_nh.deleteParam("latency_file");
 
   if(analysisEnginesArg.empty())
   {
@@ -123,6 +162,17 @@ int main(int argc, char *argv[])
     }
   }
 
+  for(size_t start = 0, end = 0; end != pipelineCutsArg.npos && start < pipelineCutsArg.length(); start = end + 1)
+  {
+    end = pipelineCutsArg.find(',', start);
+    pipelineCuts.push_back(pipelineCutsArg.substr(start, end - start));
+  }
+  for(size_t start = 0, end = 0; end != parallelEnginesArg.npos && start < parallelEnginesArg.length(); start = end + 1)
+  {
+    end = parallelEnginesArg.find(',', start);
+    parallelEngines.push_back(parallelEnginesArg.substr(start, end - start));
+  }
+
   if(savePath.empty())
   {
     savePath = getenv("HOME");
@@ -162,14 +212,22 @@ int main(int argc, char *argv[])
   }
 
   outInfo("startup parameters:" << std::endl
-          << "   visualization: " FG_CYAN << (visualization ? "enabled" : "disabled") << NO_COLOR << std::endl
+          << "   visualization: " FG_CYAN << (visualization ? (headless ? "headless" : "enabled") : "disabled") << NO_COLOR << std::endl
           << "       save_path: " FG_CYAN << savePath << NO_COLOR << std::endl
+          << "  pipeline_depth: " FG_CYAN << pipelineDepth << NO_COLOR << std::endl
           << "analysis_engines: " << engineList.str());
 
   try
   {
     RSAnalysisEngineManager<RSAnalysisEngine> manager(visualization, savePath);
 
+    manager.setPipelining(std::max(pipelineDepth, 1), pipelineCuts);
+    manager.setParallelEngines(parallelEngines);
+    manager.setLatencyReporting(latencyPeriod, latencyFile);
+    if(headless)
+    {
+      manager.setHeadlessVisualization(visRate, visFormat, visFile);
+    }
     manager.init(analysisEngineFiles);
 
     manager.run();
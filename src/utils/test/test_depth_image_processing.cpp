@@ -0,0 +1,487 @@
+/**
+ * Copyright 2014 University of Bremen, Institute for Artificial Intelligence
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// STL
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+// GTest
+#include <gtest/gtest.h>
+
+// RS
+#include <rs/utils/DepthImageProcessing.h>
+
+namespace dip = rs::DepthImageProcessing;
+
+/******************************************************************************
+ * Projection
+ *****************************************************************************/
+
+struct ProjectionInput
+{
+  cv::Mat depth, color, alpha, lookupX, lookupY;
+
+  ProjectionInput(const int width, const int height, const unsigned int seed)
+  {
+    std::mt19937 rng(seed);
+    depth.create(height, width, CV_16U);
+    color.create(height, width, CV_8UC3);
+    alpha.create(height, width, CV_8U);
+    lookupX.create(1, width, CV_32F);
+    lookupY.create(1, height, CV_32F);
+
+    // about a quarter of the pixels is invalid, the rest covers the whole range
+    for(int r = 0; r < height; ++r)
+    {
+      for(int c = 0; c < width; ++c)
+      {
+        depth.at<uint16_t>(r, c) = rng() % 4 ? rng() % 65536 : 0;
+        color.at<cv::Vec3b>(r, c) = cv::Vec3b(rng(), rng(), rng());
+        alpha.at<uint8_t>(r, c) = rng();
+      }
+    }
+    for(int c = 0; c < width; ++c)
+    {
+      lookupX.at<float>(0, c) = (c - width * 0.5f) / 525.0f;
+    }
+    for(int r = 0; r < height; ++r)
+    {
+      lookupY.at<float>(0, r) = (r - height * 0.5f) / 525.0f;
+    }
+  }
+
+  void project(pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloud, const dip::InstructionSet set) const
+  {
+    cloud.reset(new pcl::PointCloud<pcl::PointXYZRGBA>());
+    dip::project(depth, color, alpha, lookupX, lookupY, cloud, set);
+  }
+};
+
+static void expectSameBits(const pcl::PointCloud<pcl::PointXYZRGBA> &expected, const pcl::PointCloud<pcl::PointXYZRGBA> &actual)
+{
+  ASSERT_EQ(expected.width, actual.width);
+  ASSERT_EQ(expected.height, actual.height);
+  ASSERT_EQ(expected.points.size(), actual.points.size());
+
+  size_t mismatches = 0;
+  for(size_t i = 0; i < expected.points.size(); ++i)
+  {
+    const pcl::PointXYZRGBA &e = expected.points[i], &a = actual.points[i];
+    // NaNs of invalid points have to match as well, so the bits are compared instead of the values
+    if(memcmp(e.data, a.data, sizeof(e.data)) || e.rgba != a.rgba)
+    {
+      ADD_FAILURE_AT(__FILE__, __LINE__) << "point " << i << " differs: (" << e.x << ", " << e.y << ", " << e.z << ", " << e.rgba
+                                         << ") != (" << a.x << ", " << a.y << ", " << a.z << ", " << a.rgba << ")";
+      if(++mismatches == 10)
+      {
+        return;
+      }
+    }
+  }
+}
+
+class ProjectionTest : public ::testing::TestWithParam<dip::InstructionSet>
+{
+};
+
+TEST_P(ProjectionTest, MatchesScalarBitForBit)
+{
+  if(!dip::isSupported(GetParam()))
+  {
+    std::cerr << "instruction set " << GetParam() << " not supported, skipping." << std::endl;
+    return;
+  }
+
+  // widths that are not a multiple of the vector sizes exercise the scalar tails
+  const int sizes[][2] = {{640, 480}, {512, 424}, {37, 5}, {7, 3}, {1, 1}, {17, 2}};
+  for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+  {
+    SCOPED_TRACE(testing::Message() << sizes[i][0] << "x" << sizes[i][1]);
+    const ProjectionInput input(sizes[i][0], sizes[i][1], i + 1);
+    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr expected, actual;
+    input.project(expected, dip::INSTRUCTIONS_SCALAR);
+    input.project(actual, GetParam());
+    expectSameBits(*expected, *actual);
+  }
+}
+
+TEST_P(ProjectionTest, InvalidDepthGivesNaN)
+{
+  if(!dip::isSupported(GetParam()))
+  {
+    return;
+  }
+
+  ProjectionInput input(19, 2, 7);
+  input.depth.setTo(0);
+  pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud;
+  input.project(cloud, GetParam());
+  for(size_t i = 0; i < cloud->points.size(); ++i)
+  {
+    EXPECT_TRUE(std::isnan(cloud->points[i].x) && std::isnan(cloud->points[i].y) && std::isnan(cloud->points[i].z));
+    EXPECT_EQ(0u, cloud->points[i].rgba);
+  }
+}
+
+INSTANTIATE_TEST_CASE_P(InstructionSets, ProjectionTest,
+                        ::testing::Values(dip::INSTRUCTIONS_SCALAR, dip::INSTRUCTIONS_SSE41, dip::INSTRUCTIONS_AVX2, dip::INSTRUCTIONS_BEST));
+
+/******************************************************************************
+ * Hole filling
+ *****************************************************************************/
+
+/*
+ * The previous hole filling, which climbs the pyramid separately for every hole until it finds a
+ * valid value. With its bugs fixed: it reads the pyramid levels instead of the input image, keeps
+ * the valid pixels and sums the filter in 32 bits.
+ */
+namespace reference
+{
+
+static void filter(const cv::Mat &input, cv::Mat &output)
+{
+  output = input.clone();
+  for(int y = 1; y < input.rows - 1; ++y)
+  {
+    for(int x = 1; x < input.cols - 1; ++x)
+    {
+      int sum = 0, count = 0;
+      for(int dy = -1; dy <= 1; ++dy)
+      {
+        for(int dx = -1; dx <= 1; ++dx)
+        {
+          const uint16_t v = input.at<uint16_t>(y + dy, x + dx);
+          const int weight = (2 - std::abs(dx)) * (2 - std::abs(dy));
+          if(v >= 1 && v <= 10000)
+          {
+            sum += weight * v;
+            count += weight;
+          }
+        }
+      }
+      output.at<uint16_t>(y, x) = count ? sum / count : input.at<uint16_t>(y, x);
+    }
+  }
+}
+
+static void downsample(const cv::Mat &input, cv::Mat &output)
+{
+  output.create(input.rows / 2, input.cols / 2, input.type());
+  for(int y = 1, yOut = 0; y < input.rows; y += 2, ++yOut)
+  {
+    for(int x = 1, xOut = 0; x < input.cols; x += 2, ++xOut)
+    {
+      const uint16_t v[4] = {input.at<uint16_t>(y - 1, x - 1), input.at<uint16_t>(y - 1, x), input.at<uint16_t>(y, x - 1), input.at<uint16_t>(y, x)};
+      float sum = 0.f;
+      int count = 0;
+      for(int i = 0; i < 4; ++i)
+      {
+        if(v[i] >= 1 && v[i] <= 10000)
+        {
+          sum += v[i];
+          ++count;
+        }
+      }
+      output.at<uint16_t>(yOut, xOut) = count ? sum / count : v[0];
+    }
+  }
+}
+
+static void fillHoles(cv::Mat &image)
+{
+  cv::Mat output = image.clone();
+  std::vector<cv::Mat> pyramid;
+  for(int y = 0; y < image.rows; ++y)
+  {
+    for(int x = 0; x < image.cols; ++x)
+    {
+      if(image.at<uint16_t>(y, x))
+      {
+        continue;
+      }
+
+      uint16_t replacement = 0;
+      bool top = false;
+      for(int level = 0, xPyr = x / 2, yPyr = y / 2; !replacement && !top; ++level, xPyr /= 2, yPyr /= 2)
+      {
+        if(level == (int)pyramid.size())
+        {
+          cv::Mat smoothed, upper;
+          filter(level ? pyramid.back() : image, smoothed);
+          downsample(smoothed, upper);
+          pyramid.push_back(upper);
+        }
+        const cv::Mat &pyrLevel = pyramid[level];
+        top = std::min(pyrLevel.cols, pyrLevel.rows) < 10;
+        if(xPyr < pyrLevel.cols && yPyr < pyrLevel.rows)
+        {
+          replacement = pyrLevel.at<uint16_t>(yPyr, xPyr);
+        }
+        else
+        {
+          top = true;
+        }
+      }
+      output.at<uint16_t>(y, x) = replacement;
+    }
+  }
+  image = output;
+}
+
+}
+
+static cv::Mat randomDepth(const int width, const int height, const double holes, const unsigned int seed)
+{
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  cv::Mat depth(height, width, CV_16U);
+  for(int r = 0; r < height; ++r)
+  {
+    for(int c = 0; c < width; ++c)
+    {
+      // a few values are out of the filtered range, they are kept but not used for filling
+      depth.at<uint16_t>(r, c) = uniform(rng) < holes ? 0 : 300 + rng() % 11000;
+    }
+  }
+  return depth;
+}
+
+static void setRect(cv::Mat &depth, const int x, const int y, const int width, const int height, const uint16_t value)
+{
+  for(int r = std::max(0, y); r < std::min(depth.rows, y + height); ++r)
+  {
+    for(int c = std::max(0, x); c < std::min(depth.cols, x + width); ++c)
+    {
+      depth.at<uint16_t>(r, c) = value;
+    }
+  }
+}
+
+// the reference divides the downsampled sums in float, the push-pull pass in integers
+static const int fillTolerance = 1;
+
+static void expectFilledLikeReference(const cv::Mat &input)
+{
+  cv::Mat expected = input.clone(), actual = input.clone();
+  reference::fillHoles(expected);
+  dip::fillHoles(actual);
+
+  ASSERT_EQ(expected.rows, actual.rows);
+  ASSERT_EQ(expected.cols, actual.cols);
+  size_t mismatches = 0;
+  for(int r = 0; r < expected.rows && mismatches < 10; ++r)
+  {
+    for(int c = 0; c < expected.cols && mismatches < 10; ++c)
+    {
+      const int e = expected.at<uint16_t>(r, c), a = actual.at<uint16_t>(r, c);
+      if(std::abs(e - a) > fillTolerance)
+      {
+        ADD_FAILURE_AT(__FILE__, __LINE__) << "pixel (" << c << ", " << r << "): " << a << " instead of " << e;
+        ++mismatches;
+      }
+      if(input.at<uint16_t>(r, c))
+      {
+        EXPECT_EQ(input.at<uint16_t>(r, c), a) << "valid pixel (" << c << ", " << r << ") changed";
+      }
+    }
+  }
+}
+
+TEST(FillHolesTest, MatchesReferenceOnRandomHoles)
+{
+  const int sizes[][2] = {{640, 480}, {512, 424}, {33, 21}, {7, 3}};
+  const double holes[] = {0.05, 0.5, 0.95};
+  for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+  {
+    for(size_t j = 0; j < sizeof(holes) / sizeof(holes[0]); ++j)
+    {
+      SCOPED_TRACE(testing::Message() << sizes[i][0] << "x" << sizes[i][1] << ", holes " << holes[j]);
+      expectFilledLikeReference(randomDepth(sizes[i][0], sizes[i][1], holes[j], i * 10 + j));
+    }
+  }
+}
+
+TEST(FillHolesTest, MatchesReferenceOnLargeAndBorderHoles)
+{
+  cv::Mat depth = randomDepth(640, 480, 0.1, 5);
+  // a large hole inside, one along every border and the corners
+  setRect(depth, 200, 150, 160, 120, 0);
+  setRect(depth, 0, 0, 640, 9, 0);
+  setRect(depth, 0, 471, 640, 9, 0);
+  setRect(depth, 0, 0, 17, 480, 0);
+  setRect(depth, 623, 0, 17, 480, 0);
+  expectFilledLikeReference(depth);
+
+  // odd sizes leave the last row and column without a parent
+  cv::Mat odd = randomDepth(641, 481, 0.1, 6);
+  setRect(odd, 0, 0, 641, 3, 0);
+  setRect(odd, 638, 0, 3, 481, 0);
+  setRect(odd, 0, 478, 641, 3, 0);
+  expectFilledLikeReference(odd);
+
+  cv::Mat filled = depth.clone();
+  dip::fillHoles(filled);
+  for(int r = 0; r < filled.rows; ++r)
+  {
+    for(int c = 0; c < filled.cols; ++c)
+    {
+      ASSERT_NE(0, filled.at<uint16_t>(r, c)) << "hole at (" << c << ", " << r << ") not filled";
+    }
+  }
+}
+
+TEST(FillHolesTest, KeepsAllInvalidInput)
+{
+  const int sizes[][2] = {{640, 480}, {9, 9}, {1, 1}};
+  for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+  {
+    cv::Mat depth(sizes[i][1], sizes[i][0], CV_16U);
+    depth.setTo(0);
+    expectFilledLikeReference(depth);
+
+    dip::fillHoles(depth);
+    for(int r = 0; r < depth.rows; ++r)
+    {
+      for(int c = 0; c < depth.cols; ++c)
+      {
+        ASSERT_EQ(0, depth.at<uint16_t>(r, c));
+      }
+    }
+  }
+}
+
+/******************************************************************************
+ * Smoothing
+ *****************************************************************************/
+
+enum SmoothingMode
+{
+  DOMAIN_TRANSFORM = 0,
+  GUIDED,
+  BILATERAL_GRID
+};
+
+class SmoothingTest : public ::testing::TestWithParam<SmoothingMode>
+{
+protected:
+  static const int width = 160, height = 120, edge = 80;
+  static const uint16_t near = 1000, far = 1500;
+
+  cv::Mat depth, guide;
+
+  // a vertical depth step with noise, the guide has a step at the same column
+  void SetUp()
+  {
+    std::mt19937 rng(11);
+    depth.create(height, width, CV_16U);
+    guide.create(height, width, CV_8U);
+    for(int r = 0; r < height; ++r)
+    {
+      for(int c = 0; c < width; ++c)
+      {
+        depth.at<uint16_t>(r, c) = (c < edge ? near : far) + rng() % 21 - 10;
+        guide.at<uint8_t>(r, c) = c < edge ? 40 : 200;
+      }
+    }
+    // a few invalid pixels on both sides
+    for(int r = 10; r < height; r += 20)
+    {
+      depth.at<uint16_t>(r, edge - 3) = 0;
+      depth.at<uint16_t>(r, edge + 3) = 0;
+    }
+  }
+
+  void smooth(cv::Mat &image) const
+  {
+    switch(GetParam())
+    {
+    case DOMAIN_TRANSFORM:
+      dip::domainTransformSmoothing(image, 8.0f, 30.0f);
+      break;
+    case GUIDED:
+      dip::guidedSmoothing(image, guide, 8, 30.0f);
+      break;
+    case BILATERAL_GRID:
+      dip::bilateralGridSmoothing(image, guide, 8.0f, 30.0f);
+      break;
+    }
+  }
+
+  // mean absolute deviation from the level of each side, over the columns of [begin, end)
+  double deviation(const cv::Mat &image, const int begin, const int end) const
+  {
+    double sum = 0;
+    int count = 0;
+    for(int r = 0; r < height; ++r)
+    {
+      for(int c = begin; c < end; ++c)
+      {
+        const uint16_t value = image.at<uint16_t>(r, c);
+        if(value)
+        {
+          sum += std::abs((double)value - (c < edge ? near : far));
+          ++count;
+        }
+      }
+    }
+    return sum / count;
+  }
+};
+
+TEST_P(SmoothingTest, PreservesStepEdge)
+{
+  cv::Mat smoothed = depth.clone();
+  smooth(smoothed);
+
+  // the noise is reduced away from the edge
+  EXPECT_LT(deviation(smoothed, 0, edge - 16), 0.5 * deviation(depth, 0, edge - 16));
+  EXPECT_LT(deviation(smoothed, edge + 16, width), 0.5 * deviation(depth, edge + 16, width));
+
+  // while the sides do not bleed into each other right next to the edge, the guided filter averages its
+  // coefficients across the edge and is allowed a small halo
+  const int tolerance = GetParam() == GUIDED ? (far - near) / 8 : 25;
+  for(int r = 0; r < height; ++r)
+  {
+    for(int c = edge - 2; c < edge + 2; ++c)
+    {
+      const uint16_t value = smoothed.at<uint16_t>(r, c);
+      const int level = c < edge ? near : far;
+      EXPECT_NEAR(level, value, tolerance) << "pixel (" << c << ", " << r << ")";
+    }
+  }
+}
+
+TEST_P(SmoothingTest, KeepsInvalidPixels)
+{
+  cv::Mat smoothed = depth.clone();
+  smooth(smoothed);
+  for(int r = 0; r < height; ++r)
+  {
+    for(int c = 0; c < width; ++c)
+    {
+      ASSERT_EQ(depth.at<uint16_t>(r, c) == 0, smoothed.at<uint16_t>(r, c) == 0) << "pixel (" << c << ", " << r << ")";
+    }
+  }
+}
+
+INSTANTIATE_TEST_CASE_P(Modes, SmoothingTest, ::testing::Values(DOMAIN_TRANSFORM, GUIDED, BILATERAL_GRID));
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}